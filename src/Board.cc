@@ -0,0 +1,125 @@
+#include "Board.h"
+
+#include <algorithm>
+
+void ResetGrid(Grid &grid, CellState state) {
+  std::fill(grid.begin(), grid.end(), state);
+}
+
+bool CanPlaceShip(const Grid &grid, int x, int y, int length,
+                  bool isHorizontal) {
+  for (int i = 0; i < length; ++i) {
+    int cx = x + (isHorizontal ? i : 0);
+    int cy = y + (isHorizontal ? 0 : i);
+
+    if (cx < 0 || cx >= kGridCols || cy < 0 || cy >= kGridRows) {
+      return false;
+    }
+    if (grid[CellIndex(cx, cy)] == CellState::Ship) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ApplyFill(Grid &grid, int x, int y, int length, bool isHorizontal) {
+  if (!CanPlaceShip(grid, x, y, length, isHorizontal)) {
+    return false;
+  }
+  for (int i = 0; i < length; ++i) {
+    int cx = x + (isHorizontal ? i : 0);
+    int cy = y + (isHorizontal ? 0 : i);
+    grid[CellIndex(cx, cy)] = CellState::Ship;
+  }
+  return true;
+}
+
+std::vector<Ship> CreateFleet() {
+  return {{4, true}, {3, true}, {3, true}, {2, true}, {2, true},
+          {2, true}, {1, true}, {1, true}, {1, true}, {1, true}};
+}
+
+void RecordShipCells(std::vector<std::uint8_t> &locations, int x, int y,
+                     const Ship &ship) {
+  for (int i = 0; i < ship.length; ++i) {
+    int cx = x + (ship.isHorizontal ? i : 0);
+    int cy = y + (ship.isHorizontal ? 0 : i);
+    locations.push_back(static_cast<std::uint8_t>(CellIndex(cx, cy)));
+  }
+}
+
+CellMask FleetMask(const std::vector<std::uint8_t> &locations) {
+  CellMask mask;
+  for (std::uint8_t cell : locations) {
+    mask.Set(cell);
+  }
+  return mask;
+}
+
+int ShipsAfloat(const std::vector<Ship> &ships,
+                const std::vector<std::uint8_t> &locations,
+                const CellMask &struck) {
+  int afloat = 0;
+  std::size_t next = 0;
+  for (const Ship &ship : ships) {
+    bool whole = false;
+    for (int i = 0; i < ship.length && next < locations.size(); ++i) {
+      bool intact = !struck.Test(locations[next++]);
+      whole = whole || intact;
+    }
+    afloat += whole ? 1 : 0;
+  }
+  return afloat;
+}
+
+bool AutoPlaceFleet(Grid &grid, std::vector<Ship> &ships, int &shipIndex,
+                    std::vector<std::uint8_t> &locations, std::mt19937 &rng) {
+  std::uniform_int_distribution<int> col(0, kGridCols - 1);
+  std::uniform_int_distribution<int> row(0, kGridRows - 1);
+  std::bernoulli_distribution horizontal(0.5);
+
+  for (; static_cast<size_t>(shipIndex) < ships.size(); ++shipIndex) {
+    Ship &ship = ships[shipIndex];
+    bool placed = false;
+
+    for (int attempt = 0; attempt < 64 && !placed; ++attempt) {
+      int x = col(rng);
+      int y = row(rng);
+      ship.isHorizontal = horizontal(rng);
+      if (ApplyFill(grid, x, y, ship.length, ship.isHorizontal)) {
+        RecordShipCells(locations, x, y, ship);
+        placed = true;
+      }
+    }
+
+    for (int i = 0; i < kCellCount * 2 && !placed; ++i) {
+      int x = (i / 2) % kGridCols;
+      int y = (i / 2) / kGridCols;
+      ship.isHorizontal = (i % 2) == 0;
+      if (ApplyFill(grid, x, y, ship.length, ship.isHorizontal)) {
+        RecordShipCells(locations, x, y, ship);
+        placed = true;
+      }
+    }
+
+    if (!placed) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int PickAutoShot(const Grid &targets, std::mt19937 &rng) {
+  int chosen = -1;
+  int candidates = 0;
+  for (int i = 0; i < kCellCount; ++i) {
+    if (targets[i] == CellState::Hit || targets[i] == CellState::Miss) {
+      continue;
+    }
+    ++candidates;
+    if (std::uniform_int_distribution<int>(1, candidates)(rng) == 1) {
+      chosen = i;
+    }
+  }
+  return chosen;
+}
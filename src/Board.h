@@ -0,0 +1,105 @@
+// Board.h
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Headless board rules shared by the windowed game and the dedicated host.
+
+constexpr int kGridCols = 10;
+constexpr int kGridRows = 10;
+constexpr int kCellCount = kGridCols * kGridRows;
+
+// total cells covered by CreateFleet(); sinking them all ends the match
+constexpr int kFleetCellCount = 20;
+// ships in CreateFleet(), and so the most shots a salvo can hold
+constexpr int kFleetShipCount = 10;
+
+enum class Phase { Preparing, Transition, Battle, Finished };
+enum class Turn { None, Server, Client };
+
+enum class GameResult { None, Victory, Defeat };
+
+enum class CellState : std::uint8_t { Empty = 0, Ship, Hit, Miss };
+
+// Classic fires one shot at a time and a hit earns another. Salvo fires one
+// shot per ship the shooter still has afloat, all at once, and the turn
+// passes after every salvo.
+enum class GameMode : std::uint8_t { Classic = 0, Salvo = 1 };
+
+using Grid = std::array<CellState, kCellCount>;
+
+// One bit per cell, so a whole salvo is resolved against a fleet with a
+// couple of word-wide ANDs.
+struct CellMask {
+  std::uint64_t bits[2] = {0, 0};
+
+  void Set(int index) { bits[index >> 6] |= std::uint64_t{1} << (index & 63); }
+  bool Test(int index) const { return (bits[index >> 6] >> (index & 63)) & 1; }
+  bool Empty() const { return (bits[0] | bits[1]) == 0; }
+  bool operator==(const CellMask &other) const {
+    return bits[0] == other.bits[0] && bits[1] == other.bits[1];
+  }
+  int Count() const {
+    return __builtin_popcountll(bits[0]) + __builtin_popcountll(bits[1]);
+  }
+
+  CellMask operator&(const CellMask &other) const {
+    return CellMask{{bits[0] & other.bits[0], bits[1] & other.bits[1]}};
+  }
+  CellMask operator|(const CellMask &other) const {
+    return CellMask{{bits[0] | other.bits[0], bits[1] | other.bits[1]}};
+  }
+  // the cells of this mask that are not in other
+  CellMask Without(const CellMask &other) const {
+    return CellMask{{bits[0] & ~other.bits[0], bits[1] & ~other.bits[1]}};
+  }
+
+  // Calls fn(index) for every cell in the mask, lowest index first.
+  template <typename Fn> void ForEach(Fn &&fn) const {
+    for (int word = 0; word < 2; ++word) {
+      for (std::uint64_t left = bits[word]; left != 0; left &= left - 1) {
+        fn(word * 64 + __builtin_ctzll(left));
+      }
+    }
+  }
+};
+static_assert(kCellCount <= 128, "a CellMask holds 128 cells");
+
+struct Ship {
+  int length;
+  bool isHorizontal;
+};
+
+inline int CellIndex(int x, int y) { return y * kGridCols + x; }
+
+void ResetGrid(Grid &grid, CellState state = CellState::Empty);
+
+bool CanPlaceShip(const Grid &grid, int x, int y, int length,
+                  bool isHorizontal);
+
+bool ApplyFill(Grid &grid, int x, int y, int length, bool isHorizontal);
+
+std::vector<Ship> CreateFleet();
+
+void RecordShipCells(std::vector<std::uint8_t> &locations, int x, int y,
+                     const Ship &ship);
+
+// Every cell the fleet recorded in locations covers.
+CellMask FleetMask(const std::vector<std::uint8_t> &locations);
+
+// Ships with at least one cell outside struck; locations lists their cells
+// ship by ship, as RecordShipCells() writes them.
+int ShipsAfloat(const std::vector<Ship> &ships,
+                const std::vector<std::uint8_t> &locations,
+                const CellMask &struck);
+
+// Places every ship from shipIndex onwards, trying random spots first and
+// falling back to a full scan so a placement is always found when one exists.
+bool AutoPlaceFleet(Grid &grid, std::vector<Ship> &ships, int &shipIndex,
+                    std::vector<std::uint8_t> &locations, std::mt19937 &rng);
+
+// Picks a uniformly random cell that has not been fired at yet, or -1.
+int PickAutoShot(const Grid &targets, std::mt19937 &rng);
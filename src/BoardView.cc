@@ -0,0 +1,117 @@
+#include "BoardView.h"
+
+#include <cmath>
+
+namespace {
+
+// how long a resolved or rolled back prediction takes to fade
+constexpr std::uint32_t kSettleFadeMs = 250;
+
+void FillCell(const BoardView &view, int index, Color color) {
+  DrawRectangleRec(Rectangle{view.x + (index % kGridCols) * view.cellSize + 1,
+                             view.y + (index / kGridCols) * view.cellSize + 1,
+                             view.cellSize - 2, view.cellSize - 2},
+                   color);
+}
+
+// Our shot pulses from the frame it is clicked until its result lands. The
+// result then fades in, and a prediction that was rolled back fades out.
+// Salvo shots still being aimed sit still; a sent salvo pulses as a whole.
+void DrawShotFeedback(const BoardView &view, const SeatState &state,
+                      std::uint32_t nowMs) {
+  float timer = (nowMs - state.pendingSinceMs) / 1000.0f;
+  Color pending = Fade(ORANGE, 0.5f + 0.3f * sinf(timer * 8.0f));
+  if (state.pendingShot >= 0) {
+    FillCell(view, state.pendingShot, pending);
+  }
+  state.pendingSalvo.ForEach(
+      [&view, pending](int index) { FillCell(view, index, pending); });
+  state.aimed.ForEach(
+      [&view](int index) { FillCell(view, index, Fade(ORANGE, 0.6f)); });
+  std::uint32_t age = nowMs - state.settledAtMs;
+  if (state.settledShot >= 0 && age < kSettleFadeMs) {
+    float left = 1.0f - static_cast<float>(age) / kSettleFadeMs;
+    FillCell(view, state.settledShot,
+             Fade(state.settledRolledBack ? ORANGE : RAYWHITE, 0.8f * left));
+  }
+}
+
+} // namespace
+
+bool BoardView::CellAt(Vector2 point, int &cellX, int &cellY) const {
+  if (point.x < x || point.y < y || cellSize <= 0.0f) {
+    return false;
+  }
+  cellX = static_cast<int>((point.x - x) / cellSize);
+  cellY = static_cast<int>((point.y - y) / cellSize);
+  return cellX < kGridCols && cellY < kGridRows;
+}
+
+void DrawBoard(const BoardView &view, const Grid &grid, const SeatState *shots,
+               std::uint32_t nowMs) {
+  for (int i = 0; i < kCellCount; ++i) {
+    switch (grid[i]) {
+    case CellState::Ship:
+      FillCell(view, i, SKYBLUE);
+      break;
+    case CellState::Hit:
+      FillCell(view, i, RED);
+      break;
+    case CellState::Miss:
+      FillCell(view, i, LIGHTGRAY);
+      break;
+    case CellState::Empty:
+    default:
+      break;
+    }
+  }
+  if (shots) {
+    DrawShotFeedback(view, *shots, nowMs);
+  }
+
+  // one quad per grid line instead of an outline per cell
+  float size = view.Size();
+  for (int i = 0; i <= kGridCols; ++i) {
+    DrawRectangleRec(Rectangle{view.x + i * view.cellSize - 0.5f, view.y,
+                               1.0f, size},
+                     LIGHTGRAY);
+  }
+  for (int i = 0; i <= kGridRows; ++i) {
+    DrawRectangleRec(Rectangle{view.x, view.y + i * view.cellSize - 0.5f,
+                               size, 1.0f},
+                     LIGHTGRAY);
+  }
+}
+
+void DrawHover(const BoardView &view, const Grid &grid, int shipLength,
+               bool isHorizontal, Vector2 point) {
+  int cellX = 0;
+  int cellY = 0;
+  if (!view.CellAt(point, cellX, cellY)) {
+    return;
+  }
+
+  bool canPlace = CanPlaceShip(grid, cellX, cellY, shipLength, isHorizontal);
+  Color hoverColor = canPlace ? Fade(SKYBLUE, 0.4f) : Fade(RED, 0.4f);
+
+  for (int i = 0; i < shipLength; ++i) {
+    int hoverX = cellX + (isHorizontal ? i : 0);
+    int hoverY = cellY + (isHorizontal ? 0 : i);
+    if (hoverX >= kGridCols || hoverY >= kGridRows) {
+      break;
+    }
+    DrawRectangleRec(Rectangle{view.x + hoverX * view.cellSize,
+                               view.y + hoverY * view.cellSize, view.cellSize,
+                               view.cellSize},
+                     hoverColor);
+  }
+}
+
+void DrawBoardFrame(const BoardView &view, float thickness, Color color) {
+  Rectangle bounds = view.Bounds();
+  bounds.x -= thickness;
+  bounds.y -= thickness;
+  bounds.width += 2 * thickness;
+  bounds.height += 2 * thickness;
+  DrawRectangleLinesEx(bounds, thickness, color);
+}
@@ -0,0 +1,39 @@
+// BoardView.h
+#pragma once
+
+#include "Board.h"
+#include "Session.h"
+#include "raylib.h"
+
+#include <cstdint>
+
+// Where one board sits in the window. Several views share a frame: the
+// battle screen shows the fleet next to the targeting board and the
+// spectator wall tiles dozens of them.
+struct BoardView {
+  float x = 0.0f;
+  float y = 0.0f;
+  float cellSize = 0.0f;
+
+  float Size() const { return cellSize * kGridCols; }
+  Rectangle Bounds() const {
+    return Rectangle{x, y, cellSize * kGridCols, cellSize * kGridRows};
+  }
+  // Constant time: one subtraction and division per axis.
+  bool CellAt(Vector2 point, int &cellX, int &cellY) const;
+};
+
+// The drawing calls below only queue untextured quads, so any number of
+// boards drawn back to back go out in one raylib batch. Draw text after the
+// boards; it switches to the font texture and starts a new batch. All of
+// them must run between BeginDrawing() and EndDrawing().
+
+// shots, when given, adds the pending/settled feedback for that seat's own
+// shots on this board.
+void DrawBoard(const BoardView &view, const Grid &grid,
+               const SeatState *shots = nullptr, std::uint32_t nowMs = 0);
+// Shades the cells a ship of shipLength would cover at point, which is in
+// the same units as the view.
+void DrawHover(const BoardView &view, const Grid &grid, int shipLength,
+               bool isHorizontal, Vector2 point);
+void DrawBoardFrame(const BoardView &view, float thickness, Color color);
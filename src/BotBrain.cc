@@ -0,0 +1,169 @@
+#include "BotBrain.h"
+
+#include <algorithm>
+#include <map>
+
+namespace {
+
+constexpr int kMaxShipLength = 4;
+// a placement through known hits is this much likelier per hit, which turns
+// the hunt into finishing off the ship once something has been struck
+constexpr float kHitBonus = 24.0f;
+// lanes are padded to a whole vector register of bytes
+constexpr std::size_t kLaneAlign = 32;
+// fewer revealed fleets than this are noise, not a habit
+constexpr std::uint32_t kMinBookFleets = 100;
+// even a strong habit only tilts the search, it never overrules it
+constexpr float kMinBias = 0.5f;
+constexpr float kMaxBias = 2.0f;
+
+} // namespace
+
+BotBrain::BotBrain(std::uint32_t seed) : rng_(seed) {
+  bias_.fill(1.0f);
+  std::map<int, int> lengths;
+  for (const Ship &ship : CreateFleet()) {
+    ++lengths[std::min(ship.length, kMaxShipLength)];
+  }
+
+  // every spot each distinct length can occupy, ships of the same length
+  // folded into one weight
+  for (const auto &[length, count] : lengths) {
+    for (int horizontal = 0; horizontal < 2; ++horizontal) {
+      // a one cell ship reads the same both ways
+      if (length == 1 && horizontal) {
+        break;
+      }
+      int cols = horizontal ? kGridCols - length + 1 : kGridCols;
+      int rows = horizontal ? kGridRows : kGridRows - length + 1;
+      for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < cols; ++x) {
+          Placement placement{};
+          placement.length = static_cast<std::uint8_t>(length);
+          placement.weight = static_cast<float>(count);
+          for (int i = 0; i < length; ++i) {
+            placement.cells[i] = static_cast<std::uint8_t>(
+                CellIndex(x + (horizontal ? i : 0), y + (horizontal ? 0 : i)));
+          }
+          placements_.push_back(placement);
+        }
+      }
+    }
+  }
+}
+
+void BotBrain::UseBook(const OpeningBook &book) {
+  if (book.fleets < kMinBookFleets) {
+    return;
+  }
+  float mean = 0.0f;
+  for (float odds : book.shipOdds) {
+    mean += odds / kCellCount;
+  }
+  if (mean <= 0.0f) {
+    return;
+  }
+  for (int cell = 0; cell < kCellCount; ++cell) {
+    bias_[cell] = std::clamp(book.shipOdds[cell] / mean, kMinBias, kMaxBias);
+  }
+}
+
+void BotBrain::Queue(std::uint32_t token, const Grid &shots) {
+  tokens_.push_back(token);
+  boards_.push_back(shots);
+}
+
+void BotBrain::Evaluate(std::vector<Move> &moves) {
+  moves.clear();
+  if (tokens_.empty()) {
+    return;
+  }
+
+  std::size_t lanes =
+      (tokens_.size() + kLaneAlign - 1) / kLaneAlign * kLaneAlign;
+  Transpose(lanes);
+  Score(lanes);
+  for (std::size_t lane = 0; lane < tokens_.size(); ++lane) {
+    moves.push_back(Move{tokens_[lane], Pick(lane, lanes)});
+  }
+
+  tokens_.clear();
+  boards_.clear();
+}
+
+// Padding lanes stay all-missed, so they score nothing and cost nothing
+// beyond the wasted vector slots.
+void BotBrain::Transpose(std::size_t lanes) {
+  open_.assign(kCellCount * lanes, 0);
+  hit_.assign(kCellCount * lanes, 0);
+  score_.assign(kCellCount * lanes, 0.0f);
+  fits_.resize(lanes);
+  hits_.resize(lanes);
+  weight_.resize(lanes);
+
+  for (std::size_t lane = 0; lane < boards_.size(); ++lane) {
+    const Grid &board = boards_[lane];
+    for (int cell = 0; cell < kCellCount; ++cell) {
+      open_[cell * lanes + lane] = board[cell] != CellState::Miss;
+      hit_[cell * lanes + lane] = board[cell] == CellState::Hit;
+    }
+  }
+}
+
+void BotBrain::Score(std::size_t lanes) {
+  std::uint8_t *fits = fits_.data();
+  std::uint8_t *hits = hits_.data();
+  float *weight = weight_.data();
+
+  for (const Placement &placement : placements_) {
+    const std::uint8_t *open = &open_[placement.cells[0] * lanes];
+    const std::uint8_t *hit = &hit_[placement.cells[0] * lanes];
+    for (std::size_t b = 0; b < lanes; ++b) {
+      fits[b] = open[b];
+      hits[b] = hit[b];
+    }
+    for (int i = 1; i < placement.length; ++i) {
+      open = &open_[placement.cells[i] * lanes];
+      hit = &hit_[placement.cells[i] * lanes];
+      for (std::size_t b = 0; b < lanes; ++b) {
+        fits[b] &= open[b];
+        hits[b] += hit[b];
+      }
+    }
+
+    for (std::size_t b = 0; b < lanes; ++b) {
+      weight[b] = fits[b] * placement.weight * (1.0f + kHitBonus * hits[b]);
+    }
+    for (int i = 0; i < placement.length; ++i) {
+      float *score = &score_[placement.cells[i] * lanes];
+      for (std::size_t b = 0; b < lanes; ++b) {
+        score[b] += weight[b];
+      }
+    }
+  }
+}
+
+// The best scoring untried cell, ties broken at random so two bots facing
+// the same board do not open the same way.
+int BotBrain::Pick(std::size_t lane, std::size_t lanes) {
+  const Grid &board = boards_[lane];
+  int chosen = -1;
+  float best = 0.0f;
+  int ties = 0;
+  for (int cell = 0; cell < kCellCount; ++cell) {
+    if (board[cell] != CellState::Empty) {
+      continue;
+    }
+    float score = score_[cell * lanes + lane] * bias_[cell];
+    if (score > best) {
+      best = score;
+      chosen = cell;
+      ties = 1;
+    } else if (score == best && score > 0.0f &&
+               std::uniform_int_distribution<int>(0, ties++)(rng_) == 0) {
+      chosen = cell;
+    }
+  }
+  // nothing fits any more, which only a lying opponent can cause
+  return chosen >= 0 ? chosen : PickAutoShot(board, rng_);
+}
@@ -0,0 +1,69 @@
+// BotBrain.h
+#pragma once
+
+#include "Board.h"
+#include "ReplayBook.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Picks shots for every server bot that owes a move this tick in one batch.
+//
+// Each bot scores its targeting board by probability density: every way the
+// fleet could still lie across the cells it has not missed adds weight to
+// the cells it covers, heavily so when it runs through a known hit. The
+// boards are transposed to structure-of-arrays with the bots as the inner
+// dimension, so each placement is scored for all of them by plain loops
+// over contiguous lanes, which the compiler turns into vector code.
+class BotBrain {
+public:
+  struct Move {
+    std::uint32_t token; // as queued
+    int cell;            // -1 when the board has nothing left to fire at
+  };
+
+  explicit BotBrain(std::uint32_t seed);
+
+  // Leans the search towards where people really put their ships. The
+  // density search alone treats every layout as equally likely.
+  void UseBook(const OpeningBook &book);
+
+  // shots is the bot's targeting board: Hit and Miss marks, Empty untried.
+  void Queue(std::uint32_t token, const Grid &shots);
+  // Scores everything queued since the last call and clears the queue.
+  void Evaluate(std::vector<Move> &moves);
+
+  std::size_t Queued() const { return tokens_.size(); }
+
+private:
+  struct Placement {
+    std::uint8_t cells[4];
+    std::uint8_t length;
+    float weight; // ships of this length in the fleet
+  };
+
+  void Transpose(std::size_t lanes);
+  void Score(std::size_t lanes);
+  int Pick(std::size_t lane, std::size_t lanes);
+
+  std::vector<Placement> placements_;
+  std::vector<std::uint32_t> tokens_;
+  std::vector<Grid> boards_;
+
+  // [cell * lanes + bot]
+  std::vector<std::uint8_t> open_; // 1 unless the bot missed there
+  std::vector<std::uint8_t> hit_;
+  std::vector<float> score_;
+  // [bot], scratch for one placement
+  std::vector<std::uint8_t> fits_;
+  std::vector<std::uint8_t> hits_;
+  std::vector<float> weight_;
+
+  // [cell], how much likelier than average a ship is there
+  std::array<float, kCellCount> bias_;
+
+  std::mt19937 rng_;
+};
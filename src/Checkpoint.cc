@@ -0,0 +1,199 @@
+#include "Checkpoint.h"
+
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+#include <unistd.h>
+
+namespace {
+
+constexpr std::uint32_t kCheckpointMagic = 0x4B434D41; // "AMCK"
+constexpr std::size_t kQueueCapacity = 64;
+constexpr auto kIdleWait = std::chrono::milliseconds(20);
+// the log is rewritten once it holds this many entries and four times
+// as many as there are live records
+constexpr std::size_t kCompactAfter = 4096;
+
+enum EntryKind : std::uint8_t { kPut = 1, kRemove = 2 };
+
+struct FileHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t recordSize;
+};
+
+bool WriteEntry(std::FILE *file, EntryKind kind, std::uint32_t key,
+                const std::uint8_t *record, std::size_t recordSize) {
+  return std::fwrite(&kind, sizeof(kind), 1, file) == 1 &&
+         std::fwrite(&key, sizeof(key), 1, file) == 1 &&
+         (kind != kPut || std::fwrite(record, recordSize, 1, file) == 1);
+}
+
+} // namespace
+
+CheckpointLog::CheckpointLog(std::string path, std::size_t recordSize,
+                             std::uint32_t version)
+    : path_(std::move(path)), recordSize_(recordSize), version_(version) {}
+
+CheckpointLog::~CheckpointLog() { Stop(); }
+
+std::size_t CheckpointLog::Load(
+    const std::function<void(std::uint32_t, const std::uint8_t *)> &fn) {
+  std::FILE *file = std::fopen(path_.c_str(), "rb");
+  if (!file) {
+    return 0;
+  }
+  FileHeader header{};
+  if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != kCheckpointMagic || header.version != version_ ||
+      header.recordSize != recordSize_) {
+    Log(LogLevel::Warn, "Ignoring checkpoint %s from another version",
+        path_);
+    std::fclose(file);
+    return 0;
+  }
+
+  std::vector<std::uint8_t> record(recordSize_);
+  EntryKind kind{};
+  std::uint32_t key = 0;
+  while (std::fread(&kind, sizeof(kind), 1, file) == 1 &&
+         std::fread(&key, sizeof(key), 1, file) == 1) {
+    if (kind == kRemove) {
+      live_.erase(key);
+    } else if (kind == kPut &&
+               std::fread(record.data(), recordSize_, 1, file) == 1) {
+      live_[key] = record;
+    } else {
+      break; // torn by a crash mid-write
+    }
+  }
+  std::fclose(file);
+
+  std::vector<std::uint32_t> keys;
+  keys.reserve(live_.size());
+  for (const auto &entry : live_) {
+    keys.push_back(entry.first);
+  }
+  std::sort(keys.begin(), keys.end());
+  for (std::uint32_t liveKey : keys) {
+    fn(liveKey, live_[liveKey].data());
+  }
+  return keys.size();
+}
+
+bool CheckpointLog::Start(std::size_t producers) {
+  // a snapshot of what was loaded, which also drops any torn tail
+  if (!Compact()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < producers; ++i) {
+    queues_.push_back(
+        std::make_unique<SpscQueue<CheckpointDelta>>(kQueueCapacity));
+  }
+  thread_ = std::thread(&CheckpointLog::Run, this);
+  return true;
+}
+
+void CheckpointLog::Stop() {
+  stopping_.store(true, std::memory_order_release);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  if (file_) {
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+void CheckpointLog::Run() {
+  while (true) {
+    // read first, so a delta queued before Stop() is still written
+    bool stopping = stopping_.load(std::memory_order_acquire);
+    if (!Drain()) {
+      if (stopping) {
+        break;
+      }
+      std::this_thread::sleep_for(kIdleWait);
+      continue;
+    }
+    if (!file_ || std::fflush(file_) != 0 ||
+        ::fdatasync(::fileno(file_)) != 0) {
+      Log(LogLevel::Error, "Failed to write checkpoint %s", path_);
+    }
+    if (appended_ >= kCompactAfter && appended_ >= 4 * live_.size()) {
+      Compact();
+    }
+  }
+}
+
+bool CheckpointLog::Drain() {
+  bool any = false;
+  CheckpointDelta delta;
+  for (auto &queue : queues_) {
+    while (queue->TryPop(delta)) {
+      Append(delta);
+      any = true;
+    }
+  }
+  return any;
+}
+
+// Without a file the records are still kept, so the next snapshot that
+// gets written has them.
+void CheckpointLog::Append(const CheckpointDelta &delta) {
+  for (std::size_t i = 0; i < delta.keys.size(); ++i) {
+    const std::uint8_t *record = delta.records.data() + i * recordSize_;
+    live_[delta.keys[i]].assign(record, record + recordSize_);
+    if (file_) {
+      WriteEntry(file_, kPut, delta.keys[i], record, recordSize_);
+    }
+    ++appended_;
+  }
+  for (std::uint32_t key : delta.removed) {
+    if (live_.erase(key) > 0) {
+      if (file_) {
+        WriteEntry(file_, kRemove, key, nullptr, 0);
+      }
+      ++appended_;
+    }
+  }
+}
+
+// Writes the live records to a fresh file and swaps it in, so a crash
+// halfway leaves the old log in place. The fresh file's handle, already at
+// its end, becomes the one later entries are appended through.
+bool CheckpointLog::Compact() {
+  std::string tempPath = path_ + ".tmp";
+  std::FILE *file = std::fopen(tempPath.c_str(), "wb");
+  if (!file) {
+    Log(LogLevel::Error, "Failed to open %s for writing", tempPath);
+    return false;
+  }
+
+  FileHeader header{kCheckpointMagic, version_,
+                    static_cast<std::uint32_t>(recordSize_)};
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+  for (const auto &[key, record] : live_) {
+    if (!ok) {
+      break;
+    }
+    ok = WriteEntry(file, kPut, key, record.data(), recordSize_);
+  }
+  ok = std::fflush(file) == 0 && ::fsync(::fileno(file)) == 0 && ok;
+  if (!ok || std::rename(tempPath.c_str(), path_.c_str()) != 0) {
+    Log(LogLevel::Error, "Failed to write checkpoint %s", path_);
+    std::fclose(file);
+    std::remove(tempPath.c_str());
+    return false;
+  }
+
+  if (file_) {
+    std::fclose(file_);
+  }
+  file_ = file;
+  appended_ = 0;
+  return true;
+}
@@ -0,0 +1,68 @@
+// Checkpoint.h
+#pragma once
+
+#include "SpscQueue.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// What one producer changed since its last delta: records written or
+// rewritten, and keys whose record is gone.
+struct CheckpointDelta {
+  std::vector<std::uint32_t> keys;   // one per record
+  std::vector<std::uint8_t> records; // recordSize bytes each, back to back
+  std::vector<std::uint32_t> removed;
+};
+
+// Fixed-size records kept on disk so a restarted process can pick them up
+// again. Producers hand over deltas through a queue of their own; a writer
+// thread appends them to a log file and rewrites the log as one snapshot
+// once it has grown well past the live set, so producers never wait on the
+// disk. A torn tail from a crash is ignored, and a file written with
+// another record size or version is not loaded at all.
+class CheckpointLog {
+public:
+  CheckpointLog(std::string path, std::size_t recordSize,
+                std::uint32_t version);
+  ~CheckpointLog();
+
+  CheckpointLog(const CheckpointLog &) = delete;
+  CheckpointLog &operator=(const CheckpointLog &) = delete;
+
+  // Before Start(): fn(key, record) for every record the last process
+  // left. Returns how many there were.
+  std::size_t Load(
+      const std::function<void(std::uint32_t, const std::uint8_t *)> &fn);
+  // Starts the writer with one queue per producer; false when the file
+  // cannot be written.
+  bool Start(std::size_t producers);
+  SpscQueue<CheckpointDelta> &Queue(std::size_t producer) {
+    return *queues_[producer];
+  }
+  // Writes whatever is still queued, then stops the writer.
+  void Stop();
+
+private:
+  void Run();
+  bool Drain();
+  void Append(const CheckpointDelta &delta);
+  bool Compact();
+
+  std::string path_;
+  std::size_t recordSize_;
+  std::uint32_t version_;
+  std::unordered_map<std::uint32_t, std::vector<std::uint8_t>> live_;
+  std::vector<std::unique_ptr<SpscQueue<CheckpointDelta>>> queues_;
+  std::FILE *file_ = nullptr;
+  std::size_t appended_ = 0; // log entries since the last snapshot
+  std::atomic<bool> stopping_{false};
+  std::thread thread_;
+};
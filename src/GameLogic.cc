@@ -1,403 +1,477 @@
 #include "GameLogic.h"
 
+#include "Board.h"
+#include "BoardView.h"
 #include "GameState.h"
+#include "LocalTransport.h"
+#include "Log.h"
+#include "Protocol.h"
+#include "RateLimit.h"
+#include "ResultStore.h"
+#include "Session.h"
+#include "Trace.h"
+#include "Transport.h"
 #include "raylib.h"
 
-#include <algorithm>
-#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <ctime>
+#include <future>
+#include <random>
 #include <string>
-#include <vector>
+#include <utility>
 
 #include <enet/enet.h>
 
 namespace {
 
-constexpr enet_uint8 kChannel = 0;
-constexpr enet_uint16 kServerPort = 7777;
+// Preparing fills the window with our own board; battle puts our fleet next
+// to the enemy's waters. All in design units, scaled by gameState.viewport.
+const BoardView kPlacementBoard{0.0f, 0.0f, kCellSize};
+const BoardView kFleetBoard{10.0f, 160.0f, 28.0f};
+const BoardView kTargetBoard{310.0f, 160.0f, 28.0f};
 
-static_assert(kWindowSize % kGridCols == 0,
-              "Window size must be divisible by grid cols");
-static_assert(kWindowSize % kGridRows == 0,
-              "Window size must be divisible by grid rows");
+const Vector2 kHeadlinePosition{20.0f, 20.0f};
 
-enum class MessageType : std::uint8_t {
-  CellRequest = 1,
-  CellUpdate = 2,
-  GridSnapshot = 3,
-  FinishedPreparing = 4,
-  TurnUpdate = 5
-};
-
-enum class CellState : std::uint8_t { Empty = 0, Ship, Hit, Miss };
-
-constexpr int kCellCount = kGridCols * kGridRows;
-using Grid = std::array<CellState, kCellCount>;
-
-struct Ship {
-  int length;
-  bool isHorizontal;
-};
-
-#pragma pack(push, 1)
-struct CellRequestMessage {
-  std::uint8_t type;
-  std::uint16_t x;
-  std::uint16_t y;
-};
+// the opponent, plus a spare slot to tell latecomers the game is taken
+constexpr std::size_t kServerPeers = 2;
 
-struct CellUpdateMessage {
-  std::uint8_t type;
-  std::uint16_t x;
-  std::uint16_t y;
-  CellState filled;
-};
+void DrawBattle(const SeatState &state, bool myTurn, std::uint32_t nowMs,
+                const std::string &headline) {
+  static CachedText headlineText(22);
+  static CachedText fleetLabel(20);
+  static CachedText targetLabel(20);
+  const Viewport &viewport = gameState.viewport;
 
-struct GridSnapshotMessage {
-  std::uint8_t type;
-  std::uint16_t width;
-  std::uint16_t height;
-  std::uint8_t cells[kCellCount];
-};
-
-struct FinishedPreparingMessage {
-  std::uint8_t type;
-  std::uint8_t finished;
-};
+  BeginDrawing();
+  ClearBackground(RAYWHITE);
 
-struct TurnUpdateMessage {
-  std::uint8_t type;
-  std::uint8_t currentTurn; // 0 = server, 1 = client
-};
-#pragma pack(pop)
+  BeginMode2D(viewport.Camera());
+  DrawBoard(kFleetBoard, state.playerGrid);
+  DrawBoard(kTargetBoard, state.enemyGrid, &state, nowMs);
+  // the board that needs attention right now
+  DrawBoardFrame(myTurn ? kTargetBoard : kFleetBoard, 3.0f, SKYBLUE);
+  if (myTurn) {
+    DrawHover(kTargetBoard, state.enemyGrid, 1, true, viewport.Mouse());
+  }
+  EndMode2D();
 
-int CellIndex(int x, int y) { return y * kGridCols + x; }
+  headlineText.Draw(viewport, headline.c_str(), kHeadlinePosition, DARKGRAY);
+  fleetLabel.Draw(viewport, "Your fleet",
+                  Vector2{kFleetBoard.x, kFleetBoard.y - 34}, GRAY);
+  targetLabel.Draw(viewport, "Enemy waters",
+                   Vector2{kTargetBoard.x, kTargetBoard.y - 34}, GRAY);
+  EndDrawing();
+}
 
-void ResetGrid(Grid &grid, CellState state = CellState::Empty) {
-  std::fill(grid.begin(), grid.end(), state);
+const char *DisconnectText(enet_uint32 data) {
+  switch (static_cast<DisconnectReason>(data)) {
+  case DisconnectReason::Busy:
+    return ": the game is already full";
+  case DisconnectReason::Flooding:
+    return ": too many messages";
+  case DisconnectReason::QueueFull:
+    return ": the lobby is full, try again later";
+  case DisconnectReason::Restarting:
+    return ": the server is restarting";
+  case DisconnectReason::MatchOver:
+    return ": the match is over";
+  case DisconnectReason::None:
+  default:
+    return "";
+  }
 }
 
-bool CanPlaceShip(const Grid &grid, int x, int y, int length,
-                  bool isHorizontal) {
-  for (int i = 0; i < length; ++i) {
-    int cx = x + (isHorizontal ? i : 0);
-    int cy = y + (isHorizontal ? 0 : i);
+// Stable identity for the matchmaking lobby's rating table.
+std::uint64_t LoadOrCreatePlayerId() {
+  const char *path = "amiral_player.id";
+  unsigned long long id = 0;
 
-    if (cx < 0 || cx >= kGridCols || cy < 0 || cy >= kGridRows) {
-      return false;
+  if (std::FILE *file = std::fopen(path, "r")) {
+    if (std::fscanf(file, "%llx", &id) != 1) {
+      id = 0;
     }
-    if (grid[CellIndex(cx, cy)] == CellState::Ship) {
-      return false;
+    std::fclose(file);
+  }
+
+  if (id == 0) {
+    std::random_device device;
+    id = (static_cast<unsigned long long>(device()) << 32) | device();
+    if (std::FILE *file = std::fopen(path, "w")) {
+      std::fprintf(file, "%016llx\n", id);
+      std::fclose(file);
     }
   }
-  return true;
+  return static_cast<std::uint64_t>(id);
 }
 
-bool ApplyFill(Grid &grid, int x, int y, int length, bool isHorizontal) {
-  if (!CanPlaceShip(grid, x, y, length, isHorizontal)) {
-    return false;
+std::shared_future<std::uint64_t> playerId;
+
+std::uint64_t PlayerId() {
+  if (!playerId.valid()) {
+    WarmStart();
   }
-  for (int i = 0; i < length; ++i) {
-    int cx = x + (isHorizontal ? i : 0);
-    int cy = y + (isHorizontal ? 0 : i);
-    grid[CellIndex(cx, cy)] = CellState::Ship;
+  return playerId.get();
+}
+
+std::string WithCountdown(const std::string &text, enet_uint32 deadline) {
+  if (deadline == 0) {
+    return text;
   }
-  return true;
+  enet_uint32 now = enet_time_get();
+  enet_uint32 left = (deadline > now) ? (deadline - now + 999) / 1000 : 0;
+  return text + " - " + std::to_string(left) + "s";
 }
 
-void ApplyHover(const Grid &grid, int shipLength, bool isHorizontal) {
-  Vector2 mousePos = GetMousePosition();
-  int cellX = static_cast<int>(mousePos.x) / kCellSize;
-  int cellY = static_cast<int>(mousePos.y) / kCellSize;
+// In salvo mode, how much of this turn's salvo has been aimed.
+std::string WithSalvo(const std::string &text, const SeatState &state) {
+  if (state.mode != GameMode::Salvo) {
+    return text;
+  }
+  return text + " - " + std::to_string(state.aimed.Count()) + "/" +
+         std::to_string(state.salvoSize) + " shots";
+}
 
-  if (cellX < 0 || cellX >= kGridCols || cellY < 0 || cellY >= kGridRows) {
-    return;
+// ENet backed link to whichever peer is on the other end of the match. A
+// host seats the first peer to connect, turns the rest away and holds the
+// seated one to its message budget.
+class EnetTransport : public Transport {
+public:
+  explicit EnetTransport(ENetHost *host,
+                         const RateLimitConfig &limits = RateLimitConfig{})
+      : host_(host), limits_(limits) {}
+  ~EnetTransport() override { Release(); }
+
+  EnetTransport(const EnetTransport &) = delete;
+  EnetTransport &operator=(const EnetTransport &) = delete;
+
+  void SetPeer(ENetPeer *peer) { peer_ = peer; }
+  ENetPeer *Peer() const { return peer_; }
+  bool IsConnected() const {
+    return peer_ && peer_->state == ENET_PEER_STATE_CONNECTED;
   }
 
-  bool canPlace = CanPlaceShip(grid, cellX, cellY, shipLength, isHorizontal);
-  Color hoverColor = canPlace ? Fade(SKYBLUE, 0.4f) : Fade(RED, 0.4f);
+  void Send(const void *data, std::size_t size) override {
+    if (!IsConnected()) {
+      return;
+    }
+    ENetPacket *packet =
+        enet_packet_create(data, size, ENET_PACKET_FLAG_RELIABLE);
+    enet_peer_send(peer_, kChannel, packet);
+  }
 
-  for (int i = 0; i < shipLength; ++i) {
-    int hoverX = cellX + (isHorizontal ? i : 0);
-    int hoverY = cellY + (isHorizontal ? 0 : i);
+  // Sends are queued; the frame loop flushes once per batch of them.
+  void Flush() override { enet_host_flush(host_); }
+  std::uint32_t RoundTripMs() const override {
+    return peer_ ? peer_->roundTripTime : 0;
+  }
 
-    if (hoverX < 0 || hoverX >= kGridCols || hoverY < 0 ||
-        hoverY >= kGridRows) {
-      break;
+  void Disconnect() override {
+    if (peer_) {
+      enet_peer_disconnect(peer_, 0);
     }
-
-    Rectangle cellRect{static_cast<float>(hoverX * kCellSize),
-                       static_cast<float>(hoverY * kCellSize),
-                       static_cast<float>(kCellSize),
-                       static_cast<float>(kCellSize)};
-    DrawRectangleRec(cellRect, hoverColor);
   }
-}
 
-void DrawGrid(const Grid &grid, const std::string &headline) {
-  BeginDrawing();
-  ClearBackground(RAYWHITE);
+  void Refuse() override {
+    if (peer_) {
+      enet_peer_disconnect(
+          peer_, static_cast<enet_uint32>(DisconnectReason::Busy));
+      peer_ = nullptr;
+    }
+  }
 
-  for (int y = 0; y < kGridRows; ++y) {
-    for (int x = 0; x < kGridCols; ++x) {
-      Rectangle cellRect{
-          static_cast<float>(x * kCellSize), static_cast<float>(y * kCellSize),
-          static_cast<float>(kCellSize), static_cast<float>(kCellSize)};
-      DrawRectangleLinesEx(cellRect, 1.0f, LIGHTGRAY);
-
-      CellState state = grid[CellIndex(x, y)];
-      Color fillColor = RAYWHITE;
-      switch (state) {
-      case CellState::Ship:
-        fillColor = SKYBLUE;
-        break;
-      case CellState::Hit:
-        fillColor = RED;
-        break;
-      case CellState::Miss:
-        fillColor = LIGHTGRAY;
+  bool Poll(TransportEvent &event) override {
+    Release();
+    ENetEvent raw;
+    while (enet_host_service(host_, &raw, 0) > 0) {
+      event = TransportEvent{};
+      switch (raw.type) {
+      case ENET_EVENT_TYPE_CONNECT:
+        if (peer_ && raw.peer != peer_) {
+          enet_peer_disconnect(
+              raw.peer, static_cast<enet_uint32>(DisconnectReason::Busy));
+          ++refused_;
+          break;
+        }
+        Log(LogLevel::Info, "Peer connected: %x:%u", raw.peer->address.host,
+            raw.peer->address.port);
+        peer_ = raw.peer;
+        budget_.Reset(limits_, enet_time_get());
+        event.type = TransportEvent::Type::Connected;
+        return true;
+      case ENET_EVENT_TYPE_DISCONNECT:
+        if (raw.peer != peer_) {
+          break; // turned away, or a connection we already left
+        }
+        peer_ = nullptr;
+        event.type = TransportEvent::Type::Disconnected;
+        event.reason = raw.data;
+        return true;
+      case ENET_EVENT_TYPE_RECEIVE:
+        // only the seated peer is heard, and only within its budget
+        if (raw.peer != peer_) {
+          ++dropped_;
+        } else if (!budget_.Take(limits_, enet_time_get())) {
+          ++dropped_;
+          if (budget_.Exhausted(limits_)) {
+            Log(LogLevel::Warn, "Peer kept flooding, dropping it");
+            enet_peer_disconnect(
+                raw.peer, static_cast<enet_uint32>(DisconnectReason::Flooding));
+          }
+        } else {
+          packet_ = raw.packet;
+          event.type = TransportEvent::Type::Message;
+          event.data = packet_->data;
+          event.size = packet_->dataLength;
+          return true;
+        }
+        enet_packet_destroy(raw.packet);
         break;
-      case CellState::Empty:
+      case ENET_EVENT_TYPE_NONE:
       default:
         break;
       }
+    }
+    return false;
+  }
 
-      if (state != CellState::Empty) {
-        DrawRectangle(x * kCellSize + 1, y * kCellSize + 1, kCellSize - 2,
-                      kCellSize - 2, fillColor);
-      }
+  std::uint32_t Refused() const { return refused_; }
+  std::uint32_t Dropped() const { return dropped_; }
+
+  using Transport::Send;
+
+private:
+  // the message handed out by the last Poll()
+  void Release() {
+    if (packet_) {
+      enet_packet_destroy(packet_);
+      packet_ = nullptr;
     }
   }
 
-  DrawText(headline.c_str(), 20, 20, 22, DARKGRAY);
-  EndDrawing();
-}
+  ENetHost *host_;
+  ENetPeer *peer_ = nullptr;
+  ENetPacket *packet_ = nullptr;
+  RateLimitConfig limits_;
+  TokenBucket budget_;
+  std::uint32_t refused_ = 0;
+  std::uint32_t dropped_ = 0;
+};
 
-std::vector<Ship> CreateFleet() {
-  return {{4, true}, {3, true}, {3, true}, {2, true}, {2, true},
-          {2, true}, {1, true}, {1, true}, {1, true}, {1, true}};
-}
+// What the host's session talks through: the link its opponent arrived on,
+// ENet or shared memory, whichever came first.
+class SeatTransport : public Transport {
+public:
+  void Seat(Transport *link) { link_ = link; }
+  Transport *Link() const { return link_; }
 
-void RecordShipCells(std::vector<std::uint8_t> &locations, int x, int y,
-                     const Ship &ship) {
-  for (int i = 0; i < ship.length; ++i) {
-    int cx = x + (ship.isHorizontal ? i : 0);
-    int cy = y + (ship.isHorizontal ? 0 : i);
-    locations.push_back(static_cast<std::uint8_t>(CellIndex(cx, cy)));
+  void Send(const void *data, std::size_t size) override {
+    if (link_) {
+      link_->Send(data, size);
+    }
+  }
+  void Disconnect() override {
+    if (link_) {
+      link_->Disconnect();
+    }
+  }
+  void Flush() override {
+    if (link_) {
+      link_->Flush();
+    }
+  }
+  std::uint32_t RoundTripMs() const override {
+    return link_ ? link_->RoundTripMs() : 0;
   }
-}
 
-void BroadcastCellUpdate(ENetHost *host, int x, int y, CellState filled) {
-  CellUpdateMessage msg{static_cast<std::uint8_t>(MessageType::CellUpdate),
-                        static_cast<std::uint16_t>(x),
-                        static_cast<std::uint16_t>(y), filled};
-  ENetPacket *packet =
-      enet_packet_create(&msg, sizeof(msg), ENET_PACKET_FLAG_RELIABLE);
-  enet_host_broadcast(host, kChannel, packet);
-  enet_host_flush(host);
+  using Transport::Send;
+
+private:
+  Transport *link_ = nullptr;
+};
+
+bool IsLoopback(const ENetAddress &address) {
+  // ENet keeps the address in network byte order
+  const auto *bytes = reinterpret_cast<const std::uint8_t *>(&address.host);
+  return bytes[0] == 127;
 }
 
-void SendGridSnapshot(ENetPeer *peer, const Grid &grid) {
-  if (!peer || peer->state != ENET_PEER_STATE_CONNECTED) {
-    return;
+// Ship placement input shared by both seats during Phase::Preparing.
+void HandlePlacement(PeerSession &session, const std::string &headline) {
+  static CachedText headlineText(22);
+  const Viewport &viewport = gameState.viewport;
+  const SeatState &state = session.State();
+  if (static_cast<size_t>(state.shipIndex) < state.ships.size()) {
+    if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
+      session.RotateShip();
+    }
+
+    int cellX = 0;
+    int cellY = 0;
+    if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) &&
+        kPlacementBoard.CellAt(viewport.Mouse(), cellX, cellY)) {
+      session.PlaceShip(cellX, cellY);
+    }
   }
 
-  GridSnapshotMessage msg{};
-  msg.type = static_cast<std::uint8_t>(MessageType::GridSnapshot);
-  msg.width = static_cast<std::uint16_t>(kGridCols);
-  msg.height = static_cast<std::uint16_t>(kGridRows);
+  BeginDrawing();
+  ClearBackground(RAYWHITE);
+  BeginMode2D(viewport.Camera());
+  DrawBoard(kPlacementBoard, state.playerGrid);
+  // the ship just placed moves the hover on to the next one
+  if (static_cast<size_t>(state.shipIndex) < state.ships.size()) {
+    const Ship &ship = state.ships[state.shipIndex];
+    DrawHover(kPlacementBoard, state.playerGrid, ship.length,
+              ship.isHorizontal, viewport.Mouse());
+  }
+  EndMode2D();
+  headlineText.Draw(viewport,
+                    WithCountdown(headline, state.prepareDeadlineMs).c_str(),
+                    kHeadlinePosition, DARKGRAY);
+  EndDrawing();
+}
 
-  for (int i = 0; i < kCellCount; ++i) {
-    msg.cells[i] = static_cast<std::uint8_t>(grid[i]);
+// A click on the enemy grid, sent before the frame is drawn. Traced from
+// the click to the datagram leaving.
+void FireNow(PeerSession &session, Transport &transport, int x, int y,
+             std::uint32_t nowMs) {
+  TraceScope span("fire");
+  std::uint32_t previous = session.State().shotTrace;
+  session.Fire(x, y, nowMs);
+  transport.Flush();
+  if (session.State().shotTrace != previous) {
+    span.Bind(session.State().shotTrace);
   }
+}
+
+bool FinishedScreen(const SeatState &state, float &finishedTimer) {
+  finishedTimer += GetFrameTime();
+  GameResult screenResult =
+      (state.outcome == GameResult::None) ? GameResult::Defeat : state.outcome;
+  DrawFinishedScreen(screenResult, finishedTimer);
 
-  ENetPacket *packet =
-      enet_packet_create(&msg, sizeof(msg), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, kChannel, packet);
-  enet_host_flush(peer->host);
+  return IsKeyPressed(KEY_ENTER) || IsKeyPressed(KEY_SPACE) ||
+         IsKeyPressed(KEY_ESCAPE) || IsMouseButtonPressed(MOUSE_LEFT_BUTTON);
 }
 
 } // namespace
 
-int RunServer() {
+void WarmStart() {
+  if (!playerId.valid()) {
+    playerId = std::async(std::launch::async, LoadOrCreatePlayerId).share();
+  }
+}
+
+int RunServer(const DeadlineConfig &deadlines, GameMode mode) {
   ENetAddress address{};
   address.host = ENET_HOST_ANY;
   address.port = kServerPort;
 
-  ENetHost *host = enet_host_create(&address, 32, 1, 0, 0);
+  ENetHost *host = enet_host_create(&address, kServerPeers, 1,
+                                    kServerPeers * kPeerBandwidth, 0);
   if (!host) {
-    std::fprintf(stderr, "Failed to create ENet server host\n");
+    Log(LogLevel::Error, "Failed to create ENet server host");
     return 1;
   }
+  host->maximumPacketSize = kMaxPacketSize;
+  host->maximumWaitingData = kMaxWaitingData;
 
-  ENetPeer *connectedPeer = nullptr;
-
-  InitWindow(kWindowSize, kWindowSize, "ENet Server - Shared Grid");
+  OpenWindow("ENet Server - Shared Grid");
   SetTargetFPS(60);
 
-  Grid playerGrid{};
-  Grid enemyGrid{};
-
-  std::vector<std::uint8_t> shipLocations;
-  shipLocations.reserve(20);
-
-  std::vector<Ship> ships = CreateFleet();
-
-  Turn currentTurn = Turn::Server;
-  int currentShipIndex = 0;
-  int hittedShipCount = 0;
-  int enemyHitCount = 0;
+  // a guest on this machine skips the network altogether
+  EnetTransport remote(host, RateLimitConfig{});
+  LocalTransport local;
+  if (!local.Listen(kServerPort)) {
+    Log(LogLevel::Warn, "Local guests will connect over ENet");
+  }
+  Transport *const links[] = {&local, &remote};
 
-  bool serverFinishedPreparing = false;
-  bool clientFinishedPreparing = false;
+  SeatTransport transport;
+  HostSession session(transport, deadlines, std::random_device{}(),
+                      enet_time_get(), mode);
+  const SeatState &state = session.State();
 
-  bool resetGrid = false;
+  // seat 0 is this host, seat 1 the client
+  ResultWriter results("results");
+  const std::uint64_t hostPlayerId = PlayerId();
+  const enet_uint32 matchStartMs = enet_time_get();
+  bool resultSubmitted = false;
 
   std::string headline = "Server: Preparing Phase";
-
-  Phase currentPhase = Phase::Preparing;
-  float transitionTimer = 0.0f;
   float finishedTimer = 0.0f;
-  GameResult outcome = GameResult::None;
   bool exitRequested = false;
 
-  while (!WindowShouldClose()) {
-    ENetEvent event;
-    while (enet_host_service(host, &event, 0) > 0) {
-      switch (event.type) {
-      case ENET_EVENT_TYPE_CONNECT:
-        std::printf("Client connected: %x:%u\n", event.peer->address.host,
-                    event.peer->address.port);
-        connectedPeer = event.peer;
-        gameState.isClientConnected = true;
-        SendGridSnapshot(event.peer, playerGrid);
-        break;
-      case ENET_EVENT_TYPE_DISCONNECT:
-        std::printf("Client disconnected\n");
-        if (connectedPeer == event.peer) {
-          connectedPeer = nullptr;
-        }
-        event.peer->data = nullptr;
+  std::uint32_t refusedPeers = 0;
+  StartupTimes &startup = gameState.startup;
+  SetTraceProcess("host");
+  // the shot whose result the last battle frame showed
+  std::uint32_t shownTrace = 0;
+
+  // every pass below ends in a drawn frame
+  for (int frame = 0; !WindowShouldClose() && !exitRequested; ++frame) {
+    if (frame == 1 && startup.firstFrameMs < 0.0) {
+      startup.firstFrameMs = StartupTimes::MsSince(startup.chosen);
+      if (startup.benchmark) {
         break;
-      case ENET_EVENT_TYPE_RECEIVE: {
-        if (event.packet->dataLength < 1) {
-          enet_packet_destroy(event.packet);
-          break;
-        }
-
-        const auto messageType =
-            static_cast<MessageType>(event.packet->data[0]);
-
-        switch (messageType) {
-        case MessageType::CellUpdate:
-          if (event.packet->dataLength == sizeof(CellUpdateMessage)) {
-            const auto *msg =
-                reinterpret_cast<const CellUpdateMessage *>(event.packet->data);
-            int x = static_cast<int>(msg->x);
-            int y = static_cast<int>(msg->y);
-
-            if (x >= 0 && x < kGridCols && y >= 0 && y < kGridRows) {
-              int index = CellIndex(x, y);
-              if (currentTurn == Turn::Server) {
-                CellState previous = enemyGrid[index];
-                enemyGrid[index] = msg->filled;
-
-                if (msg->filled == CellState::Hit &&
-                    previous != CellState::Hit &&
-                    currentPhase != Phase::Finished &&
-                    outcome != GameResult::Defeat) {
-                  ++enemyHitCount;
-                  if (enemyHitCount >= 20) {
-                    outcome = GameResult::Victory;
-                    currentPhase = Phase::Finished;
-                    finishedTimer = 0.0f;
-                    currentTurn = Turn::None;
-                  }
-                }
-              } else {
-                playerGrid[index] = msg->filled;
-              }
-            }
-          }
-          break;
-        case MessageType::CellRequest:
-          if (event.packet->dataLength == sizeof(CellRequestMessage)) {
-            const auto *msg = reinterpret_cast<const CellRequestMessage *>(
-                event.packet->data);
-            int x = static_cast<int>(msg->x);
-            int y = static_cast<int>(msg->y);
-
-            if (x < 0 || x >= kGridCols || y < 0 || y >= kGridRows) {
-              break;
-            }
-
-            int index = CellIndex(x, y);
-            bool isHit = std::find(shipLocations.begin(), shipLocations.end(),
-                                   index) != shipLocations.end();
-
-            CellState result = isHit ? CellState::Hit : CellState::Miss;
-            playerGrid[index] = result;
-
-            if (isHit) {
-              // Server Ship Has Been Hitted
-              hittedShipCount++;
-
-              if (hittedShipCount >= 20 && currentPhase != Phase::Finished) {
-                outcome = GameResult::Defeat;
-                currentPhase = Phase::Finished;
-                finishedTimer = 0.0f;
-                currentTurn = Turn::None;
-              }
-            }
-
-            BroadcastCellUpdate(host, x, y, result);
-
-            if (!isHit) {
-              std::uint8_t nextTurn = (currentTurn == Turn::Server) ? 1 : 0;
-              currentTurn = (nextTurn == 0) ? Turn::Server : Turn::Client;
-              TurnUpdateMessage turnMsg{
-                  static_cast<std::uint8_t>(MessageType::TurnUpdate), nextTurn};
-              ENetPacket *turnPacket = enet_packet_create(
-                  &turnMsg, sizeof(turnMsg), ENET_PACKET_FLAG_RELIABLE);
-              enet_host_broadcast(host, kChannel, turnPacket);
-              enet_host_flush(host);
-            }
+      }
+    }
+    for (Transport *link : links) {
+      TransportEvent event;
+      while (link->Poll(event)) {
+        bool seated = transport.Link() == link;
+        switch (event.type) {
+        case TransportEvent::Type::Connected:
+          if (transport.Link()) {
+            link->Refuse();
+            ++refusedPeers;
+            break;
           }
+          transport.Seat(link);
+          gameState.isClientConnected = true;
+          session.OnPeerConnected(enet_time_get());
           break;
-        case MessageType::TurnUpdate:
-          if (event.packet->dataLength == sizeof(TurnUpdateMessage)) {
-            const auto *msg =
-                reinterpret_cast<const TurnUpdateMessage *>(event.packet->data);
-            currentTurn = (msg->currentTurn == 0) ? Turn::Server : Turn::Client;
-
-            ENetPacket *fwdPacket = enet_packet_create(
-                msg, sizeof(TurnUpdateMessage), ENET_PACKET_FLAG_RELIABLE);
-            enet_host_broadcast(host, kChannel, fwdPacket);
-            enet_host_flush(host);
+        case TransportEvent::Type::Disconnected:
+          if (seated) {
+            Log(LogLevel::Info, "Client disconnected");
+            transport.Seat(nullptr);
+            session.OnPeerDisconnected();
           }
           break;
-        case MessageType::FinishedPreparing:
-          if (event.packet->dataLength == sizeof(FinishedPreparingMessage)) {
-            const auto *msg =
-                reinterpret_cast<const FinishedPreparingMessage *>(
-                    event.packet->data);
-            if (msg->finished == 1) {
-              clientFinishedPreparing = true;
-            }
+        case TransportEvent::Type::Message:
+          if (seated) {
+            session.OnMessage(event.data, event.size, enet_time_get());
           }
           break;
-        default:
-          break;
         }
-
-        enet_packet_destroy(event.packet);
-        break;
       }
-      case ENET_EVENT_TYPE_NONE:
-      default:
-        break;
+    }
+
+    enet_uint32 now = enet_time_get();
+    session.Update(now);
+    // everything this frame's messages and deadlines produced, in one go
+    transport.Flush();
+    gameState.viewport.Refresh();
+
+    if (state.phase == Phase::Finished && !resultSubmitted) {
+      if (session.Reason() == FinishReason::Timeout) {
+        Log(LogLevel::Warn,
+            "Client missed the preparation deadline, dropping it");
       }
+      MatchRecord record{};
+      record.outcome = (state.outcome == GameResult::Victory)
+                           ? MatchOutcome::FirstWon
+                           : MatchOutcome::SecondWon;
+      record.reason = session.Reason();
+      record.shots[0] = session.ShotsFired()[0];
+      record.shots[1] = session.ShotsFired()[1];
+      record.players[0] = hostPlayerId;
+      record.players[1] = session.PeerPlayerId();
+      record.durationMs = now - matchStartMs;
+      record.finishedAt = static_cast<std::uint64_t>(std::time(nullptr));
+      results.Submit(record, std::move(session.Replay()));
+      resultSubmitted = true;
     }
 
     if (!gameState.isClientConnected) {
@@ -405,438 +479,269 @@ int RunServer() {
       continue;
     }
 
-    if (serverFinishedPreparing && !clientFinishedPreparing) {
+    if (state.phase != Phase::Finished && state.selfReady &&
+        !state.peerReady) {
       ShowWaitingRoom("Waiting for other player to finish...");
       continue;
     }
 
-    float delta = GetFrameTime();
-
-    switch (currentPhase) {
+    switch (state.phase) {
     case Phase::Preparing:
-      if (static_cast<size_t>(currentShipIndex) < ships.size()) {
-        Ship &ship = ships[currentShipIndex];
-
-        ApplyHover(playerGrid, ship.length, ship.isHorizontal);
-
-        if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
-          ship.isHorizontal = !ship.isHorizontal;
-        }
-
-        if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
-          Vector2 mousePos = GetMousePosition();
-          int cellX = static_cast<int>(mousePos.x) / kCellSize;
-          int cellY = static_cast<int>(mousePos.y) / kCellSize;
-
-          if (ApplyFill(playerGrid, cellX, cellY, ship.length,
-                        ship.isHorizontal)) {
-            RecordShipCells(shipLocations, cellX, cellY, ship);
-            ++currentShipIndex;
-          }
-        }
-      } else if (!serverFinishedPreparing && connectedPeer) {
-        FinishedPreparingMessage msg{
-            static_cast<std::uint8_t>(MessageType::FinishedPreparing), 1};
-        ENetPacket *packet =
-            enet_packet_create(&msg, sizeof(msg), ENET_PACKET_FLAG_RELIABLE);
-        enet_peer_send(connectedPeer, kChannel, packet);
-        enet_host_flush(host);
-        serverFinishedPreparing = true;
-      }
-
-      DrawGrid(playerGrid, headline);
+      HandlePlacement(session, headline);
       break;
 
     case Phase::Transition:
-      transitionTimer += delta;
-      DrawTransition(transitionTimer);
-
-      if (transitionTimer > 3.0f) {
-        currentPhase = Phase::Battle;
-        currentTurn = Turn::Server;
-
-        TurnUpdateMessage turnMsg{
-            static_cast<std::uint8_t>(MessageType::TurnUpdate), 0};
-        ENetPacket *turnPacket = enet_packet_create(&turnMsg, sizeof(turnMsg),
-                                                    ENET_PACKET_FLAG_RELIABLE);
-        enet_host_broadcast(host, kChannel, turnPacket);
-        enet_host_flush(host);
-      }
+      DrawTransition((now - state.transitionStartMs) / 1000.0f);
       break;
 
-    case Phase::Battle:
+    case Phase::Battle: {
       headline = "Battle Phase!";
-      if (!resetGrid) {
-        ResetGrid(enemyGrid);
-        resetGrid = true;
-      }
-
-      if (currentTurn != Turn::Server) {
-        DrawGrid(playerGrid, "Enemy's Turn - Your Ships");
-        break;
-      }
-
-      DrawGrid(enemyGrid, "Your Turn (Server)");
-      ApplyHover(enemyGrid, 1, true);
-
-      if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && connectedPeer) {
-        Vector2 mousePos = GetMousePosition();
-        int cellX = static_cast<int>(mousePos.x) / kCellSize;
-        int cellY = static_cast<int>(mousePos.y) / kCellSize;
-
-        CellRequestMessage msg{
-            static_cast<std::uint8_t>(MessageType::CellRequest),
-            static_cast<std::uint16_t>(cellX),
-            static_cast<std::uint16_t>(cellY)};
-        ENetPacket *packet =
-            enet_packet_create(&msg, sizeof(msg), ENET_PACKET_FLAG_RELIABLE);
-        enet_peer_send(connectedPeer, kChannel, packet);
-        enet_host_flush(host);
+      // fire before drawing so the click shows on this very frame
+      int cellX = 0;
+      int cellY = 0;
+      if (session.IsMyTurn() && IsMouseButtonPressed(MOUSE_LEFT_BUTTON) &&
+          kTargetBoard.CellAt(gameState.viewport.Mouse(), cellX, cellY)) {
+        FireNow(session, transport, cellX, cellY, now);
       }
-      break;
 
-    case Phase::Finished: {
-      finishedTimer += delta;
-      GameResult screenResult =
-          (outcome == GameResult::None) ? GameResult::Defeat : outcome;
-      DrawFinishedScreen(screenResult, finishedTimer);
-
-      if (IsKeyPressed(KEY_ENTER) || IsKeyPressed(KEY_SPACE) ||
-          IsKeyPressed(KEY_ESCAPE) || IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
-        exitRequested = true;
-      }
+      TraceScope redraw("redraw",
+                        state.settledTrace != shownTrace ? state.settledTrace
+                                                         : 0);
+      shownTrace = state.settledTrace;
+      bool myTurn = session.IsMyTurn();
+      DrawBattle(state, myTurn, now,
+                 WithCountdown(myTurn ? WithSalvo("Your Turn (Server)", state)
+                                      : "Enemy's Turn - Your Ships",
+                               state.turnDeadlineMs));
       break;
     }
-    }
 
-    if (exitRequested) {
+    case Phase::Finished:
+      exitRequested = FinishedScreen(state, finishedTimer);
       break;
     }
-
-    if (clientFinishedPreparing && serverFinishedPreparing &&
-        currentPhase == Phase::Preparing) {
-      currentPhase = Phase::Transition;
-      transitionTimer = 0.0f;
-    }
   }
 
+  refusedPeers += remote.Refused();
+  if (refusedPeers > 0 || remote.Dropped() > 0) {
+    Log(LogLevel::Info, "Refused %u connections, dropped %u messages",
+        refusedPeers, remote.Dropped());
+  }
   enet_host_flush(host);
   enet_host_destroy(host);
-  CloseWindow();
   return 0;
 }
 
-int RunClient(const char *hostName) {
-  ENetHost *client = enet_host_create(nullptr, 1, 1, 0, 0);
-  if (!client) {
-    std::fprintf(stderr, "Failed to create ENet client host\n");
-    return 1;
-  }
+int RunClient(const char *hostName, bool matchmaking) {
+  const enet_uint16 port = matchmaking ? kMatchmakingPort : kServerPort;
 
   ENetAddress address{};
   enet_address_set_host(&address, hostName);
-  address.port = kServerPort;
+  address.port = port;
+
+  // a host on this machine is reached through shared memory instead
+  LocalTransport local;
+  const bool isLocal =
+      !matchmaking && IsLoopback(address) && local.Connect(port);
 
-  ENetPeer *peer = enet_host_connect(client, &address, 1, 0);
-  if (!peer) {
-    std::fprintf(stderr, "Failed to initiate connection to %s:%u\n", hostName,
-                 kServerPort);
-    enet_host_destroy(client);
+  ENetHost *client = enet_host_create(nullptr, 1, 1, 0, 0);
+  if (!client) {
+    Log(LogLevel::Error, "Failed to create ENet client host");
     return 1;
   }
 
-  ENetEvent event;
-  if (enet_host_service(client, &event, 5000) <= 0 ||
-      event.type != ENET_EVENT_TYPE_CONNECT) {
-    std::fprintf(stderr, "Connection to %s timed out\n", hostName);
-    enet_peer_reset(peer);
-    enet_host_destroy(client);
-    return 1;
+  ENetPeer *peer = nullptr;
+  if (!isLocal) {
+    peer = enet_host_connect(client, &address, 1, 0);
+    if (!peer) {
+      Log(LogLevel::Error, "Failed to initiate connection to %s:%u", hostName,
+          port);
+      enet_host_destroy(client);
+      return 1;
+    }
+
+    ENetEvent event;
+    if (enet_host_service(client, &event, 5000) <= 0 ||
+        event.type != ENET_EVENT_TYPE_CONNECT) {
+      Log(LogLevel::Error, "Connection to %s timed out", hostName);
+      enet_peer_reset(peer);
+      enet_host_destroy(client);
+      return 1;
+    }
   }
 
-  InitWindow(kWindowSize, kWindowSize, "ENet Client - Shared Grid");
+  // the server's traffic is not rate limited
+  RateLimitConfig unlimited;
+  unlimited.perSecond = 0;
+  EnetTransport remote(client, unlimited);
+  remote.SetPeer(peer);
+  Transport &transport = isLocal ? static_cast<Transport &>(local) : remote;
+
+  // without a lobby the host is the opponent, so there is nothing to wait for
+  bool matchFound = !matchmaking;
+
+  // queues us in the lobby, or just identifies us to a peer-to-peer host
+  LobbyJoinMessage joinMsg{static_cast<std::uint8_t>(MessageType::LobbyJoin),
+                           PlayerId()};
+  transport.Send(joinMsg);
+  transport.Flush();
+
+  OpenWindow("ENet Client - Shared Grid");
   SetTargetFPS(60);
 
-  Grid playerGrid{};
-  Grid enemyGrid{};
-  std::vector<std::uint8_t> shipLocations;
-  shipLocations.reserve(20);
-  std::vector<Ship> ships = CreateFleet();
+  GuestSession session(transport, std::random_device{}());
+  const SeatState &state = session.State();
 
-  Turn currentTurn = Turn::None;
-  int currentShipIndex = 0;
-  int hittedShipCount = 0;
-  int enemyHitCount = 0;
+  SetTraceProcess("guest");
+  std::uint32_t shownTrace = 0;
 
   std::string headline = "Client: Preparing Phase";
-
-  Phase currentPhase = Phase::Preparing;
-  float transitionTimer = 0.0f;
   float finishedTimer = 0.0f;
-  GameResult outcome = GameResult::None;
   bool exitRequested = false;
-
   bool connectionActive = true;
-  bool clientFinishedPreparing = false;
-  bool serverFinishedPreparing = false;
-  bool resetGrid = false;
-
-  while (!WindowShouldClose() && connectionActive) {
-    while (enet_host_service(client, &event, 0) > 0) {
+  // the shard our match lives on keeps it across a restart
+  std::uint32_t shardMatchId = 0;
+  bool reconnecting = false;
+  enet_uint32 resumeUntilMs = 0;
+
+  while (!WindowShouldClose() && connectionActive && !exitRequested) {
+    TransportEvent event;
+    while (transport.Poll(event)) {
       switch (event.type) {
-      case ENET_EVENT_TYPE_RECEIVE: {
-        if (event.packet->dataLength < 1) {
-          enet_packet_destroy(event.packet);
-          break;
-        }
-
-        const auto messageType =
-            static_cast<MessageType>(event.packet->data[0]);
-
-        switch (messageType) {
-        case MessageType::CellUpdate:
-          if (event.packet->dataLength == sizeof(CellUpdateMessage)) {
-            const auto *msg =
-                reinterpret_cast<const CellUpdateMessage *>(event.packet->data);
-            int x = static_cast<int>(msg->x);
-            int y = static_cast<int>(msg->y);
-
-            if (x >= 0 && x < kGridCols && y >= 0 && y < kGridRows) {
-              int index = CellIndex(x, y);
-              if (currentTurn == Turn::Client) {
-                CellState previous = enemyGrid[index];
-                enemyGrid[index] = msg->filled;
-
-                if (msg->filled == CellState::Hit &&
-                    previous != CellState::Hit &&
-                    currentPhase != Phase::Finished &&
-                    outcome != GameResult::Defeat) {
-                  ++enemyHitCount;
-                  if (enemyHitCount >= 20) {
-                    outcome = GameResult::Victory;
-                    currentPhase = Phase::Finished;
-                    finishedTimer = 0.0f;
-                    currentTurn = Turn::None;
-                  }
-                }
-              } else {
-                playerGrid[index] = msg->filled;
-              }
+      case TransportEvent::Type::Message:
+        if (event.size == sizeof(MatchFoundMessage) &&
+            static_cast<MessageType>(event.data[0]) ==
+                MessageType::MatchFound) {
+          const auto *msg =
+              reinterpret_cast<const MatchFoundMessage *>(event.data);
+          LogMatch(LogLevel::Info, msg->matchId, "Match found: rating %d vs %d",
+                   msg->rating, msg->opponentRating);
+          headline = "Preparing - opponent rated " +
+                     std::to_string(msg->opponentRating);
+          if (msg->port == 0) {
+            matchFound = true;
+          } else {
+            // the match lives on a shard; the match id routes us there
+            enet_peer_disconnect_now(remote.Peer(), 0);
+            address.port = msg->port;
+            shardMatchId = msg->matchId;
+            remote.SetPeer(
+                enet_host_connect(client, &address, 1, msg->matchId));
+            if (!remote.Peer()) {
+              Log(LogLevel::Error, "Failed to connect to match shard");
+              connectionActive = false;
             }
           }
-          break;
-        case MessageType::GridSnapshot:
-          if (event.packet->dataLength == sizeof(GridSnapshotMessage)) {
-            const auto *msg = reinterpret_cast<const GridSnapshotMessage *>(
-                event.packet->data);
-
-            if (msg->width == kGridCols && msg->height == kGridRows) {
-              for (int i = 0; i < kCellCount; ++i) {
-                playerGrid[i] = static_cast<CellState>(msg->cells[i]);
-              }
-            }
-          }
-          break;
-        case MessageType::FinishedPreparing:
-          if (event.packet->dataLength == sizeof(FinishedPreparingMessage)) {
-            const auto *msg =
-                reinterpret_cast<const FinishedPreparingMessage *>(
-                    event.packet->data);
-            if (msg->finished == 1) {
-              serverFinishedPreparing = true;
-            }
-          }
-          break;
-        case MessageType::TurnUpdate:
-          if (event.packet->dataLength == sizeof(TurnUpdateMessage)) {
-            const auto *msg =
-                reinterpret_cast<const TurnUpdateMessage *>(event.packet->data);
-            currentTurn = (msg->currentTurn == 0) ? Turn::Server : Turn::Client;
+        } else {
+          session.OnMessage(event.data, event.size, enet_time_get());
+        }
+        break;
+      case TransportEvent::Type::Disconnected: {
+        Log(LogLevel::Info, "Disconnected from server%s",
+            DisconnectText(event.reason));
+        // a shard that went down, or failed to come back yet: try again
+        // until the match would be called off
+        auto reason = static_cast<DisconnectReason>(event.reason);
+        if (shardMatchId != 0 && state.phase != Phase::Finished &&
+            (reason == DisconnectReason::None ||
+             reason == DisconnectReason::Restarting)) {
+          enet_uint32 now = enet_time_get();
+          if (!reconnecting) {
+            reconnecting = true;
+            resumeUntilMs = now + kResumeWindowMs;
           }
-          break;
-        case MessageType::CellRequest:
-          if (event.packet->dataLength == sizeof(CellRequestMessage)) {
-            const auto *msg = reinterpret_cast<const CellRequestMessage *>(
-                event.packet->data);
-
-            int x = static_cast<int>(msg->x);
-            int y = static_cast<int>(msg->y);
-
-            if (x < 0 || x >= kGridCols || y < 0 || y >= kGridRows) {
+          if (static_cast<std::int32_t>(resumeUntilMs - now) > 0) {
+            remote.SetPeer(
+                enet_host_connect(client, &address, 1, shardMatchId));
+            if (remote.Peer()) {
               break;
             }
-
-            int index = CellIndex(x, y);
-            bool isHit = std::find(shipLocations.begin(), shipLocations.end(),
-                                   index) != shipLocations.end();
-
-            if (isHit) {
-              // Client Ship Has Been Hitted
-              hittedShipCount++;
-
-              if (hittedShipCount >= 20 && currentPhase != Phase::Finished) {
-                outcome = GameResult::Defeat;
-                currentPhase = Phase::Finished;
-                finishedTimer = 0.0f;
-                currentTurn = Turn::None;
-              }
-            }
-
-            CellState result = isHit ? CellState::Hit : CellState::Miss;
-            playerGrid[index] = result;
-
-            CellUpdateMessage updateMsg{
-                static_cast<std::uint8_t>(MessageType::CellUpdate),
-                static_cast<std::uint16_t>(x), static_cast<std::uint16_t>(y),
-                result};
-            ENetPacket *packet = enet_packet_create(
-                &updateMsg, sizeof(updateMsg), ENET_PACKET_FLAG_RELIABLE);
-            enet_peer_send(peer, kChannel, packet);
-            enet_host_flush(client);
-
-            if (!isHit) {
-              TurnUpdateMessage turnMsg{
-                  static_cast<std::uint8_t>(MessageType::TurnUpdate), 1};
-              ENetPacket *turnPacket = enet_packet_create(
-                  &turnMsg, sizeof(turnMsg), ENET_PACKET_FLAG_RELIABLE);
-              enet_peer_send(peer, kChannel, turnPacket);
-              enet_host_flush(client);
-            }
           }
-          break;
-        default:
-          break;
         }
-
-        enet_packet_destroy(event.packet);
-        break;
-      }
-      case ENET_EVENT_TYPE_DISCONNECT:
-        std::printf("Disconnected from server\n");
         connectionActive = false;
         break;
-      case ENET_EVENT_TYPE_NONE:
-      case ENET_EVENT_TYPE_CONNECT:
-      default:
+      }
+      case TransportEvent::Type::Connected:
+        // reached the match shard: it seats us by player id
+        transport.Send(joinMsg);
+        matchFound = true;
+        if (reconnecting) {
+          LogMatch(LogLevel::Info, shardMatchId, "Reconnected to the match");
+          reconnecting = false;
+          session.Rejoined();
+        }
         break;
       }
     }
 
-    if (peer->state != ENET_PEER_STATE_CONNECTED) {
+    gameState.viewport.Refresh();
+    if (!matchFound) {
+      ShowWaitingRoom("Searching for an opponent...");
       continue;
     }
-
-    if (currentPhase != Phase::Finished && clientFinishedPreparing &&
-        !serverFinishedPreparing) {
-      ShowWaitingRoom("Waiting for other player to finish...");
+    if (reconnecting) {
+      ShowWaitingRoom("Connection lost - reconnecting...");
       continue;
     }
 
-    float delta = GetFrameTime();
-
-    switch (currentPhase) {
-    case Phase::Preparing:
-      if (static_cast<size_t>(currentShipIndex) < ships.size()) {
-        Ship &ship = ships[currentShipIndex];
-
-        ApplyHover(playerGrid, ship.length, ship.isHorizontal);
-
-        if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
-          ship.isHorizontal = !ship.isHorizontal;
-        }
+    if (!isLocal && !remote.IsConnected()) {
+      continue;
+    }
 
-        if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
-          Vector2 mousePos = GetMousePosition();
-          int cellX = static_cast<int>(mousePos.x) / kCellSize;
-          int cellY = static_cast<int>(mousePos.y) / kCellSize;
+    enet_uint32 now = enet_time_get();
+    session.Update(now);
+    transport.Flush();
 
-          if (ApplyFill(playerGrid, cellX, cellY, ship.length,
-                        ship.isHorizontal)) {
-            RecordShipCells(shipLocations, cellX, cellY, ship);
-            ++currentShipIndex;
-          }
-        }
-      } else if (!clientFinishedPreparing) {
-        FinishedPreparingMessage msg{
-            static_cast<std::uint8_t>(MessageType::FinishedPreparing), 1};
-        ENetPacket *packet =
-            enet_packet_create(&msg, sizeof(msg), ENET_PACKET_FLAG_RELIABLE);
-        enet_peer_send(peer, kChannel, packet);
-        enet_host_flush(client);
-        clientFinishedPreparing = true;
-      }
+    if (state.phase != Phase::Finished && state.selfReady &&
+        !state.peerReady) {
+      ShowWaitingRoom("Waiting for other player to finish...");
+      continue;
+    }
 
-      DrawGrid(playerGrid, headline);
+    switch (state.phase) {
+    case Phase::Preparing:
+      HandlePlacement(session, headline);
       break;
 
     case Phase::Transition:
-      transitionTimer += delta;
-      DrawTransition(transitionTimer);
-
-      if (transitionTimer > 3.0f) {
-        currentPhase = Phase::Battle;
-      }
+      DrawTransition((now - state.transitionStartMs) / 1000.0f);
       break;
 
-    case Phase::Battle:
+    case Phase::Battle: {
       headline = "Battle Phase!";
-      if (!resetGrid) {
-        ResetGrid(enemyGrid);
-        resetGrid = true;
-      }
-
-      if (currentTurn != Turn::Client) {
-        DrawGrid(playerGrid, "Waiting for opponent...");
-        break;
+      int cellX = 0;
+      int cellY = 0;
+      if (session.IsMyTurn() && IsMouseButtonPressed(MOUSE_LEFT_BUTTON) &&
+          kTargetBoard.CellAt(gameState.viewport.Mouse(), cellX, cellY)) {
+        FireNow(session, transport, cellX, cellY, now);
       }
 
-      if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
-        Vector2 mousePos = GetMousePosition();
-        int cellX = static_cast<int>(mousePos.x) / kCellSize;
-        int cellY = static_cast<int>(mousePos.y) / kCellSize;
-
-        CellRequestMessage msg{
-            static_cast<std::uint8_t>(MessageType::CellRequest),
-            static_cast<std::uint16_t>(cellX),
-            static_cast<std::uint16_t>(cellY)};
-        ENetPacket *packet =
-            enet_packet_create(&msg, sizeof(msg), ENET_PACKET_FLAG_RELIABLE);
-        enet_peer_send(peer, kChannel, packet);
-        enet_host_flush(client);
-      }
-
-      DrawGrid(enemyGrid, "Your Turn (Client)");
-      ApplyHover(enemyGrid, 1, true);
-
-      break;
-
-    case Phase::Finished: {
-      finishedTimer += delta;
-      GameResult screenResult =
-          (outcome == GameResult::None) ? GameResult::Defeat : outcome;
-      DrawFinishedScreen(screenResult, finishedTimer);
-
-      if (IsKeyPressed(KEY_ENTER) || IsKeyPressed(KEY_SPACE) ||
-          IsKeyPressed(KEY_ESCAPE) || IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
-        exitRequested = true;
+      TraceScope redraw("redraw",
+                        state.settledTrace != shownTrace ? state.settledTrace
+                                                         : 0);
+      shownTrace = state.settledTrace;
+      if (session.IsMyTurn()) {
+        DrawBattle(state, true, now,
+                   WithCountdown(WithSalvo("Your Turn (Client)", state),
+                                 state.turnDeadlineMs));
+      } else {
+        DrawBattle(state, false, now,
+                   state.lastTurnTimedOut
+                       ? "Time's up - a shot was fired for you"
+                       : "Waiting for opponent...");
       }
       break;
     }
-    }
 
-    if (exitRequested) {
+    case Phase::Finished:
+      exitRequested = FinishedScreen(state, finishedTimer);
       break;
     }
-
-    if (clientFinishedPreparing && serverFinishedPreparing &&
-        currentPhase == Phase::Preparing) {
-      currentPhase = Phase::Transition;
-      transitionTimer = 0.0f;
-    }
   }
 
-  if (connectionActive) {
-    enet_peer_disconnect(peer, 0);
+  if (connectionActive && remote.Peer()) {
+    enet_peer_disconnect(remote.Peer(), 0);
+    ENetEvent event;
     while (enet_host_service(client, &event, 3000) > 0) {
       if (event.type == ENET_EVENT_TYPE_RECEIVE) {
         enet_packet_destroy(event.packet);
@@ -847,6 +752,5 @@ int RunClient(const char *hostName) {
   }
 
   enet_host_destroy(client);
-  CloseWindow();
   return 0;
 }
@@ -1,5 +1,22 @@
 #pragma once
 
-int RunServer();
-int RunClient(const char *hostName);
+#include "Board.h"
 
+#include <cstdint>
+
+// Server-enforced deadlines in milliseconds; 0 disables the limit.
+struct DeadlineConfig {
+  std::uint32_t turnMs = 30000;
+  std::uint32_t prepareMs = 120000;
+};
+
+// Starts reading what a game needs from disk on a background thread, so it
+// is ready by the time the menu is left. The game reads it on demand
+// otherwise.
+void WarmStart();
+
+int RunServer(const DeadlineConfig &deadlines = DeadlineConfig{},
+              GameMode mode = GameMode::Classic);
+// With matchmaking the client joins the dedicated host's lobby instead of
+// connecting straight to a peer-to-peer host.
+int RunClient(const char *hostName, bool matchmaking = false);
@@ -1,53 +1,83 @@
 // GameState.h
 #pragma once
 
+#include "Board.h"
+#include "Viewport.h"
 #include "raylib.h"
+#include <chrono>
 #include <cmath>
 #include <string>
 
+// How long it takes to get somewhere the player can act, for
+// --startup-bench. Times are -1 until reached.
+struct StartupTimes {
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point launched = Clock::now(); // static init, before main()
+  Clock::time_point chosen;                  // a menu button was clicked
+  double interactiveMs = -1.0;               // launch to first menu frame
+  double firstFrameMs = -1.0;                // choice to first game frame
+  // picks Host Game by itself and leaves after that first frame
+  bool benchmark = false;
+
+  static double MsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  }
+};
+
 struct GameState {
   bool isClientConnected = false;
+  // maps the design canvas onto the window; refreshed once per frame
+  Viewport viewport;
+  StartupTimes startup;
 };
 
 // one shared instance across all translation units
 inline GameState gameState;
 
-constexpr int kWindowSize = 600;
-constexpr int kGridCols = 10;
-constexpr int kGridRows = 10;
-constexpr int kCellSize = kWindowSize / kGridCols;
+constexpr float kCellSize = kDesignSize / kGridCols;
 
 struct MenuResult {
   bool quit;
   bool isHost;
+  bool matchmaking;
   std::string address;
 };
 
-enum class Phase { Preparing, Transition, Battle, Finished };
-enum class Turn { None, Server, Client };
-
-enum class GameResult { None, Victory, Defeat };
-
+// Opens the window on first use. It stays open when a choice is made, so
+// the game that follows reuses the context and the fonts already uploaded.
 inline MenuResult ShowMainMenu() {
-  InitWindow(kWindowSize, kWindowSize, "Shared Grid - Main Menu");
+  OpenWindow("Shared Grid - Main Menu");
   SetTargetFPS(60);
+  Viewport &viewport = gameState.viewport;
+  StartupTimes &startup = gameState.startup;
 
-  MenuResult result{true, false, std::string{}};
+  MenuResult result{true, false, false, std::string{}};
   std::string ipText = "127.0.0.1";
   bool editingIp = false;
   bool selectionMade = false;
 
-  Rectangle hostRect{static_cast<float>(kWindowSize / 2 - 140), 220.0f, 280.0f,
-                     60.0f};
-  Rectangle joinRect{static_cast<float>(kWindowSize / 2 - 140), 290.0f, 280.0f,
-                     60.0f};
-  Rectangle ipRect{static_cast<float>(kWindowSize / 2 - 160), 420.0f, 320.0f,
-                   48.0f};
+  Rectangle hostRect{kDesignSize / 2 - 140, 190.0f, 280.0f, 60.0f};
+  Rectangle joinRect{kDesignSize / 2 - 140, 255.0f, 280.0f, 60.0f};
+  Rectangle findRect{kDesignSize / 2 - 140, 320.0f, 280.0f, 60.0f};
+  Rectangle ipRect{kDesignSize / 2 - 160, 430.0f, 320.0f, 48.0f};
+
+  CachedText title(42, TextAlign::Center);
+  CachedText subtitle(20);
+  CachedText hostLabel(24, TextAlign::Center);
+  CachedText joinLabel(24, TextAlign::Center);
+  CachedText findLabel(24, TextAlign::Center);
+  CachedText addressLabel(20);
+  CachedText address(24);
+  CachedText caret(24);
+  CachedText quitHint(20);
 
   while (!WindowShouldClose()) {
-    Vector2 mouse = GetMousePosition();
+    viewport.Refresh();
+    Vector2 mouse = viewport.Mouse();
     bool hostHover = CheckCollisionPointRec(mouse, hostRect);
     bool joinHover = CheckCollisionPointRec(mouse, joinRect);
+    bool findHover = CheckCollisionPointRec(mouse, findRect);
     bool ipHover = CheckCollisionPointRec(mouse, ipRect);
 
     int key = GetCharPressed();
@@ -69,6 +99,13 @@ inline MenuResult ShowMainMenu() {
       break;
     }
 
+    if (startup.benchmark && startup.interactiveMs >= 0.0) {
+      result.quit = false;
+      result.isHost = true;
+      selectionMade = true;
+      break;
+    }
+
     if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
       if (hostHover) {
         result.quit = false;
@@ -84,6 +121,14 @@ inline MenuResult ShowMainMenu() {
         selectionMade = true;
         break;
       }
+      if (findHover && !ipText.empty()) {
+        result.quit = false;
+        result.isHost = false;
+        result.matchmaking = true;
+        result.address = ipText;
+        selectionMade = true;
+        break;
+      }
       if (ipHover) {
         editingIp = true;
       } else {
@@ -94,154 +139,145 @@ inline MenuResult ShowMainMenu() {
     BeginDrawing();
     ClearBackground(RAYWHITE);
 
-    // Shared Grid Title
-    const char *title = "Shared Grid";
-    int titleWidth = MeasureText(title, 42);
-    DrawText(title, kWindowSize / 2 - titleWidth / 2, 120, 42, DARKGRAY);
-    DrawText("Choose how you want to play", 160, 170, 20, DARKGRAY);
-
-    // Host Game Button
-    Color hostColor = hostHover ? SKYBLUE : LIGHTGRAY;
-    DrawRectangleRec(hostRect, hostColor);
+    BeginMode2D(viewport.Camera());
+    DrawRectangleRec(hostRect, hostHover ? SKYBLUE : LIGHTGRAY);
     DrawRectangleLinesEx(hostRect, 2.0f, DARKGRAY);
-    int hostTextWidth = MeasureText("Host Game", 24);
-    DrawText(
-        "Host Game",
-        static_cast<int>(hostRect.x + hostRect.width / 2 - hostTextWidth / 2),
-        static_cast<int>(hostRect.y + 18), 24, DARKGRAY);
-
-    // Join Game Button
-    Color joinColor = joinHover ? SKYBLUE : LIGHTGRAY;
-    DrawRectangleRec(joinRect, joinColor);
+    DrawRectangleRec(joinRect, joinHover ? SKYBLUE : LIGHTGRAY);
     DrawRectangleLinesEx(joinRect, 2.0f, DARKGRAY);
-    int joinTextWidth = MeasureText("Join Game", 24);
-    DrawText(
-        "Join Game",
-        static_cast<int>(joinRect.x + joinRect.width / 2 - joinTextWidth / 2),
-        static_cast<int>(joinRect.y + 18), 24, DARKGRAY);
-
-    // Server Address Input
-    DrawText("Server Address", static_cast<int>(ipRect.x),
-             static_cast<int>(ipRect.y) - 28, 20, DARKGRAY);
+    // Find Match queues on the matchmaking lobby at the server address
+    DrawRectangleRec(findRect, findHover ? SKYBLUE : LIGHTGRAY);
+    DrawRectangleLinesEx(findRect, 2.0f, DARKGRAY);
     DrawRectangleRec(ipRect, editingIp ? Fade(SKYBLUE, 0.4f) : LIGHTGRAY);
     DrawRectangleLinesEx(ipRect, 2.0f, DARKGRAY);
-    DrawText(ipText.c_str(), static_cast<int>(ipRect.x + 12),
-             static_cast<int>(ipRect.y + 12), 24, DARKGRAY);
-
+    EndMode2D();
+
+    title.Draw(viewport, "Shared Grid", Vector2{kDesignSize / 2, 90.0f},
+               DARKGRAY);
+    subtitle.Draw(viewport, "Choose how you want to play",
+                  Vector2{160.0f, 145.0f}, DARKGRAY);
+    hostLabel.Draw(viewport, "Host Game",
+                   Vector2{hostRect.x + hostRect.width / 2, hostRect.y + 18},
+                   DARKGRAY);
+    joinLabel.Draw(viewport, "Join Game",
+                   Vector2{joinRect.x + joinRect.width / 2, joinRect.y + 18},
+                   DARKGRAY);
+    findLabel.Draw(viewport, "Find Match",
+                   Vector2{findRect.x + findRect.width / 2, findRect.y + 18},
+                   DARKGRAY);
+    addressLabel.Draw(viewport, "Server Address",
+                      Vector2{ipRect.x, ipRect.y - 28}, DARKGRAY);
+    address.Draw(viewport, ipText.c_str(),
+                 Vector2{ipRect.x + 12, ipRect.y + 12}, DARKGRAY);
     if (editingIp) {
-      int caretX =
-          static_cast<int>(ipRect.x + 12 + MeasureText(ipText.c_str(), 24));
-      DrawText("|", caretX, static_cast<int>(ipRect.y + 12), 24, DARKGRAY);
+      caret.Draw(viewport, "|",
+                 Vector2{ipRect.x + 12 + address.Width(), ipRect.y + 12},
+                 DARKGRAY);
     }
-
-    DrawText("Esc to quit", 20, kWindowSize - 40, 20, GRAY);
+    quitHint.Draw(viewport, "Esc to quit", Vector2{20.0f, kDesignSize - 40},
+                  GRAY);
 
     EndDrawing();
+    if (startup.interactiveMs < 0.0) {
+      startup.interactiveMs = StartupTimes::MsSince(startup.launched);
+    }
   }
 
   if (!selectionMade) {
     result.quit = true;
   }
-
-  CloseWindow();
+  startup.chosen = StartupTimes::Clock::now();
   return result;
 }
 
+// The screens below run every frame; their text is laid out once per
+// window size, not measured per frame.
 inline void ShowWaitingRoom(const char *msg) {
+  static CachedText text(24, TextAlign::Center);
+  const Viewport &viewport = gameState.viewport;
+
   BeginDrawing();
   ClearBackground(RAYWHITE);
 
-  int textWidth = MeasureText(msg, 24);
-  DrawText(msg, kWindowSize / 2 - textWidth / 2, kWindowSize / 2 - 12, 24,
-           DARKGRAY);
+  text.Draw(viewport, msg, Vector2{kDesignSize / 2, kDesignSize / 2 - 12},
+            DARKGRAY);
 
-  DrawCircle(kWindowSize / 2, kWindowSize / 2 + 60,
-             10 + static_cast<int>(GetTime() * 4) % 10,
-             SKYBLUE); // small pulse animation
+  BeginMode2D(viewport.Camera());
+  DrawCircleV(Vector2{kDesignSize / 2, kDesignSize / 2 + 60},
+              10.0f + static_cast<int>(GetTime() * 4) % 10,
+              SKYBLUE); // small pulse animation
+  EndMode2D();
 
   EndDrawing();
 }
 
 inline void DrawTransition(float timer) {
+  static CachedText title(60, TextAlign::Center);
+  static CachedText subtitle(24, TextAlign::Center);
+  const Viewport &viewport = gameState.viewport;
+
   BeginDrawing();
   ClearBackground(RAYWHITE); // white background for the transition
 
-  const char *text = "BATTLE START!";
-  int fontSize = 60;
-  int textWidth = MeasureText(text, fontSize);
-
-  float x = (kWindowSize - textWidth) / 2.0f;
-  float y = kWindowSize / 2.0f - fontSize / 2.0f;
+  const float fontSize = 60.0f;
+  float y = kDesignSize / 2.0f - fontSize / 2.0f;
 
   // Main text: dark gray fade-in with pulse
   float pulse = 0.5f + 0.5f * sinf(timer * 3.0f);
-  Color textColor = Fade(DARKGRAY, pulse);
+  title.Draw(viewport, "BATTLE START!", Vector2{kDesignSize / 2, y},
+             Fade(DARKGRAY, pulse));
 
+  BeginMode2D(viewport.Camera());
   // “Shiny sweep” effect: a bright flash moving across the text
-  float sweepX = fmodf(timer * 500.0f, kWindowSize + 250.0f) - 250.0f;
-  Rectangle shineRect{sweepX, y - 40, 150, static_cast<float>(fontSize + 80)};
-
-  // Draw text first
-  DrawText(text, static_cast<int>(x), static_cast<int>(y), fontSize, textColor);
-
-  // Add the "shing" flash
+  float sweepX = fmodf(timer * 500.0f, kDesignSize + 250.0f) - 250.0f;
+  Rectangle shineRect{sweepX, y - 40, 150, fontSize + 80};
   DrawRectangleGradientEx(shineRect, Fade(WHITE, 0.0f), Fade(YELLOW, 0.5f),
                           Fade(YELLOW, 0.5f), Fade(WHITE, 0.0f));
+  EndMode2D();
 
   // Slight black overlay to create visual depth
-  DrawRectangle(0, 0, kWindowSize, kWindowSize, Fade(BLACK, 0.1f));
+  DrawRectangle(0, 0, GetScreenWidth(), GetScreenHeight(), Fade(BLACK, 0.1f));
 
-  // Optional subtext
-  const char *sub = "Get Ready to Fire!";
-  int subFont = 24;
-  int subWidth = MeasureText(sub, subFont);
-  DrawText(sub, (kWindowSize - subWidth) / 2,
-           static_cast<int>(y + fontSize + 30), subFont, GRAY);
+  subtitle.Draw(viewport, "Get Ready to Fire!",
+                Vector2{kDesignSize / 2, y + fontSize + 30}, GRAY);
 
   EndDrawing();
 }
 
 inline void DrawFinishedScreen(GameResult result, float timer) {
+  static CachedText headline(58, TextAlign::Center);
+  static CachedText subtext(26, TextAlign::Center);
+  static CachedText prompt(22, TextAlign::Center);
+  const Viewport &viewport = gameState.viewport;
+
   BeginDrawing();
   ClearBackground(RAYWHITE);
 
   Color accentColor = (result == GameResult::Victory) ? DARKGREEN : MAROON;
   Color glowColor = Fade(accentColor, 0.12f + 0.08f * sinf(timer * 2.0f));
-  DrawRectangle(0, 0, kWindowSize, kWindowSize, glowColor);
-
-  const char *headline =
-      (result == GameResult::Victory) ? "Victory!" : "Defeat";
-  const char *subtext = (result == GameResult::Victory)
-                            ? "You sank all enemy ships."
-                            : "All of your ships have been sunk.";
-
-  int headlineFont = 58;
-  int headlineWidth = MeasureText(headline, headlineFont);
-  int headlineX = (kWindowSize - headlineWidth) / 2;
-  int headlineY = kWindowSize / 2 - 120;
-
-  float pulse = 0.6f + 0.4f * sinf(timer * 3.0f);
-  DrawText(headline, headlineX, headlineY, headlineFont,
-           Fade(accentColor, pulse));
-
-  int subFont = 26;
-  int subWidth = MeasureText(subtext, subFont);
-  DrawText(subtext, (kWindowSize - subWidth) / 2, headlineY + 80, subFont,
-           DARKGRAY);
+  DrawRectangle(0, 0, GetScreenWidth(), GetScreenHeight(), glowColor);
 
-  const char *prompt = "Press Enter to exit the game";
-  int promptFont = 22;
-  int promptWidth = MeasureText(prompt, promptFont);
-  int promptY = kWindowSize - 140;
-  DrawText(prompt, (kWindowSize - promptWidth) / 2, promptY, promptFont,
-           GRAY);
+  float headlineY = kDesignSize / 2 - 120;
 
   // simple decorative orbs to match other screens' liveliness
+  BeginMode2D(viewport.Camera());
   float orbRadius = 18.0f + 6.0f * sinf(timer * 1.5f);
-  DrawCircle(kWindowSize / 2 - 150, headlineY + 120, orbRadius,
-             Fade(SKYBLUE, 0.4f));
-  DrawCircle(kWindowSize / 2 + 150, headlineY + 40, orbRadius,
-             Fade(SKYBLUE, 0.3f));
+  DrawCircleV(Vector2{kDesignSize / 2 - 150, headlineY + 120}, orbRadius,
+              Fade(SKYBLUE, 0.4f));
+  DrawCircleV(Vector2{kDesignSize / 2 + 150, headlineY + 40}, orbRadius,
+              Fade(SKYBLUE, 0.3f));
+  EndMode2D();
+
+  float pulse = 0.6f + 0.4f * sinf(timer * 3.0f);
+  headline.Draw(viewport,
+                (result == GameResult::Victory) ? "Victory!" : "Defeat",
+                Vector2{kDesignSize / 2, headlineY}, Fade(accentColor, pulse));
+  subtext.Draw(viewport,
+               (result == GameResult::Victory)
+                   ? "You sank all enemy ships."
+                   : "All of your ships have been sunk.",
+               Vector2{kDesignSize / 2, headlineY + 80}, DARKGRAY);
+  prompt.Draw(viewport, "Press Enter to exit the game",
+              Vector2{kDesignSize / 2, kDesignSize - 140}, GRAY);
 
   EndDrawing();
 }
@@ -0,0 +1,425 @@
+#include "LoadGenerator.h"
+
+#include "Board.h"
+#include "MatchServer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <enet/enet.h>
+
+namespace {
+
+struct LoadStats {
+  std::atomic<std::uint64_t> matches{0};
+  std::atomic<std::uint64_t> shots{0};
+  std::atomic<std::uint64_t> connectFailures{0};
+};
+
+struct Bot {
+  ENetPeer *peer = nullptr;
+  std::uint64_t playerId = 0;
+  bool onShard = false;
+  bool myTurn = false;
+  int pendingShot = -1;
+  std::uint16_t shotSeq = 0;
+  int hits = 0;
+  int hitsTaken = 0;
+  Grid fleet{};
+  Grid shots{};
+};
+
+template <typename Message>
+void Send(ENetPeer *peer, const Message &msg) {
+  enet_peer_send(peer, kChannel,
+                 enet_packet_create(&msg, sizeof(msg),
+                                    ENET_PACKET_FLAG_RELIABLE));
+}
+
+class BotThread {
+public:
+  BotThread(const LoadGeneratorConfig &config, unsigned players,
+            LoadStats &stats, std::uint32_t seed)
+      : config_(config), bots_(players), stats_(stats), rng_(seed) {}
+
+  void Run(std::uint32_t durationMs);
+
+private:
+  void Queue(Bot &bot);
+  void OnConnect(Bot &bot);
+  void OnReceive(Bot &bot, const ENetPacket *packet);
+  void Fire(Bot &bot);
+  void Prepare(Bot &bot);
+
+  const LoadGeneratorConfig &config_;
+  std::vector<Bot> bots_;
+  LoadStats &stats_;
+  std::mt19937 rng_;
+  ENetHost *host_ = nullptr;
+  ENetAddress address_{};
+};
+
+void BotThread::Run(std::uint32_t durationMs) {
+  // each bot holds one connection, plus headroom while hopping to a shard
+  host_ = enet_host_create(nullptr, bots_.size() * 2, 1, 0, 0);
+  if (!host_) {
+    std::fprintf(stderr, "Failed to create ENet load generator host\n");
+    return;
+  }
+  enet_address_set_host(&address_, config_.host.c_str());
+
+  for (Bot &bot : bots_) {
+    bot.playerId = (static_cast<std::uint64_t>(rng_()) << 32 | rng_()) | 1;
+    Queue(bot);
+  }
+
+  std::uint32_t end = enet_time_get() + durationMs;
+  while (static_cast<std::int32_t>(end - enet_time_get()) > 0) {
+    ENetEvent event;
+    enet_uint32 wait = 1;
+    while (enet_host_service(host_, &event, wait) > 0) {
+      wait = 0;
+      Bot *bot = static_cast<Bot *>(event.peer->data);
+      if (!bot || bot->peer != event.peer) {
+        if (event.type == ENET_EVENT_TYPE_RECEIVE) {
+          enet_packet_destroy(event.packet);
+        }
+        continue;
+      }
+      switch (event.type) {
+      case ENET_EVENT_TYPE_CONNECT:
+        OnConnect(*bot);
+        break;
+      case ENET_EVENT_TYPE_DISCONNECT:
+        if (!bot->onShard) {
+          stats_.connectFailures.fetch_add(1, std::memory_order_relaxed);
+        }
+        Queue(*bot);
+        break;
+      case ENET_EVENT_TYPE_RECEIVE:
+        OnReceive(*bot, event.packet);
+        enet_packet_destroy(event.packet);
+        break;
+      case ENET_EVENT_TYPE_NONE:
+      default:
+        break;
+      }
+    }
+    enet_host_flush(host_);
+  }
+
+  for (Bot &bot : bots_) {
+    if (bot.peer) {
+      enet_peer_disconnect_now(bot.peer, 0);
+    }
+  }
+  enet_host_destroy(host_);
+}
+
+void BotThread::Queue(Bot &bot) {
+  std::uint64_t playerId = bot.playerId;
+  bot = Bot{};
+  bot.playerId = playerId;
+
+  address_.port = config_.port;
+  bot.peer = enet_host_connect(host_, &address_, 1, 0);
+  if (bot.peer) {
+    bot.peer->data = &bot;
+  }
+}
+
+void BotThread::OnConnect(Bot &bot) {
+  LobbyJoinMessage join{static_cast<std::uint8_t>(MessageType::LobbyJoin),
+                        bot.playerId};
+  Send(bot.peer, join);
+  if (bot.onShard) {
+    Prepare(bot);
+  }
+}
+
+void BotThread::Prepare(Bot &bot) {
+  std::vector<Ship> ships = CreateFleet();
+  std::vector<std::uint8_t> locations;
+  int shipIndex = 0;
+  ResetGrid(bot.fleet);
+  AutoPlaceFleet(bot.fleet, ships, shipIndex, locations, rng_);
+
+  // the shard drops duplicates, so announcing again is harmless
+  FinishedPreparingMessage ready{
+      static_cast<std::uint8_t>(MessageType::FinishedPreparing), 1};
+  Send(bot.peer, ready);
+}
+
+void BotThread::Fire(Bot &bot) {
+  int index = PickAutoShot(bot.shots, rng_);
+  if (index < 0) {
+    return;
+  }
+  bot.pendingShot = index;
+  CellRequestMessage shot{static_cast<std::uint8_t>(MessageType::CellRequest),
+                          static_cast<std::uint16_t>(index % kGridCols),
+                          static_cast<std::uint16_t>(index / kGridCols),
+                          ++bot.shotSeq, 0};
+  Send(bot.peer, shot);
+}
+
+void BotThread::OnReceive(Bot &bot, const ENetPacket *packet) {
+  if (packet->dataLength < 1) {
+    return;
+  }
+
+  switch (static_cast<MessageType>(packet->data[0])) {
+  case MessageType::MatchFound: {
+    if (packet->dataLength != sizeof(MatchFoundMessage)) {
+      break;
+    }
+    const auto *msg = reinterpret_cast<const MatchFoundMessage *>(packet->data);
+    enet_peer_disconnect_now(bot.peer, 0);
+    bot.peer->data = nullptr;
+    bot.onShard = true;
+    address_.port = msg->port;
+    bot.peer = enet_host_connect(host_, &address_, 1, msg->matchId);
+    if (bot.peer) {
+      bot.peer->data = &bot;
+    }
+    break;
+  }
+
+  case MessageType::PrepareDeadline:
+    // both seats are in: preparation has officially started
+    if (packet->dataLength == sizeof(PrepareDeadlineMessage) &&
+        reinterpret_cast<const PrepareDeadlineMessage *>(packet->data)
+                ->remainingMs > 0) {
+      Prepare(bot);
+    }
+    break;
+
+  case MessageType::TurnUpdate:
+    if (packet->dataLength != sizeof(TurnUpdateMessage)) {
+      break;
+    }
+    bot.myTurn = reinterpret_cast<const TurnUpdateMessage *>(packet->data)
+                     ->currentTurn == 1;
+    if (bot.myTurn && bot.pendingShot < 0) {
+      Fire(bot);
+    }
+    break;
+
+  case MessageType::CellUpdate: {
+    // the result of our own shot
+    if (packet->dataLength != sizeof(CellUpdateMessage)) {
+      break;
+    }
+    const auto *msg = reinterpret_cast<const CellUpdateMessage *>(packet->data);
+    // older results are stale; a newer seq is a move the shard made for us
+    // after a timeout
+    if (msg->x >= kGridCols || msg->y >= kGridRows ||
+        msg->board != kBoardServer || SeqNewer(bot.shotSeq, msg->seq)) {
+      break;
+    }
+    bot.shotSeq = msg->seq;
+    int index = CellIndex(msg->x, msg->y);
+    bot.shots[index] = msg->filled;
+    bot.pendingShot = -1;
+    stats_.shots.fetch_add(1, std::memory_order_relaxed);
+    if (msg->filled != CellState::Hit) {
+      bot.myTurn = false;
+      break;
+    }
+    if (++bot.hits >= kFleetCellCount) {
+      stats_.matches.fetch_add(1, std::memory_order_relaxed);
+      enet_peer_disconnect_later(bot.peer, 0);
+      break;
+    }
+    Fire(bot);
+    break;
+  }
+
+  case MessageType::CellRequest: {
+    // the opponent's shot at our fleet
+    if (packet->dataLength != sizeof(CellRequestMessage)) {
+      break;
+    }
+    const auto *msg =
+        reinterpret_cast<const CellRequestMessage *>(packet->data);
+    if (msg->x >= kGridCols || msg->y >= kGridRows) {
+      break;
+    }
+    int index = CellIndex(msg->x, msg->y);
+    bool isHit = bot.fleet[index] == CellState::Ship;
+    bot.fleet[index] = isHit ? CellState::Hit : CellState::Miss;
+
+    CellUpdateMessage update{static_cast<std::uint8_t>(MessageType::CellUpdate),
+                             msg->x,
+                             msg->y,
+                             isHit ? CellState::Hit : CellState::Miss,
+                             msg->seq,
+                             kBoardClient,
+                             msg->trace};
+    Send(bot.peer, update);
+    if (isHit && ++bot.hitsTaken >= kFleetCellCount) {
+      enet_peer_disconnect_later(bot.peer, 0);
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
+// Plays one game between two random fleets and returns the shots fired.
+int SelfPlayGame(std::mt19937 &rng) {
+  Grid fleets[2];
+  Grid shots[2];
+  int hits[2] = {0, 0};
+  for (int seat = 0; seat < 2; ++seat) {
+    std::vector<Ship> ships = CreateFleet();
+    std::vector<std::uint8_t> locations;
+    int shipIndex = 0;
+    ResetGrid(fleets[seat]);
+    ResetGrid(shots[seat]);
+    AutoPlaceFleet(fleets[seat], ships, shipIndex, locations, rng);
+  }
+
+  int shotsFired = 0;
+  int seat = 0;
+  while (true) {
+    int index = PickAutoShot(shots[seat], rng);
+    if (index < 0) {
+      return shotsFired;
+    }
+    ++shotsFired;
+    bool isHit = fleets[1 - seat][index] == CellState::Ship;
+    shots[seat][index] = isHit ? CellState::Hit : CellState::Miss;
+    if (!isHit) {
+      seat = 1 - seat;
+    } else if (++hits[seat] >= kFleetCellCount) {
+      return shotsFired;
+    }
+  }
+}
+
+struct LoadResult {
+  double matchesPerSecond = 0.0;
+  double shotsPerSecond = 0.0;
+  std::uint64_t connectFailures = 0;
+};
+
+LoadResult GenerateLoad(const LoadGeneratorConfig &config) {
+  LoadStats stats;
+  unsigned threadCount = std::max(1u, std::min(config.threads,
+                                               config.players));
+  std::vector<std::unique_ptr<BotThread>> bots;
+  std::vector<std::thread> threads;
+  std::random_device seed;
+  for (unsigned i = 0; i < threadCount; ++i) {
+    unsigned players = config.players / threadCount +
+                       (i < config.players % threadCount ? 1 : 0);
+    bots.push_back(
+        std::make_unique<BotThread>(config, players, stats, seed()));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (auto &bot : bots) {
+    threads.emplace_back(&BotThread::Run, bot.get(), config.durationMs);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  LoadResult result;
+  result.matchesPerSecond = stats.matches.load() / seconds;
+  result.shotsPerSecond = stats.shots.load() / seconds;
+  result.connectFailures = stats.connectFailures.load();
+  return result;
+}
+
+void PrintResult(const char *label, const LoadResult &result) {
+  std::printf("%-10s %10.1f matches/s %12.1f shots/s %6llu failed connects\n",
+              label, result.matchesPerSecond, result.shotsPerSecond,
+              static_cast<unsigned long long>(result.connectFailures));
+}
+
+} // namespace
+
+int RunLoadGenerator(const LoadGeneratorConfig &config) {
+  std::printf("%u bot players on %u threads, %.1fs per run\n", config.players,
+              config.threads, config.durationMs / 1000.0);
+
+  if (config.sweepShards == 0) {
+    PrintResult("external", GenerateLoad(config));
+    return 0;
+  }
+
+  // the bots share the machine, so the curve flattens once bots and shards
+  // together run out of cores
+  for (unsigned shards = 1; shards <= config.sweepShards; shards *= 2) {
+    MatchServerConfig serverConfig;
+    serverConfig.port = config.port;
+    serverConfig.shards = shards;
+    serverConfig.ratingsPath = "loadgen_ratings.dat";
+    serverConfig.resultsPath = "loadgen_results";
+    // the bots play flat out, and only against each other
+    serverConfig.limits.perSecond = 0;
+    serverConfig.maxQueued = 0;
+    serverConfig.botAfterMs = 0;
+
+    std::atomic<bool> stop{false};
+    int serverResult = 0;
+    std::thread server([&] {
+      serverResult = RunMatchServer(serverConfig, &stop);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    LoadGeneratorConfig runConfig = config;
+    runConfig.host = "127.0.0.1";
+    LoadResult result = GenerateLoad(runConfig);
+
+    stop.store(true);
+    server.join();
+    if (serverResult != 0) {
+      return serverResult;
+    }
+
+    char label[32];
+    std::snprintf(label, sizeof(label), "%u shards", shards);
+    PrintResult(label, result);
+  }
+  return 0;
+}
+
+int RunTrainingWorkload() {
+  constexpr int kSelfPlayGames = 20000;
+  constexpr std::uint32_t kSelfPlaySeed = 0x5EED;
+
+  std::mt19937 rng(kSelfPlaySeed);
+  std::uint64_t shots = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int game = 0; game < kSelfPlayGames; ++game) {
+    shots += static_cast<std::uint64_t>(SelfPlayGame(rng));
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::printf("self-play: %d games, %.1f shots/game, %.0f games/s\n",
+              kSelfPlayGames, static_cast<double>(shots) / kSelfPlayGames,
+              kSelfPlayGames / seconds);
+
+  LoadGeneratorConfig config;
+  config.players = 128;
+  config.threads = 2;
+  config.durationMs = 8000;
+  config.sweepShards = 2;
+  return RunLoadGenerator(config);
+}
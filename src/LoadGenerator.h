@@ -0,0 +1,28 @@
+// LoadGenerator.h
+#pragma once
+
+#include "Protocol.h"
+
+#include <cstdint>
+#include <string>
+
+struct LoadGeneratorConfig {
+  std::string host = "127.0.0.1";
+  std::uint16_t port = kMatchmakingPort;
+  unsigned players = 256; // concurrent bot players
+  unsigned threads = 4;   // client threads sharing the players
+  std::uint32_t durationMs = 20000;
+  // > 0 sweeps an in-process match server over 1, 2, 4 ... sweepShards
+  // shards instead of loading an external host
+  unsigned sweepShards = 0;
+};
+
+// Headless bots that queue in the lobby, follow MatchFound to their shard,
+// place a random fleet and fire random shots, then queue again. Prints
+// finished matches and relayed shots per second.
+int RunLoadGenerator(const LoadGeneratorConfig &config);
+
+// Fixed, non-interactive workload for profile-guided builds: seeded headless
+// self-play games followed by a short loopback run of bots against an
+// in-process two-shard host.
+int RunTrainingWorkload();
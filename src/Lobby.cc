@@ -0,0 +1,208 @@
+#include "Lobby.h"
+
+#include <algorithm>
+
+Lobby::Lobby(const LobbyConfig &config)
+    : config_(config), widenWheel_(100, 256) {
+  if (config_.bucketWidth <= 0) {
+    config_.bucketWidth = 1;
+  }
+  if (config_.maxRating < config_.minRating) {
+    config_.maxRating = config_.minRating;
+  }
+  config_.maxRadius = std::max(config_.maxRadius, config_.initialRadius);
+  int span = config_.maxRating - config_.minRating;
+  buckets_.resize(static_cast<size_t>(span / config_.bucketWidth + 1));
+}
+
+void Lobby::Start(std::uint32_t nowMs) { widenWheel_.Start(nowMs); }
+
+Lobby::Ticket Lobby::Enqueue(std::uint32_t token, int rating,
+                             std::vector<Pairing> &pairings) {
+  std::int32_t index = Allocate();
+  Entry &entry = entries_[index];
+  entry.token = token;
+  entry.serial = nextSerial_++;
+  entry.bucket = BucketFor(rating);
+  entry.radius = config_.initialRadius;
+  entry.waitedMs = 0;
+  Link(index);
+  ++size_;
+
+  if (TryPair(index, pairings)) {
+    return kInvalidTicket;
+  }
+
+  entries_[index].widenTimer = widenWheel_.Schedule(
+      config_.widenEveryMs, static_cast<std::uint32_t>(index));
+  return (static_cast<Ticket>(entries_[index].generation) << 32) |
+         static_cast<Ticket>(index + 1);
+}
+
+bool Lobby::Remove(Ticket ticket) {
+  if (ticket == kInvalidTicket) {
+    return false;
+  }
+  std::int32_t index = static_cast<std::int32_t>(ticket & 0xFFFFFFFFu) - 1;
+  std::uint32_t generation = static_cast<std::uint32_t>(ticket >> 32);
+  if (index < 0 || static_cast<size_t>(index) >= entries_.size()) {
+    return false;
+  }
+  Entry &entry = entries_[index];
+  if (!entry.active || entry.generation != generation) {
+    return false;
+  }
+  Take(index);
+  return true;
+}
+
+void Lobby::Tick(std::uint32_t nowMs, std::vector<Pairing> &pairings) {
+  widenWheel_.Advance(nowMs, [&](std::uint32_t token) {
+    std::int32_t index = static_cast<std::int32_t>(token);
+    Entry &entry = entries_[index];
+    entry.widenTimer = TimerWheel::kInvalidHandle;
+    if (!entry.active) {
+      return;
+    }
+
+    entry.radius = std::min(entry.radius + 1, config_.maxRadius);
+    entry.waitedMs += config_.widenEveryMs;
+    if (TryPair(index, pairings)) {
+      return;
+    }
+    // nobody in reach for long enough, so a server bot takes the other seat
+    if (config_.botAfterMs > 0 &&
+        entries_[index].waitedMs >= config_.botAfterMs) {
+      pairings.push_back(Pairing{entries_[index].token, kBotToken});
+      Take(index);
+      return;
+    }
+    // at full width only newcomers can still reach this ticket, but the
+    // clock keeps running while a bot is still on offer
+    if (entries_[index].radius < config_.maxRadius ||
+        config_.botAfterMs > 0) {
+      entries_[index].widenTimer =
+          widenWheel_.Schedule(config_.widenEveryMs, token);
+    }
+  });
+}
+
+std::int32_t Lobby::BucketFor(int rating) const {
+  int clamped = std::clamp(rating, config_.minRating, config_.maxRating);
+  return (clamped - config_.minRating) / config_.bucketWidth;
+}
+
+std::int32_t Lobby::Allocate() {
+  std::int32_t index = freeHead_;
+  if (index != kNil) {
+    freeHead_ = entries_[index].next;
+  } else {
+    index = static_cast<std::int32_t>(entries_.size());
+    entries_.emplace_back();
+  }
+  entries_[index].active = true;
+  entries_[index].widenTimer = TimerWheel::kInvalidHandle;
+  return index;
+}
+
+void Lobby::Release(std::int32_t index) {
+  Entry &entry = entries_[index];
+  entry.active = false;
+  ++entry.generation;
+  if (entry.generation == 0) {
+    entry.generation = 1;
+  }
+  entry.prev = kNil;
+  entry.next = freeHead_;
+  freeHead_ = index;
+}
+
+void Lobby::Link(std::int32_t index) {
+  Entry &entry = entries_[index];
+  Bucket &bucket = buckets_[entry.bucket];
+  entry.prev = bucket.tail;
+  entry.next = kNil;
+  if (bucket.tail != kNil) {
+    entries_[bucket.tail].next = index;
+  } else {
+    bucket.head = index;
+  }
+  bucket.tail = index;
+}
+
+void Lobby::Unlink(std::int32_t index) {
+  Entry &entry = entries_[index];
+  Bucket &bucket = buckets_[entry.bucket];
+  if (entry.prev != kNil) {
+    entries_[entry.prev].next = entry.next;
+  } else {
+    bucket.head = entry.next;
+  }
+  if (entry.next != kNil) {
+    entries_[entry.next].prev = entry.prev;
+  } else {
+    bucket.tail = entry.prev;
+  }
+}
+
+// Nearest bucket wins; on a tie the older head wins. A bucket head is its
+// oldest and therefore widest ticket, so if it rejects the distance nobody
+// behind it will accept either.
+std::int32_t Lobby::FindOpponent(std::int32_t index) const {
+  const Entry &seeker = entries_[index];
+  const std::int32_t bucketCount = static_cast<std::int32_t>(buckets_.size());
+
+  for (std::int32_t distance = 0; distance <= seeker.radius; ++distance) {
+    std::int32_t best = kNil;
+    for (std::int32_t side : {-1, 1}) {
+      if (distance == 0 && side == 1) {
+        break;
+      }
+      std::int32_t bucket = seeker.bucket + side * distance;
+      if (bucket < 0 || bucket >= bucketCount) {
+        continue;
+      }
+
+      std::int32_t candidate = buckets_[bucket].head;
+      if (candidate == index) {
+        candidate = entries_[candidate].next;
+      }
+      if (candidate == kNil || entries_[candidate].radius < distance) {
+        continue;
+      }
+      if (best == kNil || entries_[candidate].serial < entries_[best].serial) {
+        best = candidate;
+      }
+    }
+    if (best != kNil) {
+      return best;
+    }
+  }
+  return kNil;
+}
+
+bool Lobby::TryPair(std::int32_t index, std::vector<Pairing> &pairings) {
+  std::int32_t opponent = FindOpponent(index);
+  if (opponent == kNil) {
+    return false;
+  }
+
+  const Entry &seeker = entries_[index];
+  const Entry &other = entries_[opponent];
+  if (other.serial < seeker.serial) {
+    pairings.push_back(Pairing{other.token, seeker.token});
+  } else {
+    pairings.push_back(Pairing{seeker.token, other.token});
+  }
+
+  Take(opponent);
+  Take(index);
+  return true;
+}
+
+void Lobby::Take(std::int32_t index) {
+  widenWheel_.Cancel(entries_[index].widenTimer);
+  Unlink(index);
+  Release(index);
+  --size_;
+}
@@ -0,0 +1,92 @@
+// Lobby.h
+#pragma once
+
+#include "TimerWheel.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct LobbyConfig {
+  int bucketWidth = 25; // rating points per bucket
+  int minRating = 0;
+  int maxRating = 4000;
+  int initialRadius = 2; // buckets either side a fresh ticket accepts
+  int maxRadius = 40;
+  std::uint32_t widenEveryMs = 2000; // wait time that buys one more bucket
+  // wait after which a ticket is paired with a server bot; 0 = humans only
+  std::uint32_t botAfterMs = 0;
+};
+
+// Rating-bucketed matchmaking queue. Each bucket keeps its tickets in arrival
+// order, so finding the oldest compatible opponent probes at most
+// 2 * radius + 1 bucket heads instead of scanning everyone who is waiting.
+// Search windows widen with wait time through a timer wheel, so a tick only
+// revisits the tickets whose window actually grew.
+class Lobby {
+public:
+  using Ticket = std::uint64_t;
+  static constexpr Ticket kInvalidTicket = 0;
+
+  // Stands in for the second token of a pairing against a server bot.
+  static constexpr std::uint32_t kBotToken = 0xFFFFFFFFu;
+
+  // Tokens are whatever the caller enqueued; first is the longer waiter.
+  struct Pairing {
+    std::uint32_t first;
+    std::uint32_t second;
+  };
+
+  explicit Lobby(const LobbyConfig &config = LobbyConfig{});
+
+  void Start(std::uint32_t nowMs);
+
+  // Queues a player and immediately tries to pair them. Returns
+  // kInvalidTicket when the player was paired on the spot.
+  Ticket Enqueue(std::uint32_t token, int rating,
+                 std::vector<Pairing> &pairings);
+
+  bool Remove(Ticket ticket);
+
+  void Tick(std::uint32_t nowMs, std::vector<Pairing> &pairings);
+
+  std::size_t Size() const { return size_; }
+
+private:
+  static constexpr std::int32_t kNil = -1;
+
+  struct Entry {
+    std::uint32_t token = 0;
+    std::uint32_t generation = 1;
+    std::uint64_t serial = 0; // enqueue order, lower waited longer
+    std::int32_t bucket = 0;
+    std::int32_t radius = 0;
+    std::uint32_t waitedMs = 0; // counted in widen steps
+    std::int32_t prev = kNil;
+    std::int32_t next = kNil;
+    TimerWheel::Handle widenTimer = TimerWheel::kInvalidHandle;
+    bool active = false;
+  };
+
+  struct Bucket {
+    std::int32_t head = kNil;
+    std::int32_t tail = kNil;
+  };
+
+  std::int32_t BucketFor(int rating) const;
+  std::int32_t Allocate();
+  void Release(std::int32_t index);
+  void Link(std::int32_t index);
+  void Unlink(std::int32_t index);
+  std::int32_t FindOpponent(std::int32_t index) const;
+  bool TryPair(std::int32_t index, std::vector<Pairing> &pairings);
+  void Take(std::int32_t index);
+
+  LobbyConfig config_;
+  std::vector<Bucket> buckets_;
+  std::vector<Entry> entries_;
+  std::int32_t freeHead_ = kNil;
+  std::size_t size_ = 0;
+  std::uint64_t nextSerial_ = 0;
+  TimerWheel widenWheel_;
+};
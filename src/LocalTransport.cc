@@ -0,0 +1,268 @@
+#include "LocalTransport.h"
+
+#include "Log.h"
+#include "Protocol.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::uint32_t kSegmentMagic = 0x544C4D41; // "AMLT"
+constexpr std::uint32_t kSegmentVersion = 1;
+// far more than a match ever has in flight between two frames
+constexpr std::uint32_t kRingSlots = 256;
+
+struct alignas(64) Slot {
+  std::uint16_t size;
+  std::uint8_t data[LocalTransport::kMaxMessageSize];
+};
+static_assert(sizeof(Slot) == 128, "a slot is two cache lines");
+static_assert(sizeof(GridSnapshotMessage) <= LocalTransport::kMaxMessageSize,
+              "every message fits a slot");
+
+// One direction. Only the writing side moves tail and only the reading
+// side moves head, each on its own cache line.
+struct Ring {
+  alignas(64) std::atomic<std::uint32_t> head;
+  alignas(64) std::atomic<std::uint32_t> tail;
+  Slot slots[kRingSlots];
+
+  bool Push(const void *data, std::size_t size) {
+    std::uint32_t at = tail.load(std::memory_order_relaxed);
+    if (at - head.load(std::memory_order_acquire) >= kRingSlots) {
+      return false;
+    }
+    Slot &slot = slots[at % kRingSlots];
+    slot.size = static_cast<std::uint16_t>(size);
+    std::memcpy(slot.data, data, size);
+    tail.store(at + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool Pop(std::uint8_t *out, std::size_t &size) {
+    std::uint32_t at = head.load(std::memory_order_relaxed);
+    if (at == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    const Slot &slot = slots[at % kRingSlots];
+    size = slot.size;
+    std::memcpy(out, slot.data, size);
+    head.store(at + 1, std::memory_order_release);
+    return true;
+  }
+
+  void Clear() {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+  }
+};
+
+bool Alive(std::int32_t pid) {
+  return pid > 0 && (::kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+std::string SegmentName(std::uint16_t port) {
+  return "/amiral-" + std::to_string(port);
+}
+
+} // namespace
+
+// The closed fields hold 0 while that side is open, otherwise 1 plus the
+// DisconnectReason it left with.
+struct LocalTransport::Segment {
+  std::atomic<std::uint32_t> magic;
+  std::uint32_t version;
+  std::atomic<std::int32_t> hostPid;
+  std::atomic<std::int32_t> guestPid; // 0 while the seat is free
+  std::atomic<std::uint32_t> hostClosed;
+  std::atomic<std::uint32_t> guestClosed;
+  Ring toGuest;
+  Ring toHost;
+};
+
+LocalTransport::~LocalTransport() {
+  if (!segment_) {
+    return;
+  }
+  Close(0);
+  if (host_) {
+    ::shm_unlink(name_.c_str());
+  }
+  Unmap();
+}
+
+bool LocalTransport::Map(int fd) {
+  void *memory = ::mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+  if (memory == MAP_FAILED) {
+    return false;
+  }
+  segment_ = static_cast<Segment *>(memory);
+  return true;
+}
+
+void LocalTransport::Unmap() {
+  ::munmap(segment_, sizeof(Segment));
+  segment_ = nullptr;
+}
+
+bool LocalTransport::Listen(std::uint16_t port) {
+  name_ = SegmentName(port);
+  // we own the port, so a segment still named after it is a dead host's
+  ::shm_unlink(name_.c_str());
+  int fd = ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  bool mapped =
+      ::ftruncate(fd, static_cast<off_t>(sizeof(Segment))) == 0 && Map(fd);
+  ::close(fd);
+  if (!mapped) {
+    ::shm_unlink(name_.c_str());
+    return false;
+  }
+
+  new (segment_) Segment();
+  segment_->version = kSegmentVersion;
+  segment_->hostPid.store(static_cast<std::int32_t>(::getpid()),
+                          std::memory_order_relaxed);
+  segment_->magic.store(kSegmentMagic, std::memory_order_release);
+  host_ = true;
+  return true;
+}
+
+bool LocalTransport::Connect(std::uint16_t port) {
+  name_ = SegmentName(port);
+  int fd = ::shm_open(name_.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info {};
+  bool mapped = ::fstat(fd, &info) == 0 &&
+                static_cast<std::size_t>(info.st_size) >= sizeof(Segment) &&
+                Map(fd);
+  ::close(fd);
+  if (!mapped) {
+    return false;
+  }
+
+  Segment &segment = *segment_;
+  std::int32_t free = 0;
+  if (segment.magic.load(std::memory_order_acquire) != kSegmentMagic ||
+      segment.version != kSegmentVersion ||
+      !Alive(segment.hostPid.load(std::memory_order_relaxed)) ||
+      !segment.guestPid.compare_exchange_strong(
+          free, static_cast<std::int32_t>(::getpid()),
+          std::memory_order_acq_rel)) {
+    Unmap();
+    return false;
+  }
+  return true;
+}
+
+void LocalTransport::Send(const void *data, std::size_t size) {
+  if (!segment_ || closing_ || (host_ && !attached_)) {
+    return;
+  }
+  if (size > kMaxMessageSize) {
+    Log(LogLevel::Error, "Dropped a %zu byte message, too long to share",
+        size);
+    return;
+  }
+  Ring &ring = host_ ? segment_->toGuest : segment_->toHost;
+  if (!ring.Push(data, size)) {
+    // the other side stopped reading, as good as gone
+    Log(LogLevel::Warn, "Shared memory peer fell %u messages behind",
+        kRingSlots);
+    Close(static_cast<std::uint32_t>(DisconnectReason::Flooding));
+  }
+}
+
+void LocalTransport::Refuse() {
+  Close(static_cast<std::uint32_t>(DisconnectReason::Busy));
+}
+
+void LocalTransport::Close(std::uint32_t reason) {
+  if (!segment_ || closing_ || (host_ && !attached_)) {
+    return;
+  }
+  std::atomic<std::uint32_t> &closed =
+      host_ ? segment_->hostClosed : segment_->guestClosed;
+  closed.store(reason + 1, std::memory_order_release);
+  closing_ = true;
+}
+
+// Ready for the next guest. Only called once the last one has closed or
+// died, so nobody else touches the rings meanwhile.
+void LocalTransport::FreeSeat() {
+  Segment &segment = *segment_;
+  segment.toGuest.Clear();
+  segment.toHost.Clear();
+  segment.guestClosed.store(0, std::memory_order_relaxed);
+  segment.hostClosed.store(0, std::memory_order_relaxed);
+  segment.guestPid.store(0, std::memory_order_release);
+  attached_ = false;
+  closing_ = false;
+}
+
+bool LocalTransport::Poll(TransportEvent &event) {
+  if (!segment_) {
+    return false;
+  }
+  Segment &segment = *segment_;
+
+  if (host_ && !attached_) {
+    std::int32_t pid = segment.guestPid.load(std::memory_order_acquire);
+    if (pid == 0) {
+      return false;
+    }
+    Log(LogLevel::Info, "Client attached through shared memory, pid %d", pid);
+    attached_ = true;
+    event = TransportEvent{};
+    event.type = TransportEvent::Type::Connected;
+    return true;
+  }
+
+  // whatever was sent before a close is still delivered
+  std::size_t size = 0;
+  Ring &inbound = host_ ? segment.toHost : segment.toGuest;
+  if (inbound.Pop(message_, size)) {
+    event = TransportEvent{};
+    event.type = TransportEvent::Type::Message;
+    event.data = message_;
+    event.size = size;
+    return true;
+  }
+
+  std::uint32_t peerClosed =
+      (host_ ? segment.guestClosed : segment.hostClosed)
+          .load(std::memory_order_acquire);
+  std::int32_t peerPid = (host_ ? segment.guestPid : segment.hostPid)
+                             .load(std::memory_order_relaxed);
+  bool gone = peerClosed != 0 || !Alive(peerPid);
+  // a host that closed waits for the guest to notice before freeing the
+  // seat; a guest that closed is done at once
+  if (!gone && (host_ || !closing_)) {
+    return false;
+  }
+
+  event = TransportEvent{};
+  event.type = TransportEvent::Type::Disconnected;
+  event.reason = peerClosed != 0 ? peerClosed - 1 : 0;
+  if (host_) {
+    FreeSeat();
+  } else {
+    Close(0);
+    Unmap();
+  }
+  return true;
+}
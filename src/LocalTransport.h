@@ -0,0 +1,58 @@
+// LocalTransport.h
+#pragma once
+
+#include "Transport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Links a host and a guest on the same machine through a shared memory
+// segment named after the host's port, in place of ENet over loopback.
+// Each direction is a single-producer/single-consumer ring of fixed-size
+// slots, so a message is one copy in and one copy out with no system call
+// and no acknowledgement round trip. Peer liveness comes from the other
+// side's pid rather than keepalives.
+class LocalTransport : public Transport {
+public:
+  // messages longer than this are dropped; the largest, a GridSnapshot,
+  // fits
+  static constexpr std::size_t kMaxMessageSize = 126;
+
+  LocalTransport() = default;
+  ~LocalTransport() override;
+
+  LocalTransport(const LocalTransport &) = delete;
+  LocalTransport &operator=(const LocalTransport &) = delete;
+
+  // Host side: creates the segment for port, replacing one left by a host
+  // that crashed. One guest at a time can attach.
+  bool Listen(std::uint16_t port);
+  // Guest side: false when no live host on this machine listens on port,
+  // or another guest already holds the seat.
+  bool Connect(std::uint16_t port);
+
+  void Send(const void *data, std::size_t size) override;
+  void Disconnect() override { Close(0); }
+  void Refuse() override;
+  bool Poll(TransportEvent &event) override;
+
+  using Transport::Send;
+
+private:
+  struct Segment;
+
+  bool Map(int fd);
+  void Unmap();
+  void Close(std::uint32_t reason);
+  void FreeSeat();
+
+  Segment *segment_ = nullptr;
+  std::string name_;
+  bool host_ = false;
+  // host: a guest has been reported Connected
+  bool attached_ = false;
+  // this side has closed and is waiting to report it
+  bool closing_ = false;
+  std::uint8_t message_[kMaxMessageSize];
+};
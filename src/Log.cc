@@ -0,0 +1,270 @@
+#include "Log.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+namespace logdetail {
+
+std::atomic<std::uint8_t> minLevel{static_cast<std::uint8_t>(LogLevel::Info)};
+
+std::uint64_t Now() {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+} // namespace logdetail
+
+namespace {
+
+using logdetail::ArgKind;
+using logdetail::Record;
+
+constexpr std::size_t kRingSize = 8192; // a power of two
+constexpr auto kIdleWait = std::chrono::milliseconds(5);
+const char *const kLevelNames[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+// timestamps count from here, before anything could have logged
+const std::uint64_t kStartNanos = logdetail::Now();
+
+// Appends one conversion of record's argument index to out. spec is the
+// conversion as written minus its length modifier; the argument's own kind
+// decides the modifier, so a mismatched format cannot misread memory.
+void FormatArg(const Record &record, int index, std::string spec, char conv,
+               std::string &out) {
+  char buffer[128];
+  std::uint64_t value = record.values[index];
+  switch (record.kinds[index]) {
+  case ArgKind::Int:
+  case ArgKind::Uint: {
+    bool isSigned = record.kinds[index] == ArgKind::Int;
+    if (conv == 'c') {
+      spec += 'c';
+      std::snprintf(buffer, sizeof(buffer), spec.c_str(),
+                    static_cast<int>(value));
+      break;
+    }
+    if (conv != 'x' && conv != 'X' && conv != 'o') {
+      conv = isSigned ? 'd' : 'u';
+    }
+    spec += "ll";
+    spec += conv;
+    if (isSigned) {
+      std::snprintf(buffer, sizeof(buffer), spec.c_str(),
+                    static_cast<long long>(value));
+    } else {
+      std::snprintf(buffer, sizeof(buffer), spec.c_str(),
+                    static_cast<unsigned long long>(value));
+    }
+    break;
+  }
+  case ArgKind::Double: {
+    double number;
+    std::memcpy(&number, &value, sizeof(number));
+    spec += std::strchr("eEfFgGaA", conv) ? conv : 'g';
+    std::snprintf(buffer, sizeof(buffer), spec.c_str(), number);
+    break;
+  }
+  case ArgKind::Text:
+    spec += 's';
+    std::snprintf(buffer, sizeof(buffer), spec.c_str(), record.text + value);
+    break;
+  case ArgKind::Pointer:
+  default:
+    std::snprintf(buffer, sizeof(buffer), "%p",
+                  reinterpret_cast<void *>(static_cast<std::uintptr_t>(value)));
+    break;
+  }
+  out += buffer;
+}
+
+void FormatRecord(const Record &record, std::string &out) {
+  char prefix[48];
+  double seconds = (record.nanos - kStartNanos) / 1e9;
+  int level = static_cast<int>(record.level);
+  if (record.tag != 0) {
+    std::snprintf(prefix, sizeof(prefix), "%11.6f %s [m%u] ", seconds,
+                  kLevelNames[level], record.tag);
+  } else {
+    std::snprintf(prefix, sizeof(prefix), "%11.6f %s ", seconds,
+                  kLevelNames[level]);
+  }
+  out += prefix;
+
+  int next = 0;
+  for (const char *p = record.format; *p; ++p) {
+    if (*p != '%') {
+      out += *p;
+      continue;
+    }
+    if (p[1] == '%') {
+      out += '%';
+      ++p;
+      continue;
+    }
+    std::string spec = "%";
+    ++p;
+    while (*p && std::strchr("-+ #0123456789.", *p)) {
+      spec += *p++;
+    }
+    while (*p && std::strchr("hlLqjzt", *p)) {
+      ++p;
+    }
+    if (!*p) {
+      break;
+    }
+    if (next < record.argCount) {
+      FormatArg(record, next++, spec, *p, out);
+    } else {
+      out += "<?>";
+    }
+  }
+  out += '\n';
+}
+
+// A bounded multi-producer ring, one consumer. Every slot carries a
+// sequence number saying whose turn it is, so producers only contend on a
+// single compare-and-swap of the tail and never wait for each other.
+class Logger {
+public:
+  Logger() : slots_(new Slot[kRingSize]) {
+    for (std::size_t i = 0; i < kRingSize; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    thread_ = std::thread(&Logger::Run, this);
+  }
+
+  ~Logger() {
+    stopping_.store(true, std::memory_order_release);
+    thread_.join();
+    if (std::uint64_t dropped = Dropped()) {
+      std::fprintf(sink_, "%llu log records dropped, the ring was full\n",
+                   static_cast<unsigned long long>(dropped));
+    }
+    if (sink_ != stderr) {
+      std::fclose(sink_);
+    }
+  }
+
+  Logger(const Logger &) = delete;
+  Logger &operator=(const Logger &) = delete;
+
+  void Push(const Record &record) {
+    std::uint64_t position = tail_.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+      slot = &slots_[position & (kRingSize - 1)];
+      std::uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+      auto lag = static_cast<std::int64_t>(sequence - position);
+      if (lag == 0) {
+        if (tail_.compare_exchange_weak(position, position + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (lag < 0) {
+        // full: the game thread never waits on the disk
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        position = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    slot->record = record;
+    slot->sequence.store(position + 1, std::memory_order_release);
+  }
+
+  bool SetFile(const std::string &path) {
+    std::FILE *file = std::fopen(path.c_str(), "a");
+    if (!file) {
+      return false;
+    }
+    sinkNext_.store(file, std::memory_order_release);
+    return true;
+  }
+
+  std::uint64_t Dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Slot {
+    std::atomic<std::uint64_t> sequence{0};
+    Record record;
+  };
+
+  void Run() {
+    std::string batch;
+    for (;;) {
+      bool stopping = stopping_.load(std::memory_order_acquire);
+      std::FILE *next = sinkNext_.exchange(nullptr, std::memory_order_acq_rel);
+      if (next) {
+        if (sink_ != stderr) {
+          std::fclose(sink_);
+        }
+        sink_ = next;
+      }
+
+      batch.clear();
+      for (;;) {
+        Slot &slot = slots_[head_ & (kRingSize - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+          break;
+        }
+        FormatRecord(slot.record, batch);
+        slot.sequence.store(head_ + kRingSize, std::memory_order_release);
+        ++head_;
+      }
+
+      if (!batch.empty()) {
+        std::fwrite(batch.data(), 1, batch.size(), sink_);
+        std::fflush(sink_);
+      } else if (stopping) {
+        return;
+      } else {
+        std::this_thread::sleep_for(kIdleWait);
+      }
+    }
+  }
+
+  std::unique_ptr<Slot[]> slots_;
+  alignas(64) std::atomic<std::uint64_t> tail_{0};
+  alignas(64) std::uint64_t head_ = 0; // the logger thread's alone
+  std::atomic<std::uint64_t> dropped_{0};
+  std::atomic<bool> stopping_{false};
+  std::atomic<std::FILE *> sinkNext_{nullptr};
+  std::FILE *sink_ = stderr;
+  std::thread thread_;
+};
+
+// Started by the first record, so processes that never log never pay for
+// the thread; joined, with the ring drained, when the process exits.
+Logger &Instance() {
+  static Logger logger;
+  return logger;
+}
+
+} // namespace
+
+void logdetail::Submit(const Record &record) { Instance().Push(record); }
+
+void SetLogLevel(LogLevel level) {
+  logdetail::minLevel.store(static_cast<std::uint8_t>(level),
+                            std::memory_order_relaxed);
+}
+
+bool ParseLogLevel(const char *text, LogLevel &level) {
+  const char *const names[] = {"debug", "info", "warn", "error", "off"};
+  for (int i = 0; i <= static_cast<int>(LogLevel::Off); ++i) {
+    if (std::strcmp(text, names[i]) == 0) {
+      level = static_cast<LogLevel>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SetLogFile(const std::string &path) { return Instance().SetFile(path); }
+
+std::uint64_t LogDropped() { return Instance().Dropped(); }
@@ -0,0 +1,128 @@
+// Log.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+enum class LogLevel : std::uint8_t { Debug = 0, Info, Warn, Error, Off };
+
+// Records below the level are dropped at the call site for the price of one
+// relaxed load. The default is Info.
+void SetLogLevel(LogLevel level);
+bool ParseLogLevel(const char *text, LogLevel &level);
+// Sends records to path instead of stderr. Call before the first record.
+bool SetLogFile(const std::string &path);
+// Records lost because the ring was full.
+std::uint64_t LogDropped();
+
+namespace logdetail {
+
+constexpr int kMaxArgs = 6;
+constexpr std::size_t kTextBytes = 48;
+
+enum class ArgKind : std::uint8_t { Int, Uint, Double, Text, Pointer };
+
+// A log call as raw values. The format string is kept as a pointer, so it
+// must be a literal; text arguments are copied into text[] and truncated.
+struct Record {
+  std::uint64_t nanos;
+  const char *format;
+  std::uint32_t tag; // match id, 0 = none
+  LogLevel level;
+  std::uint8_t argCount;
+  std::uint8_t textUsed;
+  ArgKind kinds[kMaxArgs];
+  std::uint64_t values[kMaxArgs]; // Text: offset into text
+  char text[kTextBytes];
+};
+
+extern std::atomic<std::uint8_t> minLevel;
+
+std::uint64_t Now();
+void Submit(const Record &record);
+
+inline void PutText(Record &record, int index, const char *text) {
+  std::size_t room = kTextBytes - record.textUsed;
+  std::size_t length = text ? std::strlen(text) : 0;
+  if (room == 0) {
+    record.kinds[index] = ArgKind::Pointer;
+    record.values[index] = 0;
+    return;
+  }
+  length = length < room - 1 ? length : room - 1;
+  std::memcpy(record.text + record.textUsed, text, length);
+  record.text[record.textUsed + length] = '\0';
+  record.kinds[index] = ArgKind::Text;
+  record.values[index] = record.textUsed;
+  record.textUsed = static_cast<std::uint8_t>(record.textUsed + length + 1);
+}
+
+template <typename T> void Put(Record &record, int index, const T &value) {
+  if constexpr (std::is_enum_v<T>) {
+    Put(record, index, static_cast<std::underlying_type_t<T>>(value));
+  } else if constexpr (std::is_floating_point_v<T>) {
+    double wide = value;
+    record.kinds[index] = ArgKind::Double;
+    std::memcpy(&record.values[index], &wide, sizeof(wide));
+  } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+    record.kinds[index] = ArgKind::Int;
+    record.values[index] = static_cast<std::uint64_t>(value);
+  } else if constexpr (std::is_integral_v<T>) {
+    record.kinds[index] = ArgKind::Uint;
+    record.values[index] = value;
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    PutText(record, index, value.c_str());
+  } else if constexpr (std::is_convertible_v<T, const char *>) {
+    PutText(record, index, value);
+  } else {
+    static_assert(std::is_pointer_v<T>, "unsupported log argument");
+    record.kinds[index] = ArgKind::Pointer;
+    record.values[index] = reinterpret_cast<std::uintptr_t>(value);
+  }
+}
+
+template <typename... Args>
+void Emit(LogLevel level, std::uint32_t tag, const char *format,
+          const Args &...args) {
+  static_assert(sizeof...(Args) <= kMaxArgs, "too many log arguments");
+  Record record;
+  record.nanos = Now();
+  record.format = format;
+  record.tag = tag;
+  record.level = level;
+  record.argCount = static_cast<std::uint8_t>(sizeof...(Args));
+  record.textUsed = 0;
+  int index = 0;
+  (Put(record, index++, args), ...);
+  Submit(record);
+}
+
+} // namespace logdetail
+
+inline bool LogEnabled(LogLevel level) {
+  return static_cast<std::uint8_t>(level) >=
+         logdetail::minLevel.load(std::memory_order_relaxed);
+}
+
+// printf-style, formatted later on the logger's own thread. A call costs a
+// clock read and a copy into a lock-free ring; it never blocks or touches
+// a file. Lines end on their own, so formats carry no '\n'.
+template <typename... Args>
+void Log(LogLevel level, const char *format, const Args &...args) {
+  if (LogEnabled(level)) {
+    logdetail::Emit(level, 0, format, args...);
+  }
+}
+
+// The same, tagged with the match the record is about.
+template <typename... Args>
+void LogMatch(LogLevel level, std::uint32_t matchId, const char *format,
+              const Args &...args) {
+  if (LogEnabled(level)) {
+    logdetail::Emit(level, matchId, format, args...);
+  }
+}
@@ -0,0 +1,1526 @@
+#include "MatchServer.h"
+
+#include "Board.h"
+#include "BotBrain.h"
+#include "Checkpoint.h"
+#include "Lobby.h"
+#include "Log.h"
+#include "Protocol.h"
+#include "Rating.h"
+#include "ReplayBook.h"
+#include "ResultStore.h"
+#include "Session.h"
+#include "SlabPool.h"
+#include "SpscQueue.h"
+#include "TimerWheel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <random>
+#include <type_traits>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <enet/enet.h>
+
+namespace {
+
+// how long both players get to move from the lobby to their shard
+constexpr std::uint32_t kJoinDeadlineMs = 10000;
+constexpr std::uint32_t kRatingSaveIntervalMs = 30000;
+constexpr std::uint32_t kStatusIntervalMs = 10000;
+constexpr std::size_t kShardQueueCapacity = 4096;
+// how long a bot appears to think before it fires
+constexpr std::uint32_t kBotThinkMs = 700;
+// peers a shard holds for matches whose assignment has not arrived yet
+constexpr std::size_t kMaxUnboundPeers = 256;
+// how often a shard hands its changed matches to the checkpoint writer
+constexpr std::uint32_t kCheckpointIntervalMs = 250;
+// bump when MatchSession changes meaning without changing size
+constexpr std::uint32_t kCheckpointVersion = 1;
+
+std::atomic<bool> signalStop{false};
+
+void RequestStop(int) { signalStop.store(true, std::memory_order_relaxed); }
+
+ENetHost *CreateListenHost(std::uint16_t port, std::size_t peers) {
+  ENetAddress address{};
+  address.host = ENET_HOST_ANY;
+  address.port = port;
+  ENetHost *host = enet_host_create(
+      &address, peers, 1, static_cast<enet_uint32>(peers * kPeerBandwidth), 0);
+  if (host) {
+    host->maximumPacketSize = kMaxPacketSize;
+    host->maximumWaitingData = kMaxWaitingData;
+  }
+  return host;
+}
+
+void Refuse(ENetPeer *peer, DisconnectReason reason) {
+  enet_peer_disconnect(peer, static_cast<enet_uint32>(reason));
+}
+
+enum class Charge { Accepted, Dropped, Kicked };
+
+// Spends one message from the peer's budget. A peer that stays over budget
+// long enough is disconnected, once.
+Charge ChargeMessage(ENetPeer *peer, TokenBucket &budget,
+                     const RateLimitConfig &limits) {
+  if (budget.Take(limits, enet_time_get())) {
+    return Charge::Accepted;
+  }
+  if (budget.Exhausted(limits) && peer->state == ENET_PEER_STATE_CONNECTED) {
+    Refuse(peer, DisconnectReason::Flooding);
+    return Charge::Kicked;
+  }
+  return Charge::Dropped;
+}
+
+template <typename Message>
+void Send(ENetPeer *peer, const Message &msg) {
+  if (!peer || peer->state != ENET_PEER_STATE_CONNECTED) {
+    return;
+  }
+  ENetPacket *packet =
+      enet_packet_create(&msg, sizeof(msg), ENET_PACKET_FLAG_RELIABLE);
+  enet_peer_send(peer, kChannel, packet);
+}
+
+// lobby -> shard
+struct MatchAssignment {
+  std::uint32_t matchId = 0;
+  std::uint64_t players[2] = {0, 0};
+  int botSeat = -1; // the seat a server bot plays, if any
+};
+
+// shard -> lobby, which owns the ratings and the results store
+struct MatchReport {
+  MatchRecord record{};
+  std::vector<std::uint16_t> replay;
+};
+
+struct ShardStats {
+  std::atomic<std::uint32_t> liveMatches{0};
+  std::atomic<std::uint64_t> finishedMatches{0};
+  std::atomic<std::uint64_t> relayedMessages{0};
+  std::atomic<std::uint32_t> liveBots{0};
+  std::atomic<std::uint64_t> botMatches{0};
+  std::atomic<std::uint64_t> botMoves{0};
+  std::atomic<std::uint64_t> botNanos{0}; // spent picking bot shots
+  std::atomic<std::uint64_t> droppedMessages{0}; // over a peer's rate limit
+  std::atomic<std::uint64_t> kickedPeers{0};
+  std::atomic<std::uint64_t> refusedPeers{0};
+};
+
+// Every relayed player believes it is the "client" of a peer-to-peer game and
+// that its opponent is the "server", so turn values and board ids are
+// rewritten per seat.
+struct Seat {
+  ENetPeer *peer = nullptr;
+  std::uint64_t playerId = 0;
+  std::uint32_t botReadyMs = 0;
+  std::uint16_t lastSeq = 0;    // seq of this seat's latest accepted move
+  std::int8_t pendingShot = -1; // cell awaiting the defender's CellUpdate
+  std::uint8_t hits = 0;        // enemy ship cells this seat has sunk
+  std::uint8_t shotsFired = 0;
+  bool finishedPreparing = false;
+  bool bot = false; // played by the shard, never has a peer
+  CellMask fired;   // cells this seat has shot at
+  CellMask struck;  // the ones that hit
+  CellMask fleet;   // the bot's own ships
+};
+
+// each seat fires at every cell at most once
+constexpr int kSessionReplayShots = 2 * kCellCount;
+static_assert(kSessionReplayShots <= kMaxReplayShots,
+              "a session's replay must fit the result store");
+
+// Everything a shard knows about one match, in one fixed-size record with
+// no heap members. What every loop iteration reads comes first; the replay
+// is only appended to per shot and read when the match ends.
+struct alignas(64) MatchSession {
+  std::uint32_t matchId = 0;
+  std::uint32_t startedMs = 0;
+  TimerWheel::Handle timer = TimerWheel::kInvalidHandle;
+  Phase phase = Phase::Preparing;
+  std::uint16_t turnNumber = 0;
+  std::int8_t turnSeat = -1;
+  std::uint8_t joined = 0;
+  bool dirty = false;   // changed since the last checkpoint delta
+  bool resumed = false; // restored from a checkpoint, seats not all back
+  Seat seats[2];
+
+  std::uint16_t replayLength = 0;
+  std::uint16_t replay[kSessionReplayShots];
+
+  void Record(int seat, int cell, bool hit) {
+    if (replayLength < kSessionReplayShots) {
+      replay[replayLength++] = EncodeReplayShot(seat, cell, hit);
+    }
+  }
+};
+
+using SessionPool = SlabPool<MatchSession>;
+// checkpoints copy sessions as raw bytes; peer pointers and timer handles
+// are reset when one is restored
+static_assert(std::is_trivially_copyable_v<MatchSession>,
+              "sessions are checkpointed byte for byte");
+
+bool ValidFlag(const bool &flag) {
+  std::uint8_t raw;
+  std::memcpy(&raw, &flag, sizeof(raw));
+  return raw <= 1;
+}
+
+bool OnGrid(const CellMask &cells) {
+  return (cells.bits[1] >> (kCellCount - 64)) == 0;
+}
+
+// A checkpointed session is raw bytes from disk, so every field used as an
+// index, bool or enum is checked before the record is trusted. Bools and
+// the phase are read as the bytes they were stored as.
+bool ValidSession(const MatchSession &session, std::uint32_t matchId) {
+  std::underlying_type_t<Phase> phase;
+  std::memcpy(&phase, &session.phase, sizeof(phase));
+  if (session.matchId != matchId || phase < 0 ||
+      phase > static_cast<std::underlying_type_t<Phase>>(Phase::Finished) ||
+      session.turnSeat < -1 || session.turnSeat > 1 ||
+      session.replayLength > kSessionReplayShots ||
+      !ValidFlag(session.dirty) || !ValidFlag(session.resumed)) {
+    return false;
+  }
+  for (const Seat &seat : session.seats) {
+    if (seat.pendingShot < -1 || seat.pendingShot >= kCellCount ||
+        seat.hits > kFleetCellCount || !ValidFlag(seat.finishedPreparing) ||
+        !ValidFlag(seat.bot) || !OnGrid(seat.fired) || !OnGrid(seat.struck) ||
+        !OnGrid(seat.fleet)) {
+      return false;
+    }
+  }
+  for (std::uint16_t i = 0; i < session.replayLength; ++i) {
+    if (ReplayShotCell(session.replay[i]) >= kCellCount) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The seat's shots as a targeting board, the form BotBrain and
+// PickAutoShot() read.
+Grid ShotBoard(const Seat &seat) {
+  Grid board{};
+  seat.fired.ForEach([&board, &seat](int cell) {
+    board[cell] = seat.struck.Test(cell) ? CellState::Hit : CellState::Miss;
+  });
+  return board;
+}
+
+enum SessionTimer : std::uint32_t {
+  kJoinDeadline = 0,
+  kPrepareDeadline,
+  kPrepareGrace,
+  kBattleStart,
+  kTurnDeadline,
+  kSessionTimerCount
+};
+
+// A worker thread with its own ENet host, match set and deadline wheel.
+// Nothing in here is shared with other shards or the lobby except the two
+// queues and the stats counters.
+class MatchShard {
+public:
+  MatchShard(const MatchServerConfig &config, unsigned index,
+             const std::atomic<bool> &stop)
+      : config_(config),
+        port_(static_cast<std::uint16_t>(config.port + 1 + index)),
+        stop_(stop), assignments_(kShardQueueCapacity),
+        reports_(kShardQueueCapacity), rng_(std::random_device{}()),
+        brain_(rng_()) {}
+
+  ~MatchShard() {
+    Join();
+    if (host_) {
+      enet_host_destroy(host_);
+    }
+  }
+
+  MatchShard(const MatchShard &) = delete;
+  MatchShard &operator=(const MatchShard &) = delete;
+
+  bool Open();
+  void Start() { thread_ = std::thread(&MatchShard::Run, this); }
+  void Join() {
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  std::uint16_t Port() const { return port_; }
+  SpscQueue<MatchAssignment> &Assignments() { return assignments_; }
+  SpscQueue<MatchReport> &Reports() { return reports_; }
+  // Moves backlogged reports onto Reports(); true once none are left. The
+  // lobby calls it after Join() so no finished match is lost on a stop.
+  bool FlushReports();
+  // Before Start(); the shard thread owns its bots from then on.
+  void UseBook(const OpeningBook &book) { brain_.UseBook(book); }
+  // Before Start(): changed matches go to queue from then on.
+  void UseCheckpoints(SpscQueue<CheckpointDelta> &queue) {
+    checkpoints_ = &queue;
+  }
+  // Before Start(): takes over a match a previous process checkpointed. It
+  // waits for both players to reconnect, then carries on. A damaged record
+  // is dropped and false returned.
+  bool Restore(std::uint32_t matchId, const std::uint8_t *record);
+  const ShardStats &Stats() const { return stats_; }
+
+private:
+  struct PeerSlot {
+    std::uint32_t matchId = 0; // the connect data
+    std::uint64_t playerId = 0;
+    std::int32_t session = -1;
+    int seat = 0;
+    TokenBucket budget;
+  };
+
+  std::size_t PeerIndex(const ENetPeer *peer) const {
+    return static_cast<std::size_t>(peer - host_->peers);
+  }
+
+  void Run();
+  bool Admit(ENetPeer *peer);
+  void DrainAssignments();
+
+  void OnDisconnect(ENetPeer *peer);
+  void OnReceive(ENetPeer *peer, const ENetPacket *packet);
+  bool Bind(ENetPeer *peer);
+
+  void Resume(std::int32_t sessionIndex);
+  void StartTransitionIfReady(std::int32_t sessionIndex);
+
+  void Relay(std::int32_t sessionIndex, int seat, const ENetPacket *packet);
+  // Records the defender's answer to the attacker's pending shot.
+  void Resolve(std::int32_t sessionIndex, int defenderSeat,
+               const CellUpdateMessage &update);
+  void UpdateBots(std::uint32_t nowMs);
+  void AnswerAsBot(std::int32_t sessionIndex, int botSeat,
+                   const CellRequestMessage &shot);
+  // winnerSeat < 0 ends the match without a result
+  void FinishMatch(std::int32_t sessionIndex, int winnerSeat,
+                   FinishReason reason);
+  void OnTimer(std::uint32_t token);
+
+  void Arm(std::int32_t sessionIndex, SessionTimer kind, std::uint32_t delayMs);
+  void SendTurn(MatchSession &session, int timedOutSeat);
+
+  void MarkDirty(std::int32_t sessionIndex);
+  void SaveCheckpoint();
+  void ShutDown();
+
+  MatchServerConfig config_;
+  std::uint16_t port_;
+  const std::atomic<bool> &stop_;
+  ENetHost *host_ = nullptr;
+  std::thread thread_;
+
+  SpscQueue<MatchAssignment> assignments_;
+  SpscQueue<MatchReport> reports_;
+  std::deque<MatchReport> reportBacklog_; // reports_ was full
+  ShardStats stats_;
+
+  SpscQueue<CheckpointDelta> *checkpoints_ = nullptr;
+  std::deque<CheckpointDelta> checkpointBacklog_;
+  std::vector<std::int32_t> dirtySessions_;
+  std::vector<std::uint32_t> finishedMatchIds_;
+  std::uint32_t lastCheckpointMs_ = 0;
+  // match ids only grow, so a peer naming one at or below this whose
+  // session is gone is too late
+  std::uint32_t lastMatchId_ = 0;
+
+  TimerWheel sessionWheel_;
+  std::vector<PeerSlot> peerSlots_;
+  SessionPool sessions_;
+  std::unordered_map<std::uint32_t, std::int32_t> sessionsByMatch_;
+  // peers that arrived before their match's assignment did
+  std::vector<ENetPeer *> unboundPeers_;
+  std::mt19937 rng_;
+
+  BotBrain brain_;
+  std::vector<BotBrain::Move> botMoves_;
+};
+
+bool MatchShard::Open() {
+  host_ = CreateListenHost(port_, config_.maxPeers);
+  if (!host_) {
+    Log(LogLevel::Error, "Failed to create ENet shard host on port %u",
+        port_);
+    return false;
+  }
+  peerSlots_.resize(host_->peerCount);
+  return true;
+}
+
+void MatchShard::Run() {
+  sessionWheel_.Start(enet_time_get());
+  lastCheckpointMs_ = enet_time_get();
+  sessions_.ForEach([this](std::int32_t sessionIndex, MatchSession &session) {
+    if (session.resumed) {
+      Arm(sessionIndex, kJoinDeadline, kResumeWindowMs);
+    }
+  });
+
+  while (!stop_.load(std::memory_order_relaxed)) {
+    DrainAssignments();
+
+    ENetEvent event;
+    enet_uint32 wait = 1;
+    while (enet_host_service(host_, &event, wait) > 0) {
+      wait = 0;
+      switch (event.type) {
+      case ENET_EVENT_TYPE_CONNECT: {
+        PeerSlot &slot = peerSlots_[PeerIndex(event.peer)];
+        slot = PeerSlot{};
+        slot.matchId = event.data;
+        slot.budget.Reset(config_.limits, enet_time_get());
+        break;
+      }
+      case ENET_EVENT_TYPE_DISCONNECT:
+        OnDisconnect(event.peer);
+        break;
+      case ENET_EVENT_TYPE_RECEIVE:
+        if (Admit(event.peer)) {
+          OnReceive(event.peer, event.packet);
+        }
+        enet_packet_destroy(event.packet);
+        break;
+      case ENET_EVENT_TYPE_NONE:
+      default:
+        break;
+      }
+    }
+
+    sessionWheel_.Advance(enet_time_get(),
+                          [this](std::uint32_t token) { OnTimer(token); });
+    UpdateBots(enet_time_get());
+    FlushReports();
+    if (enet_time_get() - lastCheckpointMs_ >= kCheckpointIntervalMs) {
+      SaveCheckpoint();
+      lastCheckpointMs_ = enet_time_get();
+    }
+    enet_host_flush(host_);
+  }
+  ShutDown();
+}
+
+// With checkpoints the live matches outlast this process, so their players
+// are told to come back rather than that their match is over.
+void MatchShard::ShutDown() {
+  if (!checkpoints_) {
+    return;
+  }
+  sessions_.ForEach([](std::int32_t, MatchSession &session) {
+    for (Seat &seat : session.seats) {
+      if (seat.peer) {
+        Refuse(seat.peer, DisconnectReason::Restarting);
+      }
+    }
+  });
+  enet_host_flush(host_);
+
+  // the writer outlives the shards, so this drains
+  SaveCheckpoint();
+  while (!checkpointBacklog_.empty()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    SaveCheckpoint();
+  }
+}
+
+bool MatchShard::Admit(ENetPeer *peer) {
+  switch (ChargeMessage(peer, peerSlots_[PeerIndex(peer)].budget,
+                        config_.limits)) {
+  case Charge::Accepted:
+    return true;
+  case Charge::Kicked:
+    stats_.kickedPeers.fetch_add(1, std::memory_order_relaxed);
+    [[fallthrough]];
+  case Charge::Dropped:
+  default:
+    stats_.droppedMessages.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+}
+
+void MatchShard::DrainAssignments() {
+  MatchAssignment assignment;
+  bool created = false;
+  while (assignments_.TryPop(assignment)) {
+    std::int32_t sessionIndex = sessions_.Create();
+    MatchSession &session = sessions_[sessionIndex];
+    session.matchId = assignment.matchId;
+    session.startedMs = enet_time_get();
+    for (int seat = 0; seat < 2; ++seat) {
+      session.seats[seat].playerId = assignment.players[seat];
+    }
+    if (assignment.botSeat >= 0) {
+      // the bot is seated and ready before its opponent even connects
+      Seat &bot = session.seats[assignment.botSeat];
+      bot.bot = true;
+      bot.finishedPreparing = true;
+      Grid fleet{};
+      std::vector<Ship> ships = CreateFleet();
+      std::vector<std::uint8_t> locations;
+      int shipIndex = 0;
+      AutoPlaceFleet(fleet, ships, shipIndex, locations, rng_);
+      bot.fleet = FleetMask(locations);
+      ++session.joined;
+      stats_.liveBots.fetch_add(1, std::memory_order_relaxed);
+      stats_.botMatches.fetch_add(1, std::memory_order_relaxed);
+    }
+    sessionsByMatch_[assignment.matchId] = sessionIndex;
+    lastMatchId_ = std::max(lastMatchId_, assignment.matchId);
+    Arm(sessionIndex, kJoinDeadline, kJoinDeadlineMs);
+    MarkDirty(sessionIndex);
+    stats_.liveMatches.fetch_add(1, std::memory_order_relaxed);
+    created = true;
+  }
+
+  if (created && !unboundPeers_.empty()) {
+    unboundPeers_.erase(std::remove_if(unboundPeers_.begin(),
+                                       unboundPeers_.end(),
+                                       [this](ENetPeer *peer) {
+                                         return Bind(peer);
+                                       }),
+                        unboundPeers_.end());
+  }
+}
+
+bool MatchShard::FlushReports() {
+  while (!reportBacklog_.empty() &&
+         reports_.TryPush(std::move(reportBacklog_.front()))) {
+    reportBacklog_.pop_front();
+  }
+  return reportBacklog_.empty();
+}
+
+bool MatchShard::Restore(std::uint32_t matchId, const std::uint8_t *record) {
+  MatchSession restored;
+  std::memcpy(&restored, record, sizeof(restored));
+  if (!ValidSession(restored, matchId)) {
+    LogMatch(LogLevel::Warn, matchId, "Dropping a damaged checkpoint record");
+    return false;
+  }
+  std::int32_t sessionIndex = sessions_.Create();
+  MatchSession &session = sessions_[sessionIndex];
+  session = restored;
+  session.timer = TimerWheel::kInvalidHandle;
+  session.dirty = false;
+  session.resumed = true;
+  session.joined = 0;
+  bool withBot = false;
+  for (Seat &seat : session.seats) {
+    seat.peer = nullptr;
+    if (seat.bot) {
+      ++session.joined;
+      withBot = true;
+    }
+  }
+  sessionsByMatch_[session.matchId] = sessionIndex;
+  lastMatchId_ = std::max(lastMatchId_, session.matchId);
+  stats_.liveMatches.fetch_add(1, std::memory_order_relaxed);
+  if (withBot) {
+    stats_.liveBots.fetch_add(1, std::memory_order_relaxed);
+  }
+  return true;
+}
+
+void MatchShard::StartTransitionIfReady(std::int32_t sessionIndex) {
+  MatchSession &session = sessions_[sessionIndex];
+  if (session.phase == Phase::Preparing &&
+      session.seats[0].finishedPreparing &&
+      session.seats[1].finishedPreparing) {
+    session.phase = Phase::Transition;
+    Arm(sessionIndex, kBattleStart, kTransitionMs);
+  }
+}
+
+void MatchShard::OnDisconnect(ENetPeer *peer) {
+  PeerSlot &slot = peerSlots_[PeerIndex(peer)];
+  unboundPeers_.erase(
+      std::remove(unboundPeers_.begin(), unboundPeers_.end(), peer),
+      unboundPeers_.end());
+  if (slot.session >= 0) {
+    std::int32_t sessionIndex = slot.session;
+    MatchSession &session = sessions_[sessionIndex];
+    session.seats[slot.seat].peer = nullptr;
+    // leaving mid-match forfeits it
+    FinishMatch(sessionIndex, 1 - slot.seat, FinishReason::Forfeit);
+  }
+  slot = PeerSlot{};
+}
+
+void MatchShard::OnReceive(ENetPeer *peer, const ENetPacket *packet) {
+  if (packet->dataLength < 1) {
+    return;
+  }
+  stats_.relayedMessages.fetch_add(1, std::memory_order_relaxed);
+
+  PeerSlot &slot = peerSlots_[PeerIndex(peer)];
+  if (static_cast<MessageType>(packet->data[0]) == MessageType::LobbyJoin) {
+    if (packet->dataLength != sizeof(LobbyJoinMessage) ||
+        slot.playerId != 0) {
+      return;
+    }
+    slot.playerId =
+        reinterpret_cast<const LobbyJoinMessage *>(packet->data)->playerId;
+    if (Bind(peer)) {
+      return;
+    }
+    if (unboundPeers_.size() >= kMaxUnboundPeers) {
+      Refuse(peer, DisconnectReason::Busy);
+      stats_.refusedPeers.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    unboundPeers_.push_back(peer);
+    return;
+  }
+
+  if (slot.session >= 0) {
+    Relay(slot.session, slot.seat, packet);
+  }
+}
+
+// Seats a peer in the match its connect data names. Returns false while that
+// match's assignment is still on its way from the lobby.
+bool MatchShard::Bind(ENetPeer *peer) {
+  PeerSlot &slot = peerSlots_[PeerIndex(peer)];
+  auto found = sessionsByMatch_.find(slot.matchId);
+  if (found == sessionsByMatch_.end()) {
+    if (slot.matchId <= lastMatchId_) {
+      Refuse(peer, DisconnectReason::MatchOver);
+      return true;
+    }
+    return false;
+  }
+
+  std::int32_t sessionIndex = found->second;
+  MatchSession &session = sessions_[sessionIndex];
+  int seat = -1;
+  for (int i = 0; i < 2; ++i) {
+    if (session.seats[i].playerId == slot.playerId &&
+        !session.seats[i].peer && !session.seats[i].bot) {
+      seat = i;
+      break;
+    }
+  }
+  if (seat < 0) {
+    enet_peer_disconnect_later(peer, 0);
+    return true;
+  }
+
+  slot.session = sessionIndex;
+  slot.seat = seat;
+  session.seats[seat].peer = peer;
+  MarkDirty(sessionIndex);
+  if (++session.joined < 2) {
+    return true;
+  }
+  if (session.resumed) {
+    Resume(sessionIndex);
+    return true;
+  }
+
+  // both players are here, so preparation starts now
+  session.startedMs = enet_time_get();
+  if (config_.deadlines.prepareMs > 0) {
+    PrepareDeadlineMessage deadline{
+        static_cast<std::uint8_t>(MessageType::PrepareDeadline),
+        config_.deadlines.prepareMs, 0};
+    Send(session.seats[0].peer, deadline);
+    Send(session.seats[1].peer, deadline);
+    Arm(sessionIndex, kPrepareDeadline, config_.deadlines.prepareMs);
+  } else {
+    sessionWheel_.Cancel(session.timer);
+    session.timer = TimerWheel::kInvalidHandle;
+  }
+  // a bot is ready from the start, and a player may have finished placing
+  // before its opponent got here
+  FinishedPreparingMessage ready{
+      static_cast<std::uint8_t>(MessageType::FinishedPreparing), 1};
+  for (int i = 0; i < 2; ++i) {
+    if (session.seats[i].finishedPreparing) {
+      Send(session.seats[1 - i].peer, ready);
+    }
+  }
+  StartTransitionIfReady(sessionIndex);
+  return true;
+}
+
+// Both seats are back after a restart. The clients kept their own state,
+// so they only need what the shard owed them when it went down, with fresh
+// deadlines for the phase the checkpoint caught.
+void MatchShard::Resume(std::int32_t sessionIndex) {
+  MatchSession &session = sessions_[sessionIndex];
+  session.resumed = false;
+  LogMatch(LogLevel::Info, session.matchId, "Resumed in phase %d",
+           static_cast<int>(session.phase));
+
+  switch (session.phase) {
+  case Phase::Preparing:
+    for (int seat = 0; seat < 2; ++seat) {
+      if (session.seats[seat].finishedPreparing) {
+        FinishedPreparingMessage ready{
+            static_cast<std::uint8_t>(MessageType::FinishedPreparing), 1};
+        Send(session.seats[1 - seat].peer, ready);
+      }
+    }
+    if (config_.deadlines.prepareMs > 0) {
+      PrepareDeadlineMessage deadline{
+          static_cast<std::uint8_t>(MessageType::PrepareDeadline),
+          config_.deadlines.prepareMs, 0};
+      Send(session.seats[0].peer, deadline);
+      Send(session.seats[1].peer, deadline);
+      Arm(sessionIndex, kPrepareDeadline, config_.deadlines.prepareMs);
+    } else {
+      sessionWheel_.Cancel(session.timer);
+      session.timer = TimerWheel::kInvalidHandle;
+    }
+    StartTransitionIfReady(sessionIndex);
+    break;
+
+  case Phase::Transition:
+    Arm(sessionIndex, kBattleStart, kTransitionMs);
+    break;
+
+  case Phase::Battle: {
+    Seat &attacker = session.seats[session.turnSeat];
+    Seat &defender = session.seats[1 - session.turnSeat];
+    if (config_.deadlines.turnMs > 0) {
+      Arm(sessionIndex, kTurnDeadline, config_.deadlines.turnMs);
+    } else {
+      sessionWheel_.Cancel(session.timer);
+      session.timer = TimerWheel::kInvalidHandle;
+    }
+    SendTurn(session, -1);
+    attacker.botReadyMs = enet_time_get() + kBotThinkMs;
+    if (attacker.pendingShot < 0) {
+      break;
+    }
+    // the defender may never have seen the shot; a client that did
+    // answers a repeat from its last answer
+    CellRequestMessage shot{
+        static_cast<std::uint8_t>(MessageType::CellRequest),
+        static_cast<std::uint16_t>(attacker.pendingShot % kGridCols),
+        static_cast<std::uint16_t>(attacker.pendingShot / kGridCols),
+        attacker.lastSeq, 0};
+    // last, since a bot's answer can end the match
+    if (defender.bot) {
+      AnswerAsBot(sessionIndex, 1 - session.turnSeat, shot);
+    } else {
+      Send(defender.peer, shot);
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
+void MatchShard::Relay(std::int32_t sessionIndex, int seat,
+                       const ENetPacket *packet) {
+  MatchSession &session = sessions_[sessionIndex];
+  Seat &self = session.seats[seat];
+  Seat &opponent = session.seats[1 - seat];
+  auto type = static_cast<MessageType>(packet->data[0]);
+  // early readiness is kept, and Bind() passes it on once both are in
+  if (session.joined < 2 && type != MessageType::FinishedPreparing) {
+    return;
+  }
+
+  switch (type) {
+  case MessageType::FinishedPreparing: {
+    if (packet->dataLength != sizeof(FinishedPreparingMessage) ||
+        session.phase != Phase::Preparing || self.finishedPreparing) {
+      break;
+    }
+    const auto *msg =
+        reinterpret_cast<const FinishedPreparingMessage *>(packet->data);
+    if (msg->finished != 1) {
+      break;
+    }
+    self.finishedPreparing = true;
+    MarkDirty(sessionIndex);
+    if (session.joined < 2) {
+      break;
+    }
+    Send(opponent.peer, *msg);
+    StartTransitionIfReady(sessionIndex);
+    break;
+  }
+
+  case MessageType::CellRequest: {
+    if (packet->dataLength != sizeof(CellRequestMessage) ||
+        session.phase != Phase::Battle || session.turnSeat != seat ||
+        self.pendingShot >= 0) {
+      break;
+    }
+    const auto *msg =
+        reinterpret_cast<const CellRequestMessage *>(packet->data);
+    if (msg->x >= kGridCols || msg->y >= kGridRows ||
+        !SeqNewer(msg->seq, self.lastSeq)) {
+      break;
+    }
+    int index = CellIndex(msg->x, msg->y);
+    if (self.fired.Test(index)) {
+      break;
+    }
+    self.pendingShot = static_cast<std::int8_t>(index);
+    self.lastSeq = msg->seq;
+    MarkDirty(sessionIndex);
+    if (opponent.bot) {
+      AnswerAsBot(sessionIndex, 1 - seat, *msg);
+    } else {
+      Send(opponent.peer, *msg);
+    }
+    break;
+  }
+
+  case MessageType::CellUpdate: {
+    // the defender reports the result of the attacker's pending shot
+    if (packet->dataLength != sizeof(CellUpdateMessage) ||
+        session.phase != Phase::Battle) {
+      break;
+    }
+    const auto *msg = reinterpret_cast<const CellUpdateMessage *>(packet->data);
+    if (msg->x >= kGridCols || msg->y >= kGridRows ||
+        msg->board != kBoardClient || msg->seq != opponent.lastSeq ||
+        opponent.pendingShot != CellIndex(msg->x, msg->y)) {
+      break;
+    }
+    Resolve(sessionIndex, seat, *msg);
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
+void MatchShard::Resolve(std::int32_t sessionIndex, int defenderSeat,
+                         const CellUpdateMessage &update) {
+  MatchSession &session = sessions_[sessionIndex];
+  Seat &attacker = session.seats[1 - defenderSeat];
+  bool isHit = update.filled == CellState::Hit;
+  MarkDirty(sessionIndex);
+  attacker.fired.Set(attacker.pendingShot);
+  if (isHit) {
+    attacker.struck.Set(attacker.pendingShot);
+  }
+  ++attacker.shotsFired;
+  session.Record(1 - defenderSeat, attacker.pendingShot, isHit);
+  LogMatch(LogLevel::Debug, session.matchId, "Seat %d fired at %u,%u: %s",
+           1 - defenderSeat, update.x, update.y, isHit ? "hit" : "miss");
+  attacker.pendingShot = -1;
+  CellUpdateMessage result = update;
+  result.board = kBoardServer;
+  Send(attacker.peer, result);
+
+  if (isHit) {
+    ++attacker.hits;
+    if (attacker.hits >= kFleetCellCount) {
+      FinishMatch(sessionIndex, 1 - defenderSeat, FinishReason::Sunk);
+      return;
+    }
+  } else {
+    // a miss hands the turn to the defender
+    session.turnSeat = defenderSeat;
+    SendTurn(session, -1);
+  }
+  // a hit keeps the turn, so the clock restarts either way
+  if (config_.deadlines.turnMs > 0) {
+    Arm(sessionIndex, kTurnDeadline, config_.deadlines.turnMs);
+  }
+  Seat &next = session.seats[session.turnSeat];
+  if (next.bot) {
+    next.botReadyMs = enet_time_get() + kBotThinkMs;
+  }
+}
+
+// Bots answer on the spot from their own fleet, exactly as a peer's client
+// would, so the result flows through Resolve() like any other.
+void MatchShard::AnswerAsBot(std::int32_t sessionIndex, int botSeat,
+                             const CellRequestMessage &shot) {
+  const Seat &bot = sessions_[sessionIndex].seats[botSeat];
+  bool isHit = bot.fleet.Test(CellIndex(shot.x, shot.y));
+  CellUpdateMessage update{static_cast<std::uint8_t>(MessageType::CellUpdate),
+                           shot.x,
+                           shot.y,
+                           isHit ? CellState::Hit : CellState::Miss,
+                           shot.seq,
+                           kBoardClient,
+                           shot.trace};
+  Resolve(sessionIndex, botSeat, update);
+}
+
+// Every bot whose turn it is goes into one batch, scored together once per
+// loop iteration however many matches they are spread over. Finding them is
+// one pass over the pool.
+void MatchShard::UpdateBots(std::uint32_t nowMs) {
+  if (stats_.liveBots.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  sessions_.ForEach([this, nowMs](std::int32_t sessionIndex,
+                                  const MatchSession &session) {
+    // a restored match waits for its human to come back
+    if (session.phase != Phase::Battle || session.joined < 2) {
+      return;
+    }
+    const Seat &attacker = session.seats[session.turnSeat];
+    if (attacker.bot && attacker.pendingShot < 0 &&
+        static_cast<std::int32_t>(nowMs - attacker.botReadyMs) >= 0) {
+      brain_.Queue(static_cast<std::uint32_t>(sessionIndex),
+                   ShotBoard(attacker));
+    }
+  });
+  if (brain_.Queued() == 0) {
+    return;
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  brain_.Evaluate(botMoves_);
+  auto spent = std::chrono::steady_clock::now() - started;
+  stats_.botNanos.fetch_add(
+      static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(spent)
+              .count()),
+      std::memory_order_relaxed);
+  stats_.botMoves.fetch_add(botMoves_.size(), std::memory_order_relaxed);
+
+  for (const BotBrain::Move &move : botMoves_) {
+    std::int32_t sessionIndex = static_cast<std::int32_t>(move.token);
+    // an earlier move in this batch may have ended the match
+    if (!sessions_.IsLive(sessionIndex) || move.cell < 0) {
+      continue;
+    }
+    MatchSession &session = sessions_[sessionIndex];
+    Seat &attacker = session.seats[session.turnSeat];
+    attacker.pendingShot = static_cast<std::int8_t>(move.cell);
+    ++attacker.lastSeq;
+    MarkDirty(sessionIndex);
+    CellRequestMessage shot{
+        static_cast<std::uint8_t>(MessageType::CellRequest),
+        static_cast<std::uint16_t>(move.cell % kGridCols),
+        static_cast<std::uint16_t>(move.cell / kGridCols), attacker.lastSeq,
+        0};
+    Send(session.seats[1 - session.turnSeat].peer, shot);
+  }
+}
+
+void MatchShard::SendTurn(MatchSession &session, int timedOutSeat) {
+  ++session.turnNumber;
+  for (int seat = 0; seat < 2; ++seat) {
+    TurnUpdateMessage turn{
+        static_cast<std::uint8_t>(MessageType::TurnUpdate),
+        static_cast<std::uint8_t>(seat == session.turnSeat ? 1 : 0),
+        config_.deadlines.turnMs,
+        static_cast<std::uint8_t>(seat == timedOutSeat ? kTurnFlagTimedOut
+                                                       : 0),
+        session.turnNumber};
+    Send(session.seats[seat].peer, turn);
+  }
+}
+
+void MatchShard::FinishMatch(std::int32_t sessionIndex, int winnerSeat,
+                             FinishReason reason) {
+  if (!sessions_.IsLive(sessionIndex)) {
+    return;
+  }
+  MatchSession &session = sessions_[sessionIndex];
+
+  MatchReport report;
+  MatchRecord &record = report.record;
+  record.matchId = session.matchId;
+  record.outcome = winnerSeat < 0    ? MatchOutcome::NoResult
+                   : winnerSeat == 0 ? MatchOutcome::FirstWon
+                                     : MatchOutcome::SecondWon;
+  record.reason = reason;
+  for (int seat = 0; seat < 2; ++seat) {
+    record.shots[seat] =
+        static_cast<std::uint16_t>(session.seats[seat].shotsFired);
+    record.players[seat] = session.seats[seat].playerId;
+  }
+  record.durationMs = enet_time_get() - session.startedMs;
+  record.finishedAt = static_cast<std::uint64_t>(std::time(nullptr));
+  LogMatch(LogLevel::Info, session.matchId,
+           "Finished after %u ms, outcome %u, reason %u, shots %u/%u",
+           record.durationMs, record.outcome, record.reason, record.shots[0],
+           record.shots[1]);
+  report.replay.assign(session.replay,
+                       session.replay + session.replayLength);
+  reportBacklog_.push_back(std::move(report));
+
+  for (Seat &seat : session.seats) {
+    if (!seat.peer) {
+      continue;
+    }
+    peerSlots_[PeerIndex(seat.peer)].session = -1;
+    // nothing left to relay to, so send the survivor home
+    if (reason != FinishReason::Sunk) {
+      enet_peer_disconnect_later(
+          seat.peer, static_cast<enet_uint32>(DisconnectReason::MatchOver));
+    }
+  }
+
+  if (session.seats[0].bot || session.seats[1].bot) {
+    stats_.liveBots.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  if (checkpoints_) {
+    finishedMatchIds_.push_back(session.matchId);
+  }
+  sessionWheel_.Cancel(session.timer);
+  sessionsByMatch_.erase(session.matchId);
+  sessions_.Recycle(sessionIndex);
+  stats_.liveMatches.fetch_sub(1, std::memory_order_relaxed);
+  stats_.finishedMatches.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MatchShard::Arm(std::int32_t sessionIndex, SessionTimer kind,
+                     std::uint32_t delayMs) {
+  MatchSession &session = sessions_[sessionIndex];
+  sessionWheel_.Cancel(session.timer);
+  session.timer = sessionWheel_.Schedule(
+      delayMs,
+      static_cast<std::uint32_t>(sessionIndex) * kSessionTimerCount + kind);
+}
+
+void MatchShard::MarkDirty(std::int32_t sessionIndex) {
+  MatchSession &session = sessions_[sessionIndex];
+  if (!checkpoints_ || session.dirty) {
+    return;
+  }
+  session.dirty = true;
+  dirtySessions_.push_back(sessionIndex);
+}
+
+// Copies the sessions changed since the last delta for the checkpoint
+// writer; the disk is its business.
+void MatchShard::SaveCheckpoint() {
+  if (!checkpoints_) {
+    return;
+  }
+  if (!dirtySessions_.empty() || !finishedMatchIds_.empty()) {
+    CheckpointDelta delta;
+    for (std::int32_t sessionIndex : dirtySessions_) {
+      // finished since, or listed twice after its record was reused
+      if (!sessions_.IsLive(sessionIndex) || !sessions_[sessionIndex].dirty) {
+        continue;
+      }
+      MatchSession &session = sessions_[sessionIndex];
+      session.dirty = false;
+      const auto *bytes = reinterpret_cast<const std::uint8_t *>(&session);
+      delta.keys.push_back(session.matchId);
+      delta.records.insert(delta.records.end(), bytes,
+                           bytes + sizeof(session));
+    }
+    dirtySessions_.clear();
+    delta.removed.swap(finishedMatchIds_);
+    checkpointBacklog_.push_back(std::move(delta));
+  }
+  while (!checkpointBacklog_.empty() &&
+         checkpoints_->TryPush(std::move(checkpointBacklog_.front()))) {
+    checkpointBacklog_.pop_front();
+  }
+}
+
+void MatchShard::OnTimer(std::uint32_t token) {
+  std::int32_t sessionIndex =
+      static_cast<std::int32_t>(token / kSessionTimerCount);
+  auto kind = static_cast<SessionTimer>(token % kSessionTimerCount);
+  if (!sessions_.IsLive(sessionIndex)) {
+    return;
+  }
+  MatchSession &session = sessions_[sessionIndex];
+  session.timer = TimerWheel::kInvalidHandle;
+  MarkDirty(sessionIndex);
+
+  switch (kind) {
+  case kJoinDeadline:
+    if (session.joined < 2) {
+      // after a restart a player who came back wins a match against
+      // another player who did not
+      int winner = -1;
+      if (session.resumed && !session.seats[0].bot &&
+          !session.seats[1].bot && session.joined == 1) {
+        winner = session.seats[0].peer ? 0 : 1;
+      }
+      FinishMatch(sessionIndex, winner, FinishReason::Forfeit);
+    }
+    break;
+
+  case kPrepareDeadline:
+    if (session.phase != Phase::Preparing) {
+      break;
+    }
+    for (Seat &seat : session.seats) {
+      if (!seat.finishedPreparing) {
+        PrepareDeadlineMessage expired{
+            static_cast<std::uint8_t>(MessageType::PrepareDeadline), 0, 1};
+        Send(seat.peer, expired);
+      }
+    }
+    Arm(sessionIndex, kPrepareGrace, kDeadlineGraceMs);
+    break;
+
+  case kPrepareGrace: {
+    if (session.phase != Phase::Preparing) {
+      break;
+    }
+    bool firstReady = session.seats[0].finishedPreparing;
+    bool secondReady = session.seats[1].finishedPreparing;
+    int winner = (firstReady == secondReady) ? -1 : (firstReady ? 0 : 1);
+    FinishMatch(sessionIndex, winner, FinishReason::Timeout);
+    break;
+  }
+
+  case kBattleStart:
+    session.phase = Phase::Battle;
+    session.turnSeat = static_cast<std::int8_t>(
+        std::uniform_int_distribution<int>(0, 1)(rng_));
+    session.seats[session.turnSeat].botReadyMs =
+        enet_time_get() + kBotThinkMs;
+    if (config_.deadlines.turnMs > 0) {
+      Arm(sessionIndex, kTurnDeadline, config_.deadlines.turnMs);
+    }
+    SendTurn(session, -1);
+    break;
+
+  case kTurnDeadline: {
+    if (session.phase != Phase::Battle) {
+      break;
+    }
+    Seat &attacker = session.seats[session.turnSeat];
+    Seat &defender = session.seats[1 - session.turnSeat];
+    Arm(sessionIndex, kTurnDeadline, config_.deadlines.turnMs);
+
+    // a shot already in flight means the defender is the slow one
+    if (attacker.pendingShot >= 0) {
+      break;
+    }
+    int index = PickAutoShot(ShotBoard(attacker), rng_);
+    if (index < 0) {
+      break;
+    }
+    // the attacker's next seq, so its own late click reads as stale
+    attacker.pendingShot = static_cast<std::int8_t>(index);
+    ++attacker.lastSeq;
+    CellRequestMessage shot{
+        static_cast<std::uint8_t>(MessageType::CellRequest),
+        static_cast<std::uint16_t>(index % kGridCols),
+        static_cast<std::uint16_t>(index / kGridCols), attacker.lastSeq, 0};
+    TurnUpdateMessage turn{static_cast<std::uint8_t>(MessageType::TurnUpdate),
+                           1, config_.deadlines.turnMs, kTurnFlagTimedOut,
+                           ++session.turnNumber};
+    Send(attacker.peer, turn);
+
+    // last, since a bot's answer can end the match
+    if (defender.bot) {
+      AnswerAsBot(sessionIndex, 1 - session.turnSeat, shot);
+    } else {
+      Send(defender.peer, shot);
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
+LobbyConfig LobbyFor(const MatchServerConfig &config) {
+  LobbyConfig lobby;
+  lobby.botAfterMs = config.botAfterMs;
+  return lobby;
+}
+
+// The lobby side: queues players, pairs them and hands each pair to the shard
+// owning its match id. Ratings and the results store are only touched here.
+class MatchServer {
+public:
+  MatchServer(const MatchServerConfig &config, ENetHost *host,
+              const std::atomic<bool> &stop)
+      : config_(config), host_(host), stop_(stop),
+        ratings_(config.ratingsPath), results_(config.resultsPath),
+        lobby_(LobbyFor(config)), peerSlots_(host->peerCount) {}
+
+  int Run();
+
+private:
+  struct PeerSlot {
+    std::uint64_t playerId = 0;
+    Lobby::Ticket ticket = Lobby::kInvalidTicket;
+    TokenBucket budget;
+  };
+
+  std::size_t PeerIndex(const ENetPeer *peer) const {
+    return static_cast<std::size_t>(peer - host_->peers);
+  }
+
+  bool OpenCheckpoint();
+  void OnReceive(ENetPeer *peer, const ENetPacket *packet);
+  bool HasRoom() const;
+  void StartMatch(std::uint32_t firstPeer, std::uint32_t secondPeer);
+  void FlushAssignments();
+  void CollectReports();
+  void PrintStatus() const;
+
+  MatchServerConfig config_;
+  ENetHost *host_;
+  const std::atomic<bool> &stop_;
+  RatingStore ratings_;
+  ResultWriter results_;
+  Lobby lobby_;
+  std::vector<PeerSlot> peerSlots_;
+  std::vector<Lobby::Pairing> pairings_;
+  std::vector<std::unique_ptr<MatchShard>> shards_;
+  std::unique_ptr<CheckpointLog> checkpoint_;
+  // per shard, assignments its queue had no room for yet
+  std::vector<std::deque<MatchAssignment>> assignmentBacklog_;
+  std::uint32_t nextMatchId_ = 1;
+
+  std::uint64_t refusedJoins_ = 0;
+  std::uint64_t droppedMessages_ = 0;
+  std::uint64_t kickedPeers_ = 0;
+};
+
+int MatchServer::Run() {
+  unsigned shardCount = config_.shards;
+  if (shardCount == 0) {
+    unsigned cores = std::thread::hardware_concurrency();
+    shardCount = cores > 1 ? cores - 1 : 1;
+  }
+  for (unsigned i = 0; i < shardCount; ++i) {
+    shards_.push_back(std::make_unique<MatchShard>(config_, i, stop_));
+    if (!shards_.back()->Open()) {
+      return 1;
+    }
+  }
+  assignmentBacklog_.resize(shards_.size());
+
+  OpeningBook book;
+  if (LoadBook(config_.bookPath, book)) {
+    Log(LogLevel::Info, "Bots use %s, learned from %u fleets",
+        config_.bookPath, book.fleets);
+    for (auto &shard : shards_) {
+      shard->UseBook(book);
+    }
+  }
+
+  ratings_.Load();
+  if (!config_.checkpointPath.empty() && !OpenCheckpoint()) {
+    return 1;
+  }
+  for (auto &shard : shards_) {
+    shard->Start();
+  }
+
+  std::uint32_t now = enet_time_get();
+  lobby_.Start(now);
+  std::uint32_t lastSave = now;
+  std::uint32_t lastStatus = now;
+
+  Log(LogLevel::Info,
+      "Match server listening on port %u, %zu shards on ports %u-%u",
+      config_.port, shards_.size(), shards_.front()->Port(),
+      shards_.back()->Port());
+
+  while (!stop_.load(std::memory_order_relaxed)) {
+    ENetEvent event;
+    enet_uint32 wait = 5;
+    while (enet_host_service(host_, &event, wait) > 0) {
+      wait = 0;
+      switch (event.type) {
+      case ENET_EVENT_TYPE_CONNECT: {
+        PeerSlot &slot = peerSlots_[PeerIndex(event.peer)];
+        slot = PeerSlot{};
+        slot.budget.Reset(config_.limits, enet_time_get());
+        break;
+      }
+      case ENET_EVENT_TYPE_DISCONNECT: {
+        PeerSlot &slot = peerSlots_[PeerIndex(event.peer)];
+        lobby_.Remove(slot.ticket);
+        slot = PeerSlot{};
+        break;
+      }
+      case ENET_EVENT_TYPE_RECEIVE:
+        switch (ChargeMessage(event.peer,
+                              peerSlots_[PeerIndex(event.peer)].budget,
+                              config_.limits)) {
+        case Charge::Accepted:
+          OnReceive(event.peer, event.packet);
+          break;
+        case Charge::Kicked:
+          ++kickedPeers_;
+          [[fallthrough]];
+        case Charge::Dropped:
+        default:
+          ++droppedMessages_;
+          break;
+        }
+        enet_packet_destroy(event.packet);
+        break;
+      case ENET_EVENT_TYPE_NONE:
+      default:
+        break;
+      }
+    }
+
+    now = enet_time_get();
+    pairings_.clear();
+    lobby_.Tick(now, pairings_);
+    for (const Lobby::Pairing &pairing : pairings_) {
+      StartMatch(pairing.first, pairing.second);
+    }
+
+    FlushAssignments();
+    CollectReports();
+    enet_host_flush(host_);
+
+    if (ratings_.IsDirty() && now - lastSave >= kRatingSaveIntervalMs) {
+      ratings_.Save();
+      lastSave = now;
+    }
+    if (now - lastStatus >= kStatusIntervalMs) {
+      PrintStatus();
+      lastStatus = now;
+    }
+  }
+
+  for (auto &shard : shards_) {
+    shard->Join();
+  }
+  if (checkpoint_) {
+    checkpoint_->Stop();
+  }
+  // a full queue leaves reports in the shards' backlogs
+  bool backlogged = true;
+  while (backlogged) {
+    backlogged = false;
+    for (auto &shard : shards_) {
+      backlogged = !shard->FlushReports() || backlogged;
+    }
+    CollectReports();
+  }
+  if (ratings_.IsDirty()) {
+    ratings_.Save();
+  }
+  return 0;
+}
+
+// Hands the matches a previous process left to the shards owning their ids,
+// which is only the shard their players return to while the shard count
+// stays the same.
+bool MatchServer::OpenCheckpoint() {
+  checkpoint_ = std::make_unique<CheckpointLog>(
+      config_.checkpointPath, sizeof(MatchSession), kCheckpointVersion);
+  std::size_t restored = 0;
+  checkpoint_->Load(
+      [this, &restored](std::uint32_t matchId, const std::uint8_t *record) {
+        if (shards_[matchId % shards_.size()]->Restore(matchId, record)) {
+          ++restored;
+        }
+        nextMatchId_ = std::max(nextMatchId_, matchId + 1);
+      });
+  if (restored > 0) {
+    Log(LogLevel::Info, "Restored %zu live matches from %s", restored,
+        config_.checkpointPath);
+  }
+  if (!checkpoint_->Start(shards_.size())) {
+    return false;
+  }
+  for (std::size_t i = 0; i < shards_.size(); ++i) {
+    shards_[i]->UseCheckpoints(checkpoint_->Queue(i));
+  }
+  return true;
+}
+
+void MatchServer::OnReceive(ENetPeer *peer, const ENetPacket *packet) {
+  if (packet->dataLength != sizeof(LobbyJoinMessage) ||
+      static_cast<MessageType>(packet->data[0]) != MessageType::LobbyJoin) {
+    return;
+  }
+
+  PeerSlot &slot = peerSlots_[PeerIndex(peer)];
+  const auto *msg = reinterpret_cast<const LobbyJoinMessage *>(packet->data);
+  if (slot.playerId != 0 || msg->playerId == kBotPlayerId) {
+    return;
+  }
+  if (!HasRoom()) {
+    Refuse(peer, DisconnectReason::QueueFull);
+    ++refusedJoins_;
+    return;
+  }
+  slot.playerId = msg->playerId;
+
+  pairings_.clear();
+  slot.ticket = lobby_.Enqueue(static_cast<std::uint32_t>(PeerIndex(peer)),
+                               ratings_.Get(msg->playerId).rating, pairings_);
+  for (const Lobby::Pairing &pairing : pairings_) {
+    StartMatch(pairing.first, pairing.second);
+  }
+}
+
+// Admission control: a full queue or a full set of shards turns newcomers
+// away at once instead of letting everyone's wait grow without bound.
+bool MatchServer::HasRoom() const {
+  if (config_.maxQueued > 0 && lobby_.Size() >= config_.maxQueued) {
+    return false;
+  }
+  std::size_t live = 0;
+  for (const auto &shard : shards_) {
+    live += shard->Stats().liveMatches.load(std::memory_order_relaxed);
+  }
+  return live < shards_.size() * (config_.maxPeers / 2);
+}
+
+void MatchServer::StartMatch(std::uint32_t firstPeer,
+                             std::uint32_t secondPeer) {
+  MatchAssignment assignment;
+  assignment.matchId = nextMatchId_++;
+  std::size_t shardIndex = assignment.matchId % shards_.size();
+
+  const std::uint32_t peers[2] = {firstPeer, secondPeer};
+  std::int16_t ratings[2] = {0, 0};
+  for (int seat = 0; seat < 2; ++seat) {
+    if (peers[seat] == Lobby::kBotToken) {
+      assignment.players[seat] = kBotPlayerId;
+      assignment.botSeat = seat;
+      continue;
+    }
+    PeerSlot &slot = peerSlots_[peers[seat]];
+    slot.ticket = Lobby::kInvalidTicket;
+    assignment.players[seat] = slot.playerId;
+    ratings[seat] =
+        static_cast<std::int16_t>(ratings_.Get(slot.playerId).rating);
+  }
+  // a bot is shown as an even match
+  if (assignment.botSeat >= 0) {
+    ratings[assignment.botSeat] = ratings[1 - assignment.botSeat];
+  }
+
+  for (int seat = 0; seat < 2; ++seat) {
+    if (seat == assignment.botSeat) {
+      continue;
+    }
+    MatchFoundMessage found{
+        static_cast<std::uint8_t>(MessageType::MatchFound),
+        assignment.matchId, ratings[seat], ratings[1 - seat],
+        shards_[shardIndex]->Port()};
+    Send(&host_->peers[peers[seat]], found);
+  }
+  LogMatch(LogLevel::Debug, assignment.matchId,
+           "Paired on shard %zu, rating %d vs %d%s", shardIndex, ratings[0],
+           ratings[1], assignment.botSeat >= 0 ? " (bot)" : "");
+
+  assignmentBacklog_[shardIndex].push_back(assignment);
+}
+
+void MatchServer::FlushAssignments() {
+  for (std::size_t i = 0; i < shards_.size(); ++i) {
+    std::deque<MatchAssignment> &backlog = assignmentBacklog_[i];
+    while (!backlog.empty() &&
+           shards_[i]->Assignments().TryPush(std::move(backlog.front()))) {
+      backlog.pop_front();
+    }
+  }
+}
+
+void MatchServer::CollectReports() {
+  MatchReport report;
+  for (auto &shard : shards_) {
+    while (shard->Reports().TryPop(report)) {
+      const MatchRecord &record = report.record;
+      bool againstBot = record.players[0] == kBotPlayerId ||
+                        record.players[1] == kBotPlayerId;
+      if (record.outcome != MatchOutcome::NoResult && !againstBot) {
+        int winner = record.outcome == MatchOutcome::FirstWon ? 0 : 1;
+        ratings_.RecordResult(record.players[winner],
+                              record.players[1 - winner]);
+      }
+      results_.Submit(record, std::move(report.replay));
+    }
+  }
+}
+
+void MatchServer::PrintStatus() const {
+  std::uint32_t live = 0;
+  std::uint64_t finished = 0;
+  std::uint64_t relayed = 0;
+  std::uint32_t bots = 0;
+  std::uint64_t botMatches = 0;
+  std::uint64_t botMoves = 0;
+  std::uint64_t botNanos = 0;
+  std::uint64_t dropped = droppedMessages_;
+  std::uint64_t kicked = kickedPeers_;
+  std::uint64_t refused = refusedJoins_;
+  for (const auto &shard : shards_) {
+    const ShardStats &stats = shard->Stats();
+    live += stats.liveMatches.load(std::memory_order_relaxed);
+    finished += stats.finishedMatches.load(std::memory_order_relaxed);
+    relayed += stats.relayedMessages.load(std::memory_order_relaxed);
+    bots += stats.liveBots.load(std::memory_order_relaxed);
+    botMatches += stats.botMatches.load(std::memory_order_relaxed);
+    botMoves += stats.botMoves.load(std::memory_order_relaxed);
+    botNanos += stats.botNanos.load(std::memory_order_relaxed);
+    dropped += stats.droppedMessages.load(std::memory_order_relaxed);
+    kicked += stats.kickedPeers.load(std::memory_order_relaxed);
+    refused += stats.refusedPeers.load(std::memory_order_relaxed);
+  }
+  Log(LogLevel::Info,
+      "Live matches: %u, finished: %llu, relayed messages: %llu, "
+      "queued players: %zu",
+      live, finished, relayed, lobby_.Size());
+  if (botMatches > 0) {
+    Log(LogLevel::Info,
+        "Bot seats: %u live, %llu moves, %.1f us/move, %.2f ms/match", bots,
+        botMoves, botMoves ? botNanos / 1e3 / botMoves : 0.0,
+        botNanos / 1e6 / botMatches);
+  }
+  if (dropped > 0 || kicked > 0 || refused > 0) {
+    Log(LogLevel::Info,
+        "Rate limited messages: %llu, kicked peers: %llu, "
+        "refused peers: %llu",
+        dropped, kicked, refused);
+  }
+}
+
+} // namespace
+
+int RunMatchServer(const MatchServerConfig &config,
+                   const std::atomic<bool> *stop) {
+  ENetHost *host = CreateListenHost(config.port, config.maxPeers);
+  if (!host) {
+    Log(LogLevel::Error, "Failed to create ENet match server host");
+    return 1;
+  }
+
+  if (!stop) {
+    std::signal(SIGINT, RequestStop);
+    std::signal(SIGTERM, RequestStop);
+    stop = &signalStop;
+  }
+
+  int result = MatchServer(config, host, *stop).Run();
+
+  enet_host_flush(host);
+  enet_host_destroy(host);
+  return result;
+}
@@ -0,0 +1,44 @@
+// MatchServer.h
+#pragma once
+
+#include "GameLogic.h"
+#include "Protocol.h"
+#include "RateLimit.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct MatchServerConfig {
+  std::uint16_t port = kMatchmakingPort; // shard i listens on port + 1 + i
+  std::size_t maxPeers = 4000;           // per ENet host
+  unsigned shards = 0;                   // 0 = one per spare core
+  DeadlineConfig deadlines;
+  // queue wait before a server bot takes the empty seat; 0 = humans only
+  std::uint32_t botAfterMs = 20000;
+  RateLimitConfig limits; // per peer, on the lobby and every shard
+  // players the lobby holds before turning newcomers away; 0 = no limit
+  std::size_t maxQueued = 2000;
+  std::string ratingsPath = "ratings.dat";
+  std::string resultsPath = "results"; // base name of the ResultStore files
+  std::string bookPath = "opening.book"; // from --analyze; optional
+  // live matches, restored on start; "" = matches end with the process
+  std::string checkpointPath = "matches.ckpt";
+};
+
+// Headless host that queues incoming players in a rating lobby and relays
+// any number of concurrent matches between them. The lobby runs on the
+// calling thread; matches are sharded by match id across worker threads,
+// each with its own ENet host and event loop.
+//
+// New players are also turned away while every shard is full, at maxPeers / 2
+// live matches each.
+//
+// Live matches are checkpointed as they change. A server started with the
+// same shard count picks them up again, and their players reconnect into
+// the state they left.
+//
+// Runs until *stop becomes true, or until SIGINT/SIGTERM when stop is null.
+int RunMatchServer(const MatchServerConfig &config,
+                   const std::atomic<bool> *stop = nullptr);
@@ -0,0 +1,166 @@
+// Protocol.h
+#pragma once
+
+#include "Board.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Wire format shared by the peer-to-peer host, its client and the dedicated
+// matchmaking host. Every message starts with its MessageType byte.
+
+constexpr std::uint8_t kChannel = 0;
+constexpr std::uint16_t kServerPort = 7777;
+constexpr std::uint16_t kMatchmakingPort = 7778;
+
+// Per-peer limits every listening host hands to ENet. The bandwidth is what a
+// peer may send us; our largest message is a GridSnapshot, and waiting data
+// is what a peer can have received but not yet handled.
+constexpr std::uint32_t kPeerBandwidth = 8 * 1024;
+constexpr std::size_t kMaxPacketSize = 512;
+constexpr std::size_t kMaxWaitingData = 8 * 1024;
+
+// ENet disconnect data when a host turns a peer away.
+enum class DisconnectReason : std::uint32_t {
+  None = 0,
+  Busy = 1,       // the host already has its players
+  Flooding = 2,   // kept sending past its rate limit
+  QueueFull = 3,  // the lobby is at capacity, try again later
+  Restarting = 4, // the host restarts; reconnect to resume the match
+  MatchOver = 5   // the match ended, with nothing more to send
+};
+
+// After an expired preparation deadline the client gets this long to report
+// its auto-placed fleet before the server drops it.
+constexpr std::uint32_t kDeadlineGraceMs = 5000;
+
+// How long players get to reconnect to a match a restarted server picked up
+// from its checkpoint before it is called off.
+constexpr std::uint32_t kResumeWindowMs = 60000;
+
+enum class MessageType : std::uint8_t {
+  CellRequest = 1,
+  CellUpdate = 2,
+  GridSnapshot = 3,
+  FinishedPreparing = 4,
+  TurnUpdate = 5,
+  PrepareDeadline = 6,
+  LobbyJoin = 7,
+  MatchFound = 8,
+  SalvoRequest = 9,
+  SalvoResult = 10,
+  GameMode = 11,
+  TraceClock = 12
+};
+
+// Board ids in CellUpdate use the same numbering as TurnUpdate::currentTurn:
+// the board belongs to that seat, so the receiver never has to guess from its
+// current turn which grid a result is for.
+constexpr std::uint8_t kBoardServer = 0;
+constexpr std::uint8_t kBoardClient = 1;
+
+// Move sequence numbers are per shooter and wrap; a number is newer when it
+// is ahead by less than half the range.
+inline bool SeqNewer(std::uint16_t seq, std::uint16_t than) {
+  return static_cast<std::int16_t>(static_cast<std::uint16_t>(seq - than)) >
+         0;
+}
+
+#pragma pack(push, 1)
+// seq numbers the shooter's moves from 1. A repeated seq is a duplicate and
+// gets the original answer again; an older one is dropped.
+struct CellRequestMessage {
+  std::uint8_t type;
+  std::uint16_t x;
+  std::uint16_t y;
+  std::uint16_t seq;
+  std::uint32_t trace; // the shooter's trace id, 0 = untraced
+};
+
+// The result of move seq against the fleet on board. trace is the
+// request's, echoed.
+struct CellUpdateMessage {
+  std::uint8_t type;
+  std::uint16_t x;
+  std::uint16_t y;
+  CellState filled;
+  std::uint16_t seq;
+  std::uint8_t board; // kBoard*
+  std::uint32_t trace;
+};
+
+// Salvo mode: every shot of a turn in one move, a bit per cell as in
+// CellMask. seq works as in CellRequest.
+struct SalvoRequestMessage {
+  std::uint8_t type;
+  std::uint16_t seq;
+  std::uint64_t cells[2];
+};
+
+// hits is the part of cells that struck the fleet on board; shipsLeft is
+// what that fleet still has afloat, the size of its owner's next salvo.
+struct SalvoResultMessage {
+  std::uint8_t type;
+  std::uint16_t seq;
+  std::uint64_t cells[2];
+  std::uint64_t hits[2];
+  std::uint8_t board; // kBoard*
+  std::uint8_t shipsLeft;
+};
+
+struct GridSnapshotMessage {
+  std::uint8_t type;
+  std::uint16_t width;
+  std::uint16_t height;
+  std::uint8_t cells[kCellCount];
+};
+
+struct FinishedPreparingMessage {
+  std::uint8_t type;
+  std::uint8_t finished;
+};
+
+constexpr std::uint8_t kTurnFlagTimedOut = 1 << 0;
+
+struct TurnUpdateMessage {
+  std::uint8_t type;
+  std::uint8_t currentTurn; // 0 = server, 1 = client
+  std::uint32_t deadlineMs; // time left for this turn, 0 = unlimited
+  std::uint8_t flags;       // kTurnFlag*
+  std::uint16_t number;     // grows with every update; older ones are stale
+};
+
+struct PrepareDeadlineMessage {
+  std::uint8_t type;
+  std::uint32_t remainingMs;
+  std::uint8_t expired; // 1 = auto-place the rest of the fleet now
+};
+
+// Sent by the host before anything else of a match.
+struct GameModeMessage {
+  std::uint8_t type;
+  std::uint8_t mode; // GameMode
+};
+
+// Sent by a tracing host about once a second, so a tracing guest can put
+// its spans on the host's clock.
+struct TraceClockMessage {
+  std::uint8_t type;
+  std::uint64_t hostUs;
+};
+
+struct LobbyJoinMessage {
+  std::uint8_t type;
+  std::uint64_t playerId;
+};
+
+// A non-zero port moves the match to that shard of the dedicated host: the
+// client reconnects there with matchId as connect data and re-sends LobbyJoin.
+struct MatchFoundMessage {
+  std::uint8_t type;
+  std::uint32_t matchId;
+  std::int16_t rating;
+  std::int16_t opponentRating;
+  std::uint16_t port;
+};
+#pragma pack(pop)
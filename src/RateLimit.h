@@ -0,0 +1,52 @@
+// RateLimit.h
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// A well-behaved client sends a handful of messages per move, so these only
+// ever bite a flooding or broken one.
+struct RateLimitConfig {
+  std::uint32_t perSecond = 20; // 0 turns the limit off
+  std::uint32_t burst = 40;
+  // over-budget messages before the peer is disconnected; 0 never does
+  std::uint32_t maxOverruns = 200;
+};
+
+// Per-peer message budget. Tokens are kept in thousandths so a millisecond
+// clock refills them without rounding away slow rates.
+class TokenBucket {
+public:
+  void Reset(const RateLimitConfig &config, std::uint32_t nowMs) {
+    milliTokens_ = static_cast<std::uint64_t>(config.burst) * 1000;
+    lastMs_ = nowMs;
+    overruns_ = 0;
+  }
+
+  // False when the message is over budget and should be dropped unread.
+  bool Take(const RateLimitConfig &config, std::uint32_t nowMs) {
+    if (config.perSecond == 0) {
+      return true;
+    }
+    std::uint64_t cap = static_cast<std::uint64_t>(config.burst) * 1000;
+    std::uint64_t refill =
+        static_cast<std::uint64_t>(nowMs - lastMs_) * config.perSecond;
+    milliTokens_ = std::min(cap, milliTokens_ + refill);
+    lastMs_ = nowMs;
+    if (milliTokens_ < 1000) {
+      ++overruns_;
+      return false;
+    }
+    milliTokens_ -= 1000;
+    return true;
+  }
+
+  bool Exhausted(const RateLimitConfig &config) const {
+    return config.maxOverruns > 0 && overruns_ >= config.maxOverruns;
+  }
+
+private:
+  std::uint64_t milliTokens_ = 0;
+  std::uint32_t lastMs_ = 0;
+  std::uint32_t overruns_ = 0;
+};
@@ -0,0 +1,106 @@
+#include "Rating.h"
+
+#include "Log.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+constexpr std::uint32_t kRatingMagic = 0x54524D41; // "AMRT"
+constexpr std::uint32_t kRatingVersion = 1;
+
+#pragma pack(push, 1)
+struct RatingRecord {
+  std::uint64_t playerId;
+  std::int32_t rating;
+  std::uint32_t games;
+};
+#pragma pack(pop)
+
+// provisional players move faster until their rating settles
+double KFactor(const PlayerRating &player) {
+  return player.games < 30 ? 40.0 : 20.0;
+}
+
+} // namespace
+
+bool RatingStore::Load() {
+  std::FILE *file = std::fopen(path_.c_str(), "rb");
+  if (!file) {
+    return true;
+  }
+
+  std::uint32_t header[3] = {};
+  bool ok = std::fread(header, sizeof(header), 1, file) == 1 &&
+            header[0] == kRatingMagic && header[1] == kRatingVersion;
+
+  if (ok) {
+    ratings_.reserve(header[2]);
+    RatingRecord record{};
+    for (std::uint32_t i = 0; i < header[2]; ++i) {
+      if (std::fread(&record, sizeof(record), 1, file) != 1) {
+        ok = false;
+        break;
+      }
+      ratings_[record.playerId] = PlayerRating{record.rating, record.games};
+    }
+  }
+
+  std::fclose(file);
+  if (!ok) {
+    Log(LogLevel::Warn, "Ignoring corrupt rating file %s", path_);
+    ratings_.clear();
+  }
+  dirty_ = false;
+  return ok;
+}
+
+bool RatingStore::Save() {
+  std::string tempPath = path_ + ".tmp";
+  std::FILE *file = std::fopen(tempPath.c_str(), "wb");
+  if (!file) {
+    Log(LogLevel::Error, "Failed to open %s for writing", tempPath);
+    return false;
+  }
+
+  std::uint32_t header[3] = {kRatingMagic, kRatingVersion,
+                             static_cast<std::uint32_t>(ratings_.size())};
+  bool ok = std::fwrite(header, sizeof(header), 1, file) == 1;
+  for (const auto &[playerId, player] : ratings_) {
+    if (!ok) {
+      break;
+    }
+    RatingRecord record{playerId, player.rating, player.games};
+    ok = std::fwrite(&record, sizeof(record), 1, file) == 1;
+  }
+
+  ok = (std::fclose(file) == 0) && ok;
+  if (!ok || std::rename(tempPath.c_str(), path_.c_str()) != 0) {
+    Log(LogLevel::Error, "Failed to write rating file %s", path_);
+    std::remove(tempPath.c_str());
+    return false;
+  }
+  dirty_ = false;
+  return true;
+}
+
+PlayerRating RatingStore::Get(std::uint64_t playerId) const {
+  auto it = ratings_.find(playerId);
+  return it != ratings_.end() ? it->second : PlayerRating{};
+}
+
+void RatingStore::RecordResult(std::uint64_t winnerId, std::uint64_t loserId) {
+  PlayerRating &winner = ratings_[winnerId];
+  PlayerRating &loser = ratings_[loserId];
+
+  double expected =
+      1.0 / (1.0 + std::pow(10.0, (loser.rating - winner.rating) / 400.0));
+  winner.rating += static_cast<std::int32_t>(
+      std::lround(KFactor(winner) * (1.0 - expected)));
+  loser.rating -= static_cast<std::int32_t>(
+      std::lround(KFactor(loser) * (1.0 - expected)));
+  ++winner.games;
+  ++loser.games;
+  dirty_ = true;
+}
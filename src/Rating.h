@@ -0,0 +1,36 @@
+// Rating.h
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+constexpr std::int32_t kInitialRating = 1200;
+
+struct PlayerRating {
+  std::int32_t rating = kInitialRating;
+  std::uint32_t games = 0;
+};
+
+// Elo ratings kept in a small binary file next to the dedicated host.
+class RatingStore {
+public:
+  explicit RatingStore(std::string path) : path_(std::move(path)) {}
+
+  // A missing file is not an error; everyone simply starts at the default.
+  bool Load();
+  // Writes to a temporary file and renames it over the old one.
+  bool Save();
+
+  PlayerRating Get(std::uint64_t playerId) const;
+  void RecordResult(std::uint64_t winnerId, std::uint64_t loserId);
+
+  bool IsDirty() const { return dirty_; }
+  std::size_t Size() const { return ratings_.size(); }
+
+private:
+  std::string path_;
+  std::unordered_map<std::uint64_t, PlayerRating> ratings_;
+  bool dirty_ = false;
+};
@@ -0,0 +1,363 @@
+#include "ReplayBook.h"
+
+#include "ResultStore.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+#include <sys/mman.h>
+
+namespace {
+
+// records per unit of work; big enough that claiming one is noise
+constexpr std::uint32_t kChunkRecords = 4096;
+// ships sitting side by side add this many adjacent pairs or more
+constexpr int kPackedTouching = 3;
+
+enum Style { kEdgeStyle = 0, kPackedStyle, kSpreadStyle, kStyleCount };
+const char *const kStyleNames[kStyleCount] = {"edge", "packed", "spread"};
+
+struct Corpus {
+  std::string base;
+  void *records = nullptr;
+  std::size_t recordBytes = 0;
+  void *replays = nullptr;
+  std::size_t replayBytes = 0;
+
+  std::uint32_t Count() const {
+    return static_cast<std::uint32_t>(recordBytes / sizeof(MatchRecord));
+  }
+};
+
+struct Chunk {
+  std::size_t corpus;
+  std::uint32_t begin;
+  std::uint32_t end;
+};
+
+// One per worker, merged at the end, so the scan shares nothing.
+struct Tally {
+  std::uint64_t records = 0;
+  std::uint64_t sunk = 0;
+  std::uint64_t damaged = 0; // replay missing or inconsistent
+  std::uint64_t fleets = 0;
+  std::array<std::uint64_t, kCellCount> shipCells{};
+  std::array<std::uint64_t, kCellCount> openingShots{};
+  std::array<std::uint64_t, kCellCount + 1> shotsToWin{};
+  std::array<std::uint64_t, kStyleCount> styleFleets{};
+  std::array<std::uint64_t, kStyleCount> styleShots{};
+
+  void Merge(const Tally &other) {
+    records += other.records;
+    sunk += other.sunk;
+    damaged += other.damaged;
+    fleets += other.fleets;
+    for (int i = 0; i < kCellCount; ++i) {
+      shipCells[i] += other.shipCells[i];
+      openingShots[i] += other.openingShots[i];
+    }
+    for (int i = 0; i <= kCellCount; ++i) {
+      shotsToWin[i] += other.shotsToWin[i];
+    }
+    for (int i = 0; i < kStyleCount; ++i) {
+      styleFleets[i] += other.styleFleets[i];
+      styleShots[i] += other.styleShots[i];
+    }
+  }
+};
+
+int InternalAdjacency() {
+  int pairs = 0;
+  for (const Ship &ship : CreateFleet()) {
+    pairs += ship.length - 1;
+  }
+  return pairs;
+}
+
+Style Classify(const std::array<bool, kCellCount> &fleet) {
+  static const int internal = InternalAdjacency();
+  int border = 0;
+  int adjacent = 0;
+  for (int y = 0; y < kGridRows; ++y) {
+    for (int x = 0; x < kGridCols; ++x) {
+      if (!fleet[CellIndex(x, y)]) {
+        continue;
+      }
+      if (x == 0 || y == 0 || x == kGridCols - 1 || y == kGridRows - 1) {
+        ++border;
+      }
+      adjacent += x + 1 < kGridCols && fleet[CellIndex(x + 1, y)];
+      adjacent += y + 1 < kGridRows && fleet[CellIndex(x, y + 1)];
+    }
+  }
+  if (border * 2 >= kFleetCellCount) {
+    return kEdgeStyle;
+  }
+  // pairs beyond those inside the ships mean ships touching each other
+  return adjacent - internal >= kPackedTouching ? kPackedStyle : kSpreadStyle;
+}
+
+// Only matches that ended in a sinking count: the winner's hits then reveal
+// the loser's whole fleet, and its shot count is the game's length.
+void ScanRecord(const Corpus &corpus, const MatchRecord &record,
+                Tally &tally) {
+  ++tally.records;
+  if (record.reason != FinishReason::Sunk ||
+      record.outcome == MatchOutcome::NoResult ||
+      record.replayOffset == kNoReplay) {
+    return;
+  }
+
+  std::uint32_t header[2];
+  std::uint64_t offset = record.replayOffset;
+  if (offset + sizeof(header) > corpus.replayBytes) {
+    ++tally.damaged;
+    return;
+  }
+  const auto *base = static_cast<const std::uint8_t *>(corpus.replays);
+  std::memcpy(header, base + offset, sizeof(header));
+  if (header[0] != record.matchId || header[1] > kMaxReplayShots ||
+      offset + sizeof(header) + header[1] * sizeof(std::uint16_t) >
+          corpus.replayBytes) {
+    ++tally.damaged;
+    return;
+  }
+
+  int winner = record.outcome == MatchOutcome::FirstWon ? 0 : 1;
+  ++tally.sunk;
+  ++tally.shotsToWin[std::min<int>(record.shots[winner], kCellCount)];
+
+  std::array<bool, kCellCount> fleet{};
+  int revealed = 0;
+  bool opened[2] = {false, false};
+  const std::uint8_t *shots = base + offset + sizeof(header);
+  for (std::uint32_t i = 0; i < header[1]; ++i) {
+    std::uint16_t shot;
+    std::memcpy(&shot, shots + i * sizeof(shot), sizeof(shot));
+    int seat = ReplayShotSeat(shot);
+    int cell = ReplayShotCell(shot);
+    if (cell >= kCellCount) {
+      continue;
+    }
+    if (!opened[seat]) {
+      opened[seat] = true;
+      if (record.players[seat] != kBotPlayerId) {
+        ++tally.openingShots[cell];
+      }
+    }
+    if (seat == winner && ReplayShotHit(shot) && !fleet[cell]) {
+      fleet[cell] = true;
+      ++revealed;
+    }
+  }
+
+  // server bots place at random; the book is about how people play
+  if (revealed != kFleetCellCount ||
+      record.players[1 - winner] == kBotPlayerId) {
+    return;
+  }
+  ++tally.fleets;
+  for (int cell = 0; cell < kCellCount; ++cell) {
+    tally.shipCells[cell] += fleet[cell];
+  }
+  Style style = Classify(fleet);
+  ++tally.styleFleets[style];
+  tally.styleShots[style] += record.shots[winner];
+}
+
+void Scan(const std::vector<Corpus> &corpora, const std::vector<Chunk> &chunks,
+          std::atomic<std::size_t> &next, Tally &tally) {
+  for (std::size_t i = next.fetch_add(1, std::memory_order_relaxed);
+       i < chunks.size(); i = next.fetch_add(1, std::memory_order_relaxed)) {
+    const Chunk &chunk = chunks[i];
+    const Corpus &corpus = corpora[chunk.corpus];
+    const auto *records = static_cast<const MatchRecord *>(corpus.records);
+    for (std::uint32_t r = chunk.begin; r < chunk.end; ++r) {
+      ScanRecord(corpus, records[r], tally);
+    }
+  }
+}
+
+void PrintHeatmap(const char *title,
+                  const std::array<std::uint64_t, kCellCount> &counts,
+                  std::uint64_t total) {
+  std::printf("%s (%% of %llu)\n", title,
+              static_cast<unsigned long long>(total));
+  for (int y = 0; y < kGridRows; ++y) {
+    std::printf("  ");
+    for (int x = 0; x < kGridCols; ++x) {
+      double share = total ? 100.0 * counts[CellIndex(x, y)] / total : 0.0;
+      std::printf("%5.1f", share);
+    }
+    std::printf("\n");
+  }
+}
+
+int Percentile(const std::array<std::uint64_t, kCellCount + 1> &histogram,
+               std::uint64_t total, double fraction) {
+  std::uint64_t seen = 0;
+  for (int shots = 0; shots <= kCellCount; ++shots) {
+    seen += histogram[shots];
+    if (seen > 0 && seen >= fraction * total) {
+      return shots;
+    }
+  }
+  return kCellCount;
+}
+
+void PrintReport(const Tally &tally) {
+  std::printf("%llu matches, %llu sunk, %llu fleets revealed, %llu damaged "
+              "replays\n",
+              static_cast<unsigned long long>(tally.records),
+              static_cast<unsigned long long>(tally.sunk),
+              static_cast<unsigned long long>(tally.fleets),
+              static_cast<unsigned long long>(tally.damaged));
+  if (tally.sunk == 0) {
+    return;
+  }
+
+  std::uint64_t totalShots = 0;
+  for (int shots = 0; shots <= kCellCount; ++shots) {
+    totalShots += tally.shotsToWin[shots] * static_cast<std::uint64_t>(shots);
+  }
+  std::printf("Shots to win: mean %.1f, p10 %d, median %d, p90 %d\n",
+              static_cast<double>(totalShots) / tally.sunk,
+              Percentile(tally.shotsToWin, tally.sunk, 0.1),
+              Percentile(tally.shotsToWin, tally.sunk, 0.5),
+              Percentile(tally.shotsToWin, tally.sunk, 0.9));
+
+  std::uint64_t openings = 0;
+  for (std::uint64_t count : tally.openingShots) {
+    openings += count;
+  }
+  PrintHeatmap("Opening shots", tally.openingShots, openings);
+  PrintHeatmap("Ship placement", tally.shipCells, tally.fleets);
+
+  // a fleet that takes more shots to sink is the stronger placement
+  std::printf("Placement style   fleets  shots to sink\n");
+  for (int style = 0; style < kStyleCount; ++style) {
+    std::uint64_t fleets = tally.styleFleets[style];
+    std::printf("  %-14s %8llu  %13.1f\n", kStyleNames[style],
+                static_cast<unsigned long long>(fleets),
+                fleets ? static_cast<double>(tally.styleShots[style]) / fleets
+                       : 0.0);
+  }
+}
+
+bool WriteBook(const std::string &path, const Tally &tally) {
+  OpeningBook book{};
+  book.magic = kBookMagic;
+  book.version = kBookVersion;
+  book.fleets = static_cast<std::uint32_t>(tally.fleets);
+  for (int cell = 0; cell < kCellCount; ++cell) {
+    book.shipOdds[cell] =
+        tally.fleets ? static_cast<float>(tally.shipCells[cell]) / tally.fleets
+                     : 0.0f;
+  }
+
+  std::string tempPath = path + ".tmp";
+  std::FILE *file = std::fopen(tempPath.c_str(), "wb");
+  if (!file) {
+    std::fprintf(stderr, "Failed to open %s for writing\n", tempPath.c_str());
+    return false;
+  }
+  bool ok = std::fwrite(&book, sizeof(book), 1, file) == 1;
+  ok = (std::fclose(file) == 0) && ok;
+  if (!ok || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+    std::fprintf(stderr, "Failed to write book %s\n", path.c_str());
+    std::remove(tempPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+bool LoadBook(const std::string &path, OpeningBook &book) {
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  bool ok = std::fread(&book, sizeof(book), 1, file) == 1 &&
+            book.magic == kBookMagic && book.version == kBookVersion;
+  std::fclose(file);
+  return ok;
+}
+
+int RunReplayAnalytics(const std::vector<std::string> &basePaths,
+                       const std::string &bookPath, unsigned threads) {
+  std::vector<Corpus> corpora;
+  std::vector<Chunk> chunks;
+  for (const std::string &base : basePaths) {
+    Corpus corpus;
+    corpus.base = base;
+    corpus.records = MapReadOnly(base + ".dat", corpus.recordBytes);
+    if (!corpus.records) {
+      std::fprintf(stderr, "No match records in %s.dat\n", base.c_str());
+      continue;
+    }
+    corpus.replays = MapReadOnly(base + ".replay", corpus.replayBytes);
+    // the scan reads each file front to back exactly once
+    ::madvise(corpus.records, corpus.recordBytes, MADV_SEQUENTIAL);
+    if (corpus.replays) {
+      ::madvise(corpus.replays, corpus.replayBytes, MADV_SEQUENTIAL);
+    }
+    for (std::uint32_t begin = 0; begin < corpus.Count();
+         begin += kChunkRecords) {
+      chunks.push_back(Chunk{corpora.size(), begin,
+                             std::min(begin + kChunkRecords, corpus.Count())});
+    }
+    corpora.push_back(corpus);
+  }
+
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = static_cast<unsigned>(
+      std::min<std::size_t>(threads, std::max<std::size_t>(chunks.size(), 1)));
+
+  auto started = std::chrono::steady_clock::now();
+  std::vector<Tally> tallies(threads);
+  std::vector<std::thread> workers;
+  std::atomic<std::size_t> next{0};
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.emplace_back(Scan, std::cref(corpora), std::cref(chunks),
+                         std::ref(next), std::ref(tallies[i]));
+  }
+  Tally total;
+  for (unsigned i = 0; i < threads; ++i) {
+    workers[i].join();
+    total.Merge(tallies[i]);
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+
+  for (Corpus &corpus : corpora) {
+    ::munmap(corpus.records, corpus.recordBytes);
+    if (corpus.replays) {
+      ::munmap(corpus.replays, corpus.replayBytes);
+    }
+  }
+
+  PrintReport(total);
+  std::printf("Scanned %zu stores on %u threads in %.2fs\n", corpora.size(),
+              threads, seconds);
+  if (total.fleets == 0) {
+    std::fprintf(stderr, "No revealed fleets, %s left as it was\n",
+                 bookPath.c_str());
+    return 1;
+  }
+  if (!WriteBook(bookPath, total)) {
+    return 1;
+  }
+  std::printf("Wrote %s from %llu fleets\n", bookPath.c_str(),
+              static_cast<unsigned long long>(total.fleets));
+  return 0;
+}
@@ -0,0 +1,30 @@
+// ReplayBook.h
+#pragma once
+
+#include "Board.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr std::uint32_t kBookMagic = 0x4B424D41; // "AMBK"
+constexpr std::uint32_t kBookVersion = 1;
+
+// What the server bots learn from recorded games. The file is this struct
+// byte for byte, so loading it is a single read with nothing to parse.
+struct OpeningBook {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t fleets; // fully revealed fleets behind shipOdds
+  std::uint32_t reserved;
+  float shipOdds[kCellCount]; // share of those fleets with a ship there
+};
+
+// False when the file is missing, truncated or from another version.
+bool LoadBook(const std::string &path, OpeningBook &book);
+
+// Scans the result stores named by basePaths on threads worker threads (0 =
+// one per core), prints placement heatmaps, the shots-to-win distribution
+// and how long each placement style survived, then writes the book.
+int RunReplayAnalytics(const std::vector<std::string> &basePaths,
+                       const std::string &bookPath, unsigned threads);
@@ -0,0 +1,501 @@
+#include "ResultStore.h"
+
+#include "Board.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::uint32_t kIndexMagic = 0x58494D41; // "AMIX"
+constexpr std::uint32_t kIndexVersion = 1;
+constexpr std::uint32_t kInitialCapacity = 1024;
+
+// flush whichever comes first
+constexpr std::size_t kBatchSize = 64;
+constexpr auto kFlushInterval = std::chrono::milliseconds(500);
+
+struct IndexHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t capacity; // power of two
+  std::uint32_t players;
+  std::uint32_t records; // records folded into the totals
+  std::uint32_t reserved[3];
+};
+
+static_assert(sizeof(IndexHeader) == 32, "index header must stay 32 bytes");
+
+std::size_t IndexBytes(std::uint32_t capacity) {
+  return sizeof(IndexHeader) + sizeof(PlayerTotals) * capacity;
+}
+
+std::uint32_t SlotFor(std::uint64_t playerId, std::uint32_t capacity) {
+  return static_cast<std::uint32_t>((playerId * 0x9E3779B97F4A7C15ull) >>
+                                    32) &
+         (capacity - 1);
+}
+
+IndexHeader *HeaderOf(void *map) { return static_cast<IndexHeader *>(map); }
+
+PlayerTotals *SlotsOf(void *map) {
+  return reinterpret_cast<PlayerTotals *>(static_cast<char *>(map) +
+                                          sizeof(IndexHeader));
+}
+
+void AddToTotals(PlayerTotals &totals, const MatchRecord &record, int seat) {
+  totals.shotsFired += record.shots[seat];
+  if (record.outcome == MatchOutcome::NoResult) {
+    ++totals.unfinished;
+  } else if ((record.outcome == MatchOutcome::FirstWon) == (seat == 0)) {
+    ++totals.wins;
+  } else {
+    ++totals.losses;
+  }
+}
+
+} // namespace
+
+void *MapReadOnly(const std::string &path, std::size_t &bytes) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat info {};
+  void *map = nullptr;
+  if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+    bytes = static_cast<std::size_t>(info.st_size);
+    map = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      map = nullptr;
+    }
+  }
+  ::close(fd);
+  return map;
+}
+
+ResultWriter::ResultWriter(std::string basePath)
+    : basePath_(std::move(basePath)) {
+  if (!Open()) {
+    Log(LogLevel::Warn, "Match results will not be stored at %s", basePath_);
+    Close();
+    return;
+  }
+  thread_ = std::thread(&ResultWriter::Run, this);
+}
+
+ResultWriter::~ResultWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  Close();
+}
+
+void ResultWriter::Submit(const MatchRecord &record,
+                          std::vector<std::uint16_t> replay) {
+  bool wakeWriter;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!thread_.joinable()) {
+      return;
+    }
+    queue_.push_back(Pending{record, std::move(replay)});
+    wakeWriter = queue_.size() >= kBatchSize;
+  }
+  if (wakeWriter) {
+    wake_.notify_one();
+  }
+}
+
+void ResultWriter::Run() {
+  std::vector<Pending> batch;
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (true) {
+    wake_.wait_for(lock, kFlushInterval, [this] {
+      return stopping_ || queue_.size() >= kBatchSize;
+    });
+    batch.swap(queue_);
+    bool done = stopping_;
+
+    lock.unlock();
+    if (!batch.empty()) {
+      WriteBatch(batch);
+      batch.clear();
+    }
+    lock.lock();
+
+    if (done && queue_.empty()) {
+      break;
+    }
+  }
+}
+
+bool ResultWriter::Open() {
+  std::string recordPath = basePath_ + ".dat";
+
+  // drop a torn trailing record left by a crash mid-write
+  struct stat info {};
+  if (::stat(recordPath.c_str(), &info) == 0) {
+    std::size_t whole = static_cast<std::size_t>(info.st_size) /
+                        sizeof(MatchRecord) * sizeof(MatchRecord);
+    if (whole != static_cast<std::size_t>(info.st_size) &&
+        ::truncate(recordPath.c_str(), static_cast<off_t>(whole)) != 0) {
+      return false;
+    }
+    recordCount_ = static_cast<std::uint32_t>(whole / sizeof(MatchRecord));
+  }
+
+  records_ = std::fopen(recordPath.c_str(), "ab");
+  replays_ = std::fopen((basePath_ + ".replay").c_str(), "ab");
+  if (!records_ || !replays_) {
+    return false;
+  }
+
+  indexFd_ = ::open((basePath_ + ".idx").c_str(), O_RDWR | O_CREAT, 0644);
+  if (indexFd_ < 0) {
+    return false;
+  }
+
+  std::uint32_t capacity = kInitialCapacity;
+  bool valid = false;
+  if (::fstat(indexFd_, &info) == 0 &&
+      static_cast<std::size_t>(info.st_size) >= sizeof(IndexHeader)) {
+    IndexHeader header{};
+    if (::pread(indexFd_, &header, sizeof(header), 0) ==
+            static_cast<ssize_t>(sizeof(header)) &&
+        header.magic == kIndexMagic && header.version == kIndexVersion &&
+        header.capacity >= kInitialCapacity &&
+        (header.capacity & (header.capacity - 1)) == 0 &&
+        static_cast<std::size_t>(info.st_size) >= IndexBytes(header.capacity)) {
+      capacity = header.capacity;
+      valid = header.records == recordCount_;
+    }
+  }
+
+  if (!MapIndex(capacity)) {
+    return false;
+  }
+  if (valid) {
+    return true;
+  }
+
+  // The totals are derived data: after a crash or version change rebuild
+  // them from the records, whose per-player links only ever point backwards.
+  IndexHeader *header = HeaderOf(indexMap_);
+  std::memset(indexMap_, 0, indexBytes_);
+  header->magic = kIndexMagic;
+  header->version = kIndexVersion;
+  header->capacity = capacity;
+
+  std::FILE *existing = std::fopen(recordPath.c_str(), "rb");
+  MatchRecord record{};
+  for (std::uint32_t i = 0;
+       existing && i < recordCount_ &&
+       std::fread(&record, sizeof(record), 1, existing) == 1;
+       ++i) {
+    for (int seat = 0; seat < 2; ++seat) {
+      if (PlayerTotals *totals = FindOrInsert(record.players[seat])) {
+        AddToTotals(*totals, record, seat);
+        totals->lastRecord = i + 1;
+      }
+    }
+  }
+  if (existing) {
+    std::fclose(existing);
+  }
+  HeaderOf(indexMap_)->records = recordCount_;
+  return true;
+}
+
+void ResultWriter::Close() {
+  if (records_) {
+    std::fclose(records_);
+    records_ = nullptr;
+  }
+  if (replays_) {
+    std::fclose(replays_);
+    replays_ = nullptr;
+  }
+  if (indexMap_) {
+    ::msync(indexMap_, indexBytes_, MS_ASYNC);
+    ::munmap(indexMap_, indexBytes_);
+    indexMap_ = nullptr;
+  }
+  if (indexFd_ >= 0) {
+    ::close(indexFd_);
+    indexFd_ = -1;
+  }
+}
+
+bool ResultWriter::MapIndex(std::uint32_t capacity) {
+  std::size_t bytes = IndexBytes(capacity);
+  struct stat info {};
+  if (::fstat(indexFd_, &info) != 0) {
+    return false;
+  }
+  if (static_cast<std::size_t>(info.st_size) < bytes &&
+      ::ftruncate(indexFd_, static_cast<off_t>(bytes)) != 0) {
+    return false;
+  }
+  void *map =
+      ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, indexFd_, 0);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  indexMap_ = map;
+  indexBytes_ = bytes;
+  return true;
+}
+
+bool ResultWriter::GrowIndex() {
+  IndexHeader old = *HeaderOf(indexMap_);
+  std::vector<PlayerTotals> live;
+  live.reserve(old.players);
+  const PlayerTotals *slots = SlotsOf(indexMap_);
+  for (std::uint32_t i = 0; i < old.capacity; ++i) {
+    if (slots[i].playerId != 0) {
+      live.push_back(slots[i]);
+    }
+  }
+
+  ::munmap(indexMap_, indexBytes_);
+  indexMap_ = nullptr;
+  if (!MapIndex(old.capacity * 2)) {
+    return false;
+  }
+
+  std::memset(indexMap_, 0, indexBytes_);
+  IndexHeader *header = HeaderOf(indexMap_);
+  *header = old;
+  header->capacity = old.capacity * 2;
+  header->players = 0;
+  for (const PlayerTotals &totals : live) {
+    *FindOrInsert(totals.playerId) = totals;
+  }
+  return true;
+}
+
+PlayerTotals *ResultWriter::FindOrInsert(std::uint64_t playerId) {
+  if (playerId == 0 || !indexMap_) {
+    return nullptr;
+  }
+
+  IndexHeader *header = HeaderOf(indexMap_);
+  PlayerTotals *slots = SlotsOf(indexMap_);
+  std::uint32_t mask = header->capacity - 1;
+  for (std::uint32_t i = SlotFor(playerId, header->capacity);;
+       i = (i + 1) & mask) {
+    if (slots[i].playerId == playerId) {
+      return &slots[i];
+    }
+    if (slots[i].playerId != 0) {
+      continue;
+    }
+
+    // keep the load factor at or below one half
+    if ((header->players + 1) * 2 > header->capacity) {
+      return GrowIndex() ? FindOrInsert(playerId) : nullptr;
+    }
+    slots[i] = PlayerTotals{playerId, 0, 0, 0, 0, 0};
+    ++header->players;
+    return &slots[i];
+  }
+}
+
+void ResultWriter::IndexRecord(MatchRecord &record,
+                               std::uint32_t recordNumber) {
+  for (int seat = 0; seat < 2; ++seat) {
+    record.previous[seat] = 0;
+    if (PlayerTotals *totals = FindOrInsert(record.players[seat])) {
+      record.previous[seat] = totals->lastRecord;
+      AddToTotals(*totals, record, seat);
+      totals->lastRecord = recordNumber + 1;
+    }
+  }
+}
+
+void ResultWriter::WriteBatch(std::vector<Pending> &batch) {
+  long replayEnd = std::ftell(replays_);
+
+  for (Pending &pending : batch) {
+    MatchRecord &record = pending.record;
+    record.replayOffset = kNoReplay;
+
+    if (!pending.replay.empty() && replayEnd >= 0) {
+      std::uint32_t header[2] = {
+          record.matchId, static_cast<std::uint32_t>(pending.replay.size())};
+      if (std::fwrite(header, sizeof(header), 1, replays_) == 1 &&
+          std::fwrite(pending.replay.data(), sizeof(std::uint16_t),
+                      pending.replay.size(),
+                      replays_) == pending.replay.size()) {
+        record.replayOffset = static_cast<std::uint64_t>(replayEnd);
+        replayEnd += static_cast<long>(sizeof(header) +
+                                       pending.replay.size() *
+                                           sizeof(std::uint16_t));
+      } else {
+        replayEnd = -1;
+      }
+    }
+
+    IndexRecord(record, recordCount_);
+    if (std::fwrite(&record, sizeof(record), 1, records_) != 1) {
+      LogMatch(LogLevel::Error, record.matchId, "Failed to append to %s.dat",
+               basePath_);
+      break;
+    }
+    ++recordCount_;
+  }
+
+  std::fflush(replays_);
+  std::fflush(records_);
+  // only now do the totals officially cover the new records
+  HeaderOf(indexMap_)->records = recordCount_;
+}
+
+ResultIndex::ResultIndex(const std::string &basePath)
+    : replayPath_(basePath + ".replay") {
+  recordMap_ = MapReadOnly(basePath + ".dat", recordBytes_);
+  indexMap_ = MapReadOnly(basePath + ".idx", indexBytes_);
+  if (!recordMap_ || !indexMap_ || indexBytes_ < sizeof(IndexHeader)) {
+    return;
+  }
+
+  const IndexHeader *header = HeaderOf(indexMap_);
+  if (header->magic != kIndexMagic || header->version != kIndexVersion ||
+      indexBytes_ < IndexBytes(header->capacity)) {
+    return;
+  }
+
+  records_ = static_cast<const MatchRecord *>(recordMap_);
+  recordCount_ = static_cast<std::uint32_t>(recordBytes_ / sizeof(MatchRecord));
+  slots_ = SlotsOf(indexMap_);
+  capacity_ = header->capacity;
+}
+
+ResultIndex::~ResultIndex() {
+  if (recordMap_) {
+    ::munmap(recordMap_, recordBytes_);
+  }
+  if (indexMap_) {
+    ::munmap(indexMap_, indexBytes_);
+  }
+}
+
+const PlayerTotals *ResultIndex::Find(std::uint64_t playerId) const {
+  if (!IsOpen() || playerId == 0) {
+    return nullptr;
+  }
+  std::uint32_t mask = capacity_ - 1;
+  for (std::uint32_t i = SlotFor(playerId, capacity_), probes = 0;
+       probes < capacity_; i = (i + 1) & mask, ++probes) {
+    if (slots_[i].playerId == playerId) {
+      return &slots_[i];
+    }
+    if (slots_[i].playerId == 0) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+std::vector<MatchRecord> ResultIndex::History(std::uint64_t playerId,
+                                              std::size_t limit) const {
+  std::vector<MatchRecord> history;
+  const PlayerTotals *totals = Find(playerId);
+  if (!totals) {
+    return history;
+  }
+
+  std::uint32_t next = totals->lastRecord;
+  while (next != 0 && next <= recordCount_ && history.size() < limit) {
+    const MatchRecord &record = records_[next - 1];
+    history.push_back(record);
+    std::uint32_t previous =
+        record.players[0] == playerId ? record.previous[0] : record.previous[1];
+    // links only point backwards; anything else is corruption
+    if (previous >= next) {
+      break;
+    }
+    next = previous;
+  }
+  return history;
+}
+
+std::vector<PlayerTotals> ResultIndex::Leaderboard(std::size_t limit) const {
+  std::vector<PlayerTotals> players;
+  if (!IsOpen()) {
+    return players;
+  }
+  for (std::uint32_t i = 0; i < capacity_; ++i) {
+    if (slots_[i].playerId != 0) {
+      players.push_back(slots_[i]);
+    }
+  }
+
+  auto better = [](const PlayerTotals &a, const PlayerTotals &b) {
+    if (a.wins != b.wins) {
+      return a.wins > b.wins;
+    }
+    return a.losses < b.losses;
+  };
+  std::size_t count = std::min(limit, players.size());
+  std::partial_sort(players.begin(), players.begin() + count, players.end(),
+                    better);
+  players.resize(count);
+  return players;
+}
+
+std::vector<MatchRecord> ResultIndex::Recent(std::size_t limit) const {
+  std::vector<MatchRecord> recent;
+  if (!IsOpen()) {
+    return recent;
+  }
+  for (std::uint32_t i = recordCount_; i > 0 && recent.size() < limit; --i) {
+    recent.push_back(records_[i - 1]);
+  }
+  return recent;
+}
+
+std::vector<std::uint16_t>
+ResultIndex::Replay(const MatchRecord &record) const {
+  std::vector<std::uint16_t> shots;
+  if (record.replayOffset == kNoReplay) {
+    return shots;
+  }
+  std::FILE *file = std::fopen(replayPath_.c_str(), "rb");
+  if (!file) {
+    return shots;
+  }
+
+  std::uint32_t header[2] = {0, 0};
+  if (std::fseek(file, static_cast<long>(record.replayOffset), SEEK_SET) ==
+          0 &&
+      std::fread(header, sizeof(header), 1, file) == 1 &&
+      header[0] == record.matchId && header[1] <= kMaxReplayShots) {
+    shots.resize(header[1]);
+    // a damaged entry could name a cell past the board
+    if (std::fread(shots.data(), sizeof(std::uint16_t), shots.size(), file) !=
+            shots.size() ||
+        std::any_of(shots.begin(), shots.end(), [](std::uint16_t shot) {
+          return ReplayShotCell(shot) >= kCellCount;
+        })) {
+      shots.clear();
+    }
+  }
+  std::fclose(file);
+  return shots;
+}
@@ -0,0 +1,139 @@
+// ResultStore.h
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// On-disk history of finished matches. <base>.dat holds fixed-size records
+// appended in finish order, <base>.replay the shot sequences they point at,
+// and <base>.idx a memory-mapped hash table of per-player totals whose
+// entries head a per-player chain through the records.
+
+enum class MatchOutcome : std::uint8_t { FirstWon = 0, SecondWon, NoResult };
+enum class FinishReason : std::uint8_t { Sunk = 0, Forfeit, Timeout };
+
+constexpr std::uint64_t kNoReplay = ~std::uint64_t{0};
+// sanity bound for replay headers, far above two fully shot boards
+constexpr std::uint32_t kMaxReplayShots = 1024;
+// the player id recorded for a server bot's seat
+constexpr std::uint64_t kBotPlayerId = 0;
+
+#pragma pack(push, 1)
+struct MatchRecord {
+  std::uint32_t matchId;
+  MatchOutcome outcome;
+  FinishReason reason;
+  std::uint16_t shots[2];
+  std::uint64_t players[2];
+  std::uint32_t durationMs;
+  std::uint64_t finishedAt; // unix seconds
+  std::uint64_t replayOffset;
+  std::uint32_t previous[2]; // same player's previous record + 1, 0 = none
+};
+
+struct PlayerTotals {
+  std::uint64_t playerId; // 0 = empty slot
+  std::uint32_t wins;
+  std::uint32_t losses;
+  std::uint32_t unfinished;
+  std::uint32_t lastRecord; // record number + 1, 0 = none
+  std::uint64_t shotsFired;
+};
+#pragma pack(pop)
+
+// One replay entry per shot: cell index, hit bit and the shooting seat.
+inline std::uint16_t EncodeReplayShot(int seat, int cell, bool hit) {
+  return static_cast<std::uint16_t>((seat & 1) << 8 | (hit ? 1 : 0) << 7 |
+                                    (cell & 0x7F));
+}
+inline int ReplayShotSeat(std::uint16_t shot) { return (shot >> 8) & 1; }
+inline int ReplayShotCell(std::uint16_t shot) { return shot & 0x7F; }
+inline bool ReplayShotHit(std::uint16_t shot) { return (shot >> 7) & 1; }
+
+// Maps a whole file read-only; returns nullptr for missing or empty files.
+// Release it with munmap(map, bytes).
+void *MapReadOnly(const std::string &path, std::size_t &bytes);
+
+// Buffers finished matches and persists them on a background thread, so
+// Submit() is a short critical section on the game thread.
+class ResultWriter {
+public:
+  explicit ResultWriter(std::string basePath);
+  ~ResultWriter();
+
+  ResultWriter(const ResultWriter &) = delete;
+  ResultWriter &operator=(const ResultWriter &) = delete;
+
+  // previous[] and replayOffset are filled in by the writer.
+  void Submit(const MatchRecord &record, std::vector<std::uint16_t> replay);
+
+private:
+  struct Pending {
+    MatchRecord record;
+    std::vector<std::uint16_t> replay;
+  };
+
+  void Run();
+  bool Open();
+  void Close();
+  void WriteBatch(std::vector<Pending> &batch);
+  bool MapIndex(std::uint32_t capacity);
+  bool GrowIndex();
+  PlayerTotals *FindOrInsert(std::uint64_t playerId);
+  void IndexRecord(MatchRecord &record, std::uint32_t recordNumber);
+
+  std::string basePath_;
+  std::FILE *records_ = nullptr;
+  std::FILE *replays_ = nullptr;
+  int indexFd_ = -1;
+  void *indexMap_ = nullptr;
+  std::size_t indexBytes_ = 0;
+  std::uint32_t recordCount_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<Pending> queue_;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+// Read-only view over a store written by ResultWriter.
+class ResultIndex {
+public:
+  explicit ResultIndex(const std::string &basePath);
+  ~ResultIndex();
+
+  ResultIndex(const ResultIndex &) = delete;
+  ResultIndex &operator=(const ResultIndex &) = delete;
+
+  bool IsOpen() const { return records_ != nullptr && slots_ != nullptr; }
+
+  const PlayerTotals *Find(std::uint64_t playerId) const;
+  // Most recent first.
+  std::vector<MatchRecord> History(std::uint64_t playerId,
+                                   std::size_t limit) const;
+  // Ordered by wins, then fewer losses.
+  std::vector<PlayerTotals> Leaderboard(std::size_t limit) const;
+  // The last matches written, most recent first.
+  std::vector<MatchRecord> Recent(std::size_t limit) const;
+  // Shots of a match in EncodeReplayShot() form; empty when none were kept
+  // or the entry is damaged.
+  std::vector<std::uint16_t> Replay(const MatchRecord &record) const;
+
+private:
+  std::string replayPath_;
+  void *recordMap_ = nullptr;
+  std::size_t recordBytes_ = 0;
+  void *indexMap_ = nullptr;
+  std::size_t indexBytes_ = 0;
+  const MatchRecord *records_ = nullptr;
+  std::uint32_t recordCount_ = 0;
+  const PlayerTotals *slots_ = nullptr;
+  std::uint32_t capacity_ = 0;
+};
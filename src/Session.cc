@@ -0,0 +1,880 @@
+#include "Session.h"
+
+#include "Protocol.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr std::uint32_t kTraceClockIntervalMs = 1000;
+
+static_assert(kCellCount > 64, "the grid spills into a CellMask's 2nd word");
+
+bool OnGrid(const CellMask &cells) {
+  return (cells.bits[1] >> (kCellCount - 64)) == 0;
+}
+
+// At least one shot, all inside the grid, and no more than limit of them.
+bool ValidSalvo(const CellMask &shots, int limit) {
+  return OnGrid(shots) && !shots.Empty() && shots.Count() <= limit;
+}
+
+// Adds untried cells of targets to salvo at random until it holds size
+// shots or none are left.
+void FillSalvo(const Grid &targets, CellMask &salvo, int size,
+               std::mt19937 &rng) {
+  Grid open = targets;
+  salvo.ForEach([&open](int index) { open[index] = CellState::Miss; });
+  while (salvo.Count() < size) {
+    int index = PickAutoShot(open, rng);
+    if (index < 0) {
+      break;
+    }
+    salvo.Set(index);
+    open[index] = CellState::Miss;
+  }
+}
+
+SalvoResultMessage MakeSalvoResult(const CellMask &shots, const CellMask &hits,
+                                   std::uint16_t seq, std::uint8_t board,
+                                   int shipsLeft) {
+  return SalvoResultMessage{
+      static_cast<std::uint8_t>(MessageType::SalvoResult),
+      seq,
+      {shots.bits[0], shots.bits[1]},
+      {hits.bits[0], hits.bits[1]},
+      board,
+      static_cast<std::uint8_t>(shipsLeft)};
+}
+
+} // namespace
+
+PeerSession::PeerSession(Transport &transport, Turn self, std::uint32_t seed)
+    : transport_(transport), self_(self), rng_(seed) {
+  state_.shipLocations.reserve(kFleetCellCount);
+}
+
+void PeerSession::RotateShip() {
+  if (state_.phase != Phase::Preparing ||
+      static_cast<std::size_t>(state_.shipIndex) >= state_.ships.size()) {
+    return;
+  }
+  Ship &ship = state_.ships[state_.shipIndex];
+  ship.isHorizontal = !ship.isHorizontal;
+}
+
+bool PeerSession::PlaceShip(int x, int y) {
+  if (state_.phase != Phase::Preparing ||
+      static_cast<std::size_t>(state_.shipIndex) >= state_.ships.size()) {
+    return false;
+  }
+  const Ship &ship = state_.ships[state_.shipIndex];
+  if (!ApplyFill(state_.playerGrid, x, y, ship.length, ship.isHorizontal)) {
+    return false;
+  }
+  RecordShipCells(state_.shipLocations, x, y, ship);
+  ++state_.shipIndex;
+  return true;
+}
+
+void PeerSession::AutoPlace() {
+  if (state_.phase != Phase::Preparing) {
+    return;
+  }
+  AutoPlaceFleet(state_.playerGrid, state_.ships, state_.shipIndex,
+                 state_.shipLocations, rng_);
+}
+
+void PeerSession::SendReadyIfPlaced() {
+  if (state_.phase != Phase::Preparing || state_.selfReady ||
+      static_cast<std::size_t>(state_.shipIndex) < state_.ships.size()) {
+    return;
+  }
+  FinishedPreparingMessage msg{
+      static_cast<std::uint8_t>(MessageType::FinishedPreparing), 1};
+  transport_.Send(msg);
+  state_.selfReady = true;
+  fleetMask_ = FleetMask(state_.shipLocations);
+}
+
+void PeerSession::UpdateTransition(std::uint32_t nowMs) {
+  if (state_.phase == Phase::Preparing && state_.selfReady &&
+      state_.peerReady) {
+    state_.phase = Phase::Transition;
+    state_.transitionStartMs = nowMs;
+  }
+}
+
+bool PeerSession::SendMove(int x, int y, std::uint32_t nowMs) {
+  if (!IsMyTurn() || state_.pendingShot >= 0 || x < 0 || x >= kGridCols ||
+      y < 0 || y >= kGridRows ||
+      state_.enemyGrid[CellIndex(x, y)] != CellState::Empty) {
+    return false;
+  }
+  state_.pendingShot = CellIndex(x, y);
+  state_.pendingSinceMs = nowMs;
+  ++state_.shotSeq;
+  state_.shotTrace = NewTraceId();
+  TraceShotBegin(state_.shotTrace);
+  ResendMove();
+  TraceDepart(state_.shotTrace, TraceLeg::Request);
+  return true;
+}
+
+void PeerSession::ResendMove() {
+  if (state_.pendingShot < 0) {
+    return;
+  }
+  CellRequestMessage msg{
+      static_cast<std::uint8_t>(MessageType::CellRequest),
+      static_cast<std::uint16_t>(state_.pendingShot % kGridCols),
+      static_cast<std::uint16_t>(state_.pendingShot / kGridCols),
+      state_.shotSeq, state_.shotTrace};
+  transport_.Send(msg);
+}
+
+bool PeerSession::AimSalvo(int x, int y, std::uint32_t nowMs) {
+  if (!IsMyTurn() || !state_.pendingSalvo.Empty() || x < 0 ||
+      x >= kGridCols || y < 0 || y >= kGridRows ||
+      state_.enemyGrid[CellIndex(x, y)] != CellState::Empty ||
+      state_.aimed.Test(CellIndex(x, y))) {
+    return false;
+  }
+  state_.aimed.Set(CellIndex(x, y));
+  // near the end there may be fewer cells left than shots to fire
+  auto untried = static_cast<int>(std::count(
+      state_.enemyGrid.begin(), state_.enemyGrid.end(), CellState::Empty));
+  if (state_.aimed.Count() >= std::min(state_.salvoSize, untried)) {
+    SendSalvo(nowMs);
+  }
+  return true;
+}
+
+void PeerSession::SendSalvo(std::uint32_t nowMs) {
+  if (state_.aimed.Empty()) {
+    return;
+  }
+  state_.pendingSalvo = state_.aimed;
+  state_.aimed = CellMask{};
+  state_.pendingSinceMs = nowMs;
+  ++state_.shotSeq;
+  ResendSalvo();
+}
+
+void PeerSession::ResendSalvo() {
+  if (state_.pendingSalvo.Empty()) {
+    return;
+  }
+  SalvoRequestMessage msg{
+      static_cast<std::uint8_t>(MessageType::SalvoRequest),
+      state_.shotSeq,
+      {state_.pendingSalvo.bits[0], state_.pendingSalvo.bits[1]}};
+  transport_.Send(msg);
+}
+
+// One AND against the fleet resolves the whole salvo.
+CellMask PeerSession::ResolveSalvo(const CellMask &shots) {
+  CellMask hits = shots & fleetMask_;
+  shots.ForEach([this, &hits](int index) {
+    state_.playerGrid[index] =
+        hits.Test(index) ? CellState::Hit : CellState::Miss;
+  });
+  state_.hitsTaken += hits.Without(struck_).Count();
+  struck_ = struck_ | hits;
+  state_.salvoSize =
+      ShipsAfloat(state_.ships, state_.shipLocations, struck_);
+  return hits;
+}
+
+bool PeerSession::ApplySalvoResult(const SalvoResultMessage &msg) {
+  CellMask shots{{msg.cells[0], msg.cells[1]}};
+  CellMask hits{{msg.hits[0], msg.hits[1]}};
+  if (!SeqNewer(msg.seq, resultSeq_) ||
+      !ValidSalvo(shots, state_.salvoSize) || !hits.Without(shots).Empty()) {
+    return false;
+  }
+  if (self_ == Turn::Server) {
+    // the host only ever hears back about the salvo it sent
+    if (!(shots == state_.pendingSalvo)) {
+      return false;
+    }
+  } else {
+    // the host may have fired for us, but only at cells we never tried
+    bool untried = true;
+    shots.ForEach([this, &untried](int index) {
+      untried = untried && state_.enemyGrid[index] == CellState::Empty;
+    });
+    if (!untried) {
+      return false;
+    }
+  }
+  resultSeq_ = msg.seq;
+
+  // the host may have fired for us after a timeout, so catch up with it
+  if (!SeqNewer(state_.shotSeq, msg.seq)) {
+    state_.shotSeq = msg.seq;
+    state_.pendingSalvo = CellMask{};
+  }
+
+  int scored = 0;
+  shots.ForEach([this, &hits, &scored](int index) {
+    bool hit = hits.Test(index);
+    scored += hit && state_.enemyGrid[index] != CellState::Hit ? 1 : 0;
+    state_.enemyGrid[index] = hit ? CellState::Hit : CellState::Miss;
+  });
+  if (state_.phase != Phase::Finished &&
+      state_.outcome != GameResult::Defeat) {
+    state_.hitsScored += scored;
+  }
+  state_.enemySalvoSize = std::min<int>(msg.shipsLeft, kFleetShipCount);
+  // every salvo ends our turn; the host's TurnUpdate confirms it later
+  if (state_.phase == Phase::Battle && state_.turn == self_) {
+    state_.turn = (self_ == Turn::Server) ? Turn::Client : Turn::Server;
+    state_.aimed = CellMask{};
+  }
+  return true;
+}
+
+void PeerSession::SettleShot(int index, bool rolledBack,
+                             std::uint32_t nowMs) {
+  state_.pendingShot = -1;
+  state_.settledShot = index;
+  state_.settledAtMs = nowMs;
+  state_.settledRolledBack = rolledBack;
+  state_.settledTrace = state_.shotTrace;
+  TraceShotEnd(state_.shotTrace);
+}
+
+bool PeerSession::ApplyShotResult(const CellUpdateMessage &msg,
+                                  std::uint32_t nowMs) {
+  TraceScope span("result", msg.trace);
+  TraceArrive(msg.trace, TraceLeg::Answer);
+  if (!SeqNewer(msg.seq, resultSeq_)) {
+    return false;
+  }
+  resultSeq_ = msg.seq;
+
+  int index = CellIndex(msg.x, msg.y);
+  // the host may have moved for us after a timeout, so catch up with it
+  if (!SeqNewer(state_.shotSeq, msg.seq)) {
+    state_.shotSeq = msg.seq;
+    if (state_.pendingShot >= 0 && state_.pendingShot != index) {
+      SettleShot(state_.pendingShot, true, nowMs);
+    } else if (state_.pendingShot >= 0) {
+      SettleShot(index, false, nowMs);
+    }
+  }
+
+  CellState previous = state_.enemyGrid[index];
+  state_.enemyGrid[index] = msg.filled;
+  if (msg.filled == CellState::Hit && previous != CellState::Hit &&
+      state_.phase != Phase::Finished &&
+      state_.outcome != GameResult::Defeat) {
+    ++state_.hitsScored;
+  }
+  // a miss ends our turn; the host's TurnUpdate confirms it later
+  if (msg.filled != CellState::Hit && state_.phase == Phase::Battle &&
+      state_.turn == self_) {
+    state_.turn = (self_ == Turn::Server) ? Turn::Client : Turn::Server;
+  }
+  return true;
+}
+
+bool PeerSession::AcceptMove(std::uint16_t seq) {
+  if (seq == answeredSeq_ && seq != 0) {
+    transport_.Send(lastAnswer_, lastAnswerSize_);
+    return false;
+  }
+  return SeqNewer(seq, answeredSeq_);
+}
+
+void PeerSession::SendAnswer(const CellUpdateMessage &update) {
+  TraceDepart(update.trace, TraceLeg::Answer);
+  Answer(update.seq, &update, sizeof(update));
+}
+
+void PeerSession::SendAnswer(const SalvoResultMessage &result) {
+  Answer(result.seq, &result, sizeof(result));
+}
+
+void PeerSession::Answer(std::uint16_t seq, const void *data,
+                         std::size_t size) {
+  answeredSeq_ = seq;
+  std::memcpy(lastAnswer_, data, size);
+  lastAnswerSize_ = size;
+  transport_.Send(data, size);
+}
+
+void PeerSession::Finish(GameResult result) {
+  state_.outcome = result;
+  state_.phase = Phase::Finished;
+  state_.turn = Turn::None;
+}
+
+HostSession::HostSession(Transport &transport, const DeadlineConfig &deadlines,
+                         std::uint32_t seed, std::uint32_t nowMs,
+                         GameMode mode)
+    : PeerSession(transport, Turn::Server, seed), deadlines_(deadlines) {
+  state_.mode = mode;
+  state_.turn = Turn::Server;
+  replay_.reserve(2 * kCellCount);
+  deadlineWheel_.Start(nowMs);
+}
+
+void HostSession::OnPeerConnected(std::uint32_t nowMs) {
+  connected_ = true;
+
+  GameModeMessage mode{static_cast<std::uint8_t>(MessageType::GameMode),
+                       static_cast<std::uint8_t>(state_.mode)};
+  transport_.Send(mode);
+
+  GridSnapshotMessage snapshot{};
+  snapshot.type = static_cast<std::uint8_t>(MessageType::GridSnapshot);
+  snapshot.width = static_cast<std::uint16_t>(kGridCols);
+  snapshot.height = static_cast<std::uint16_t>(kGridRows);
+  for (int i = 0; i < kCellCount; ++i) {
+    snapshot.cells[i] = static_cast<std::uint8_t>(state_.playerGrid[i]);
+  }
+  transport_.Send(snapshot);
+
+  if (deadlines_.prepareMs > 0 && state_.phase == Phase::Preparing &&
+      prepareTimer_ == TimerWheel::kInvalidHandle) {
+    prepareTimer_ =
+        deadlineWheel_.Schedule(deadlines_.prepareMs, kPrepareDeadline);
+    state_.prepareDeadlineMs = nowMs + deadlines_.prepareMs;
+    PrepareDeadlineMessage msg{
+        static_cast<std::uint8_t>(MessageType::PrepareDeadline),
+        deadlines_.prepareMs, 0};
+    transport_.Send(msg);
+  }
+}
+
+void HostSession::Fire(int x, int y, std::uint32_t nowMs) {
+  if (!connected_) {
+    return;
+  }
+  if (state_.mode == GameMode::Salvo) {
+    AimSalvo(x, y, nowMs);
+  } else {
+    SendMove(x, y, nowMs);
+  }
+}
+
+void HostSession::ArmTurnDeadline(std::uint32_t nowMs) {
+  deadlineWheel_.Cancel(turnTimer_);
+  turnTimer_ = TimerWheel::kInvalidHandle;
+  state_.turnDeadlineMs = 0;
+  if (deadlines_.turnMs > 0 && state_.phase == Phase::Battle) {
+    turnTimer_ = deadlineWheel_.Schedule(deadlines_.turnMs, kTurnDeadline);
+    state_.turnDeadlineMs = nowMs + deadlines_.turnMs;
+  }
+}
+
+void HostSession::BroadcastTurn(std::uint8_t flags) {
+  TurnUpdateMessage msg{
+      static_cast<std::uint8_t>(MessageType::TurnUpdate),
+      static_cast<std::uint8_t>(state_.turn == Turn::Server ? 0 : 1),
+      state_.turnDeadlineMs ? deadlines_.turnMs : 0, flags, ++turnNumber_};
+  transport_.Send(msg);
+}
+
+void HostSession::FinishMatch(GameResult result, FinishReason reason) {
+  reason_ = reason;
+  Finish(result);
+  deadlineWheel_.Cancel(turnTimer_);
+  deadlineWheel_.Cancel(prepareTimer_);
+  turnTimer_ = TimerWheel::kInvalidHandle;
+  prepareTimer_ = TimerWheel::kInvalidHandle;
+  state_.turnDeadlineMs = 0;
+  state_.prepareDeadlineMs = 0;
+}
+
+// Resolves a guest shot against our fleet; shared by CellRequest and by the
+// auto-fire that stands in for an idle guest.
+void HostSession::ResolveGuestShot(int x, int y, std::uint16_t seq,
+                                   std::uint32_t trace, std::uint8_t turnFlags,
+                                   std::uint32_t nowMs) {
+  int index = CellIndex(x, y);
+  bool isHit = std::find(state_.shipLocations.begin(),
+                         state_.shipLocations.end(),
+                         index) != state_.shipLocations.end();
+
+  CellState result = isHit ? CellState::Hit : CellState::Miss;
+  bool repeated = state_.playerGrid[index] == CellState::Hit;
+  state_.playerGrid[index] = result;
+  ++shotsFired_[1];
+  replay_.push_back(EncodeReplayShot(1, index, isHit));
+
+  if (isHit && !repeated && ++state_.hitsTaken >= kFleetCellCount &&
+      state_.phase != Phase::Finished) {
+    FinishMatch(GameResult::Defeat, FinishReason::Sunk);
+  }
+
+  CellUpdateMessage update{static_cast<std::uint8_t>(MessageType::CellUpdate),
+                           static_cast<std::uint16_t>(x),
+                           static_cast<std::uint16_t>(y),
+                           result,
+                           seq,
+                           kBoardServer,
+                           trace};
+  SendAnswer(update);
+
+  if (state_.phase != Phase::Battle) {
+    return;
+  }
+  if (!isHit) {
+    state_.turn = Turn::Server;
+  }
+  ArmTurnDeadline(nowMs);
+  if (!isHit || turnFlags != 0) {
+    BroadcastTurn(turnFlags);
+  }
+}
+
+// The salvo counterpart of ResolveGuestShot; the turn always comes back.
+void HostSession::ResolveGuestSalvo(const CellMask &shots, std::uint16_t seq,
+                                    std::uint8_t turnFlags,
+                                    std::uint32_t nowMs) {
+  CellMask hits = ResolveSalvo(shots);
+  shotsFired_[1] += shots.Count();
+  shots.ForEach([this, &hits](int index) {
+    replay_.push_back(EncodeReplayShot(1, index, hits.Test(index)));
+  });
+
+  if (state_.hitsTaken >= kFleetCellCount && state_.phase != Phase::Finished) {
+    FinishMatch(GameResult::Defeat, FinishReason::Sunk);
+  }
+  SendAnswer(
+      MakeSalvoResult(shots, hits, seq, kBoardServer, state_.salvoSize));
+
+  if (state_.phase != Phase::Battle) {
+    return;
+  }
+  state_.turn = Turn::Server;
+  ArmTurnDeadline(nowMs);
+  BroadcastTurn(turnFlags);
+}
+
+void HostSession::AutoFireSalvo(std::uint32_t nowMs) {
+  // a salvo still in flight goes out again under the same seq
+  if (!state_.pendingSalvo.Empty()) {
+    ResendSalvo();
+    return;
+  }
+  FillSalvo(state_.enemyGrid, state_.aimed, state_.salvoSize, rng_);
+  SendSalvo(nowMs);
+}
+
+void HostSession::OnMessage(const std::uint8_t *data, std::size_t size,
+                            std::uint32_t nowMs) {
+  if (size < 1) {
+    return;
+  }
+
+  switch (static_cast<MessageType>(data[0])) {
+  case MessageType::CellUpdate: {
+    if (size != sizeof(CellUpdateMessage)) {
+      break;
+    }
+    const auto *msg = reinterpret_cast<const CellUpdateMessage *>(data);
+    if (msg->x >= kGridCols || msg->y >= kGridRows ||
+        msg->board != kBoardClient || !ApplyShotResult(*msg, nowMs)) {
+      break;
+    }
+    ++shotsFired_[0];
+    replay_.push_back(EncodeReplayShot(0, CellIndex(msg->x, msg->y),
+                                       msg->filled == CellState::Hit));
+    if (state_.hitsScored >= kFleetCellCount &&
+        state_.phase != Phase::Finished) {
+      FinishMatch(GameResult::Victory, FinishReason::Sunk);
+    } else if (state_.phase == Phase::Battle) {
+      // a hit keeps the turn, so the clock restarts; a miss hands it over
+      ArmTurnDeadline(nowMs);
+      if (msg->filled != CellState::Hit) {
+        BroadcastTurn(0);
+      }
+    }
+    break;
+  }
+
+  case MessageType::SalvoResult: {
+    if (size != sizeof(SalvoResultMessage)) {
+      break;
+    }
+    const auto *msg = reinterpret_cast<const SalvoResultMessage *>(data);
+    if (msg->board != kBoardClient || !ApplySalvoResult(*msg)) {
+      break;
+    }
+    CellMask shots{{msg->cells[0], msg->cells[1]}};
+    CellMask hits{{msg->hits[0], msg->hits[1]}};
+    shotsFired_[0] += shots.Count();
+    shots.ForEach([this, &hits](int index) {
+      replay_.push_back(EncodeReplayShot(0, index, hits.Test(index)));
+    });
+    if (state_.hitsScored >= kFleetCellCount &&
+        state_.phase != Phase::Finished) {
+      FinishMatch(GameResult::Victory, FinishReason::Sunk);
+    } else if (state_.phase == Phase::Battle) {
+      ArmTurnDeadline(nowMs);
+      BroadcastTurn(0);
+    }
+    break;
+  }
+
+  case MessageType::CellRequest: {
+    if (size != sizeof(CellRequestMessage)) {
+      break;
+    }
+    const auto *msg = reinterpret_cast<const CellRequestMessage *>(data);
+    TraceScope span("answer", msg->trace);
+    TraceArrive(msg->trace, TraceLeg::Request);
+    if (msg->x >= kGridCols || msg->y >= kGridRows ||
+        state_.mode != GameMode::Classic || !AcceptMove(msg->seq) ||
+        state_.phase != Phase::Battle || state_.turn != Turn::Client) {
+      break;
+    }
+    ResolveGuestShot(msg->x, msg->y, msg->seq, msg->trace, 0, nowMs);
+    break;
+  }
+
+  case MessageType::SalvoRequest: {
+    if (size != sizeof(SalvoRequestMessage)) {
+      break;
+    }
+    const auto *msg = reinterpret_cast<const SalvoRequestMessage *>(data);
+    CellMask shots{{msg->cells[0], msg->cells[1]}};
+    if (state_.mode != GameMode::Salvo ||
+        !ValidSalvo(shots, state_.enemySalvoSize) || !AcceptMove(msg->seq) ||
+        state_.phase != Phase::Battle || state_.turn != Turn::Client) {
+      break;
+    }
+    ResolveGuestSalvo(shots, msg->seq, 0, nowMs);
+    break;
+  }
+
+  case MessageType::FinishedPreparing:
+    if (size == sizeof(FinishedPreparingMessage) &&
+        reinterpret_cast<const FinishedPreparingMessage *>(data)->finished ==
+            1) {
+      state_.peerReady = true;
+    }
+    break;
+
+  case MessageType::LobbyJoin:
+    // identifies the guest for the match results store
+    if (size == sizeof(LobbyJoinMessage)) {
+      peerPlayerId_ =
+          reinterpret_cast<const LobbyJoinMessage *>(data)->playerId;
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+void HostSession::OnDeadline(std::uint32_t token, std::uint32_t nowMs) {
+  switch (token) {
+  case kPrepareDeadline:
+    prepareTimer_ = TimerWheel::kInvalidHandle;
+    state_.prepareDeadlineMs = 0;
+    if (state_.phase != Phase::Preparing) {
+      break;
+    }
+    AutoPlace();
+    if (!state_.peerReady) {
+      PrepareDeadlineMessage msg{
+          static_cast<std::uint8_t>(MessageType::PrepareDeadline), 0, 1};
+      transport_.Send(msg);
+      prepareTimer_ = deadlineWheel_.Schedule(kDeadlineGraceMs, kPrepareGrace);
+    }
+    break;
+
+  case kPrepareGrace:
+    prepareTimer_ = TimerWheel::kInvalidHandle;
+    if (state_.phase == Phase::Preparing && !state_.peerReady && connected_) {
+      transport_.Disconnect();
+      FinishMatch(GameResult::Victory, FinishReason::Timeout);
+    }
+    break;
+
+  case kTurnDeadline: {
+    turnTimer_ = TimerWheel::kInvalidHandle;
+    state_.turnDeadlineMs = 0;
+    if (state_.phase != Phase::Battle || !connected_) {
+      break;
+    }
+    if (state_.turn == Turn::Server) {
+      // a shot still in flight goes out again under the same seq
+      if (state_.mode == GameMode::Salvo) {
+        AutoFireSalvo(nowMs);
+      } else if (state_.pendingShot >= 0) {
+        ResendMove();
+      } else {
+        int index = PickAutoShot(state_.enemyGrid, rng_);
+        if (index >= 0) {
+          SendMove(index % kGridCols, index / kGridCols, nowMs);
+        }
+      }
+      // re-arm so a lost reply cannot stall the match
+      ArmTurnDeadline(nowMs);
+    } else if (state_.turn == Turn::Client) {
+      // moves for the guest under its next seq, so its own late click for
+      // this turn reads as a duplicate
+      auto seq = static_cast<std::uint16_t>(AnsweredSeq() + 1);
+      if (state_.mode == GameMode::Salvo) {
+        CellMask shots;
+        FillSalvo(state_.playerGrid, shots, state_.enemySalvoSize, rng_);
+        if (!shots.Empty()) {
+          ResolveGuestSalvo(shots, seq, kTurnFlagTimedOut, nowMs);
+        }
+        break;
+      }
+      int index = PickAutoShot(state_.playerGrid, rng_);
+      if (index >= 0) {
+        ResolveGuestShot(index % kGridCols, index / kGridCols, seq, 0,
+                         kTurnFlagTimedOut, nowMs);
+      }
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
+void HostSession::Update(std::uint32_t nowMs) {
+  deadlineWheel_.Advance(nowMs, [this, nowMs](std::uint32_t token) {
+    OnDeadline(token, nowMs);
+  });
+
+  if (connected_) {
+    SendReadyIfPlaced();
+    if (Tracing() && nowMs - traceClockMs_ >= kTraceClockIntervalMs) {
+      TraceClockMessage clock{
+          static_cast<std::uint8_t>(MessageType::TraceClock), TraceClockUs()};
+      transport_.Send(clock);
+      traceClockMs_ = nowMs;
+    }
+  }
+
+  if (state_.phase == Phase::Preparing) {
+    UpdateTransition(nowMs);
+    if (state_.phase == Phase::Transition) {
+      deadlineWheel_.Cancel(prepareTimer_);
+      prepareTimer_ = TimerWheel::kInvalidHandle;
+      state_.prepareDeadlineMs = 0;
+    }
+  } else if (state_.phase == Phase::Transition &&
+             nowMs - state_.transitionStartMs >= kTransitionMs) {
+    state_.phase = Phase::Battle;
+    state_.turn = Turn::Server;
+    state_.pendingShot = -1;
+    state_.pendingSalvo = CellMask{};
+    state_.aimed = CellMask{};
+    ResetGrid(state_.enemyGrid);
+    ArmTurnDeadline(nowMs);
+    BroadcastTurn(0);
+  }
+}
+
+GuestSession::GuestSession(Transport &transport, std::uint32_t seed)
+    : PeerSession(transport, Turn::Client, seed) {}
+
+void GuestSession::Fire(int x, int y, std::uint32_t nowMs) {
+  if (state_.mode == GameMode::Salvo) {
+    AimSalvo(x, y, nowMs);
+  } else {
+    SendMove(x, y, nowMs);
+  }
+}
+
+void GuestSession::OnMessage(const std::uint8_t *data, std::size_t size,
+                             std::uint32_t nowMs) {
+  if (size < 1) {
+    return;
+  }
+
+  switch (static_cast<MessageType>(data[0])) {
+  case MessageType::CellUpdate: {
+    if (size != sizeof(CellUpdateMessage)) {
+      break;
+    }
+    const auto *msg = reinterpret_cast<const CellUpdateMessage *>(data);
+    if (msg->x >= kGridCols || msg->y >= kGridRows ||
+        msg->board != kBoardServer || !ApplyShotResult(*msg, nowMs)) {
+      break;
+    }
+    if (state_.hitsScored >= kFleetCellCount &&
+        state_.phase != Phase::Finished) {
+      Finish(GameResult::Victory);
+    }
+    break;
+  }
+
+  case MessageType::SalvoResult: {
+    if (size != sizeof(SalvoResultMessage)) {
+      break;
+    }
+    const auto *msg = reinterpret_cast<const SalvoResultMessage *>(data);
+    if (msg->board != kBoardServer || !ApplySalvoResult(*msg)) {
+      break;
+    }
+    if (state_.hitsScored >= kFleetCellCount &&
+        state_.phase != Phase::Finished) {
+      Finish(GameResult::Victory);
+    }
+    break;
+  }
+
+  case MessageType::GameMode:
+    if (size == sizeof(GameModeMessage) && state_.phase == Phase::Preparing) {
+      const auto *msg = reinterpret_cast<const GameModeMessage *>(data);
+      state_.mode = msg->mode == static_cast<std::uint8_t>(GameMode::Salvo)
+                        ? GameMode::Salvo
+                        : GameMode::Classic;
+    }
+    break;
+
+  case MessageType::GridSnapshot:
+    if (size == sizeof(GridSnapshotMessage)) {
+      const auto *msg = reinterpret_cast<const GridSnapshotMessage *>(data);
+      if (msg->width == kGridCols && msg->height == kGridRows) {
+        for (int i = 0; i < kCellCount; ++i) {
+          state_.playerGrid[i] = static_cast<CellState>(msg->cells[i]);
+        }
+      }
+    }
+    break;
+
+  case MessageType::FinishedPreparing:
+    if (size == sizeof(FinishedPreparingMessage) &&
+        reinterpret_cast<const FinishedPreparingMessage *>(data)->finished ==
+            1) {
+      state_.peerReady = true;
+    }
+    break;
+
+  case MessageType::TurnUpdate:
+    if (size == sizeof(TurnUpdateMessage)) {
+      const auto *msg = reinterpret_cast<const TurnUpdateMessage *>(data);
+      if (!SeqNewer(msg->number, turnNumber_)) {
+        break;
+      }
+      turnNumber_ = msg->number;
+      state_.turn = (msg->currentTurn == 0) ? Turn::Server : Turn::Client;
+      state_.turnDeadlineMs = msg->deadlineMs ? nowMs + msg->deadlineMs : 0;
+      state_.lastTurnTimedOut = (msg->flags & kTurnFlagTimedOut) != 0;
+      // an unanswered shot will not be answered in this turn any more
+      if (state_.turn != self_ && state_.pendingShot >= 0) {
+        SettleShot(state_.pendingShot, true, nowMs);
+      }
+      if (state_.turn != self_) {
+        state_.pendingSalvo = CellMask{};
+        state_.aimed = CellMask{};
+      } else if (resendOnTurn_) {
+        ResendMove();
+      }
+      resendOnTurn_ = false;
+    }
+    break;
+
+  case MessageType::TraceClock:
+    if (size == sizeof(TraceClockMessage)) {
+      TraceClockSample(
+          reinterpret_cast<const TraceClockMessage *>(data)->hostUs,
+          transport_.RoundTripMs());
+    }
+    break;
+
+  case MessageType::PrepareDeadline:
+    if (size == sizeof(PrepareDeadlineMessage)) {
+      const auto *msg = reinterpret_cast<const PrepareDeadlineMessage *>(data);
+      state_.prepareDeadlineMs =
+          msg->remainingMs ? nowMs + msg->remainingMs : 0;
+      if (msg->expired == 1) {
+        // FinishedPreparing goes out on the next Update()
+        AutoPlace();
+      }
+    }
+    break;
+
+  case MessageType::CellRequest: {
+    if (size != sizeof(CellRequestMessage)) {
+      break;
+    }
+    const auto *msg = reinterpret_cast<const CellRequestMessage *>(data);
+    TraceScope span("answer", msg->trace);
+    TraceArrive(msg->trace, TraceLeg::Request);
+    if (msg->x >= kGridCols || msg->y >= kGridRows || !AcceptMove(msg->seq)) {
+      break;
+    }
+
+    int index = CellIndex(msg->x, msg->y);
+    bool isHit = std::find(state_.shipLocations.begin(),
+                           state_.shipLocations.end(),
+                           index) != state_.shipLocations.end();
+    bool repeated = state_.playerGrid[index] == CellState::Hit;
+    if (isHit && !repeated && ++state_.hitsTaken >= kFleetCellCount &&
+        state_.phase != Phase::Finished) {
+      Finish(GameResult::Defeat);
+    }
+
+    CellState result = isHit ? CellState::Hit : CellState::Miss;
+    state_.playerGrid[index] = result;
+
+    // the host hands the turn over itself after a miss
+    CellUpdateMessage update{static_cast<std::uint8_t>(MessageType::CellUpdate),
+                             msg->x,
+                             msg->y,
+                             result,
+                             msg->seq,
+                             kBoardClient,
+                             msg->trace};
+    SendAnswer(update);
+    break;
+  }
+
+  case MessageType::SalvoRequest: {
+    if (size != sizeof(SalvoRequestMessage)) {
+      break;
+    }
+    const auto *msg = reinterpret_cast<const SalvoRequestMessage *>(data);
+    CellMask shots{{msg->cells[0], msg->cells[1]}};
+    if (state_.mode != GameMode::Salvo ||
+        !ValidSalvo(shots, state_.enemySalvoSize) || !AcceptMove(msg->seq)) {
+      break;
+    }
+    CellMask hits = ResolveSalvo(shots);
+    if (state_.hitsTaken >= kFleetCellCount &&
+        state_.phase != Phase::Finished) {
+      Finish(GameResult::Defeat);
+    }
+    // the host hands the turn back itself
+    SendAnswer(
+        MakeSalvoResult(shots, hits, msg->seq, kBoardClient, state_.salvoSize));
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
+void GuestSession::Update(std::uint32_t nowMs) {
+  SendReadyIfPlaced();
+
+  if (state_.phase == Phase::Preparing) {
+    UpdateTransition(nowMs);
+  } else if (state_.phase == Phase::Transition &&
+             nowMs - state_.transitionStartMs >= kTransitionMs) {
+    state_.phase = Phase::Battle;
+    state_.pendingShot = -1;
+    state_.pendingSalvo = CellMask{};
+    state_.aimed = CellMask{};
+    ResetGrid(state_.enemyGrid);
+  }
+}
@@ -0,0 +1,195 @@
+// Session.h
+#pragma once
+
+#include "Board.h"
+#include "GameLogic.h"
+#include "Protocol.h"
+#include "ResultStore.h"
+#include "TimerWheel.h"
+#include "Transport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// length of the "BATTLE START!" transition between preparing and battle
+constexpr std::uint32_t kTransitionMs = 3000;
+
+// What one seat knows about its match, read by the front end to draw.
+struct SeatState {
+  GameMode mode = GameMode::Classic;
+  Phase phase = Phase::Preparing;
+  Turn turn = Turn::None;
+  Grid playerGrid{};
+  Grid enemyGrid{};
+  std::vector<Ship> ships = CreateFleet();
+  int shipIndex = 0;
+  std::vector<std::uint8_t> shipLocations;
+  bool selfReady = false; // our FinishedPreparing has been sent
+  bool peerReady = false;
+  int hitsTaken = 0;
+  int hitsScored = 0;
+  int pendingShot = -1;        // our cell awaiting its CellUpdate
+  std::uint16_t shotSeq = 0;   // seq of our latest move
+  std::uint32_t shotTrace = 0; // its trace id, 0 = untraced
+  std::uint32_t pendingSinceMs = 0;
+  // The last prediction to resolve: confirmed by its CellUpdate, or rolled
+  // back when the turn ended or a timeout shot was fired elsewhere.
+  int settledShot = -1;
+  std::uint32_t settledAtMs = 0;
+  bool settledRolledBack = false;
+  std::uint32_t settledTrace = 0;
+  // Salvo mode: cells chosen this turn but not yet sent, the salvo awaiting
+  // its SalvoResult, and how many shots each side's next salvo holds.
+  CellMask aimed;
+  CellMask pendingSalvo;
+  int salvoSize = kFleetShipCount;
+  int enemySalvoSize = kFleetShipCount;
+  GameResult outcome = GameResult::None;
+  std::uint32_t transitionStartMs = 0;
+  std::uint32_t prepareDeadlineMs = 0; // absolute, 0 = none
+  std::uint32_t turnDeadlineMs = 0;    // absolute, 0 = none
+  bool lastTurnTimedOut = false;
+};
+
+// Rules and protocol handling for one seat of a peer-to-peer match, free of
+// any window or socket so the same code runs under raylib/ENet and in the
+// lockstep harness. Times are milliseconds on the caller's monotonic clock.
+class PeerSession {
+public:
+  PeerSession(Transport &transport, Turn self, std::uint32_t seed);
+  virtual ~PeerSession() = default;
+
+  PeerSession(const PeerSession &) = delete;
+  PeerSession &operator=(const PeerSession &) = delete;
+
+  const SeatState &State() const { return state_; }
+  Turn Self() const { return self_; }
+  bool IsMyTurn() const {
+    return state_.phase == Phase::Battle && state_.turn == self_;
+  }
+
+  // Preparing-phase input for the ship currently being placed.
+  void RotateShip();
+  bool PlaceShip(int x, int y);
+  void AutoPlace();
+
+  // A click on the enemy grid, shown as pending until its result arrives.
+  // In salvo mode it aims one shot; the salvo goes out once it is full.
+  virtual void Fire(int x, int y, std::uint32_t nowMs) = 0;
+  virtual void OnMessage(const std::uint8_t *data, std::size_t size,
+                         std::uint32_t nowMs) = 0;
+  // Advances timers and phase changes; call once per frame.
+  virtual void Update(std::uint32_t nowMs) = 0;
+
+protected:
+  void SendReadyIfPlaced();
+  void UpdateTransition(std::uint32_t nowMs);
+  bool SendMove(int x, int y, std::uint32_t nowMs);
+  void ResendMove();
+  bool AimSalvo(int x, int y, std::uint32_t nowMs);
+  void SendSalvo(std::uint32_t nowMs);
+  void ResendSalvo();
+  // Marks the salvo's cells on our board and returns the ones that hit.
+  CellMask ResolveSalvo(const CellMask &shots);
+  bool ApplySalvoResult(const SalvoResultMessage &msg);
+  void SettleShot(int index, bool rolledBack, std::uint32_t nowMs);
+  // False for duplicates and results of moves we have already seen answered.
+  bool ApplyShotResult(const CellUpdateMessage &msg, std::uint32_t nowMs);
+  // False when the opponent's move seq was answered before; a repeat of the
+  // latest one gets the same answer again.
+  bool AcceptMove(std::uint16_t seq);
+  std::uint16_t AnsweredSeq() const { return answeredSeq_; }
+  void SendAnswer(const CellUpdateMessage &update);
+  void SendAnswer(const SalvoResultMessage &result);
+  void Finish(GameResult result);
+
+  Transport &transport_;
+  Turn self_;
+  SeatState state_;
+  std::mt19937 rng_;
+
+private:
+  void Answer(std::uint16_t seq, const void *data, std::size_t size);
+
+  std::uint16_t resultSeq_ = 0;
+  std::uint16_t answeredSeq_ = 0;
+  // the last answer as sent, whichever message it was
+  std::uint8_t lastAnswer_[sizeof(SalvoResultMessage)] = {};
+  std::size_t lastAnswerSize_ = 0;
+  // taken when our fleet is complete; struck_ is where it has been hit
+  CellMask fleetMask_;
+  CellMask struck_;
+};
+
+// The "server" seat: resolves the guest's shots and owns turns and
+// deadlines.
+class HostSession : public PeerSession {
+public:
+  HostSession(Transport &transport, const DeadlineConfig &deadlines,
+              std::uint32_t seed, std::uint32_t nowMs,
+              GameMode mode = GameMode::Classic);
+
+  void OnPeerConnected(std::uint32_t nowMs);
+  void OnPeerDisconnected() { connected_ = false; }
+
+  void Fire(int x, int y, std::uint32_t nowMs) override;
+  void OnMessage(const std::uint8_t *data, std::size_t size,
+                 std::uint32_t nowMs) override;
+  void Update(std::uint32_t nowMs) override;
+
+  // Result bookkeeping for the store; seat 0 is the host.
+  bool IsConnected() const { return connected_; }
+  std::uint64_t PeerPlayerId() const { return peerPlayerId_; }
+  FinishReason Reason() const { return reason_; }
+  const std::uint16_t *ShotsFired() const { return shotsFired_; }
+  std::vector<std::uint16_t> &Replay() { return replay_; }
+
+private:
+  enum DeadlineToken : std::uint32_t {
+    kPrepareDeadline = 1,
+    kPrepareGrace,
+    kTurnDeadline
+  };
+
+  void ArmTurnDeadline(std::uint32_t nowMs);
+  void BroadcastTurn(std::uint8_t flags);
+  void FinishMatch(GameResult result, FinishReason reason);
+  void ResolveGuestShot(int x, int y, std::uint16_t seq, std::uint32_t trace,
+                        std::uint8_t turnFlags, std::uint32_t nowMs);
+  void ResolveGuestSalvo(const CellMask &shots, std::uint16_t seq,
+                         std::uint8_t turnFlags, std::uint32_t nowMs);
+  void AutoFireSalvo(std::uint32_t nowMs);
+  void OnDeadline(std::uint32_t token, std::uint32_t nowMs);
+
+  DeadlineConfig deadlines_;
+  bool connected_ = false;
+  std::uint64_t peerPlayerId_ = 0;
+  FinishReason reason_ = FinishReason::Sunk;
+  std::uint16_t shotsFired_[2] = {0, 0};
+  std::uint16_t turnNumber_ = 0;
+  std::uint32_t traceClockMs_ = 0; // last TraceClock sent
+  std::vector<std::uint16_t> replay_;
+  TimerWheel deadlineWheel_;
+  TimerWheel::Handle prepareTimer_ = TimerWheel::kInvalidHandle;
+  TimerWheel::Handle turnTimer_ = TimerWheel::kInvalidHandle;
+};
+
+// The "client" seat: answers the host's shots against its own fleet.
+class GuestSession : public PeerSession {
+public:
+  GuestSession(Transport &transport, std::uint32_t seed);
+
+  void Fire(int x, int y, std::uint32_t nowMs) override;
+  void OnMessage(const std::uint8_t *data, std::size_t size,
+                 std::uint32_t nowMs) override;
+  void Update(std::uint32_t nowMs) override;
+  // Back on a server that restarted, which may have lost the move still
+  // waiting for an answer: it goes out again with the next turn update.
+  void Rejoined() { resendOnTurn_ = true; }
+
+private:
+  std::uint16_t turnNumber_ = 0;
+  bool resendOnTurn_ = false;
+};
@@ -0,0 +1,113 @@
+// SlabPool.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Fixed-size records carved from slabs that are never moved or freed while
+// the pool lives, so a record keeps its index and address for its whole
+// life. Create() and Recycle() are O(1) through a free list threaded through
+// the slabs themselves. ForEach() walks the live records in index order,
+// reading one byte of liveness per record and skipping the dead ones, which
+// keeps a scan over thousands of records a straight run the prefetcher
+// can follow.
+template <typename T, std::size_t kSlabRecords = 256> class SlabPool {
+  static_assert(std::is_trivially_destructible_v<T>,
+                "pool records own no heap memory");
+
+public:
+  using Index = std::int32_t;
+  static constexpr Index kNone = -1;
+
+  SlabPool() = default;
+  SlabPool(const SlabPool &) = delete;
+  SlabPool &operator=(const SlabPool &) = delete;
+
+  // A default-initialised record, reusing the most recently recycled one.
+  Index Create() {
+    if (freeHead_ == kNone) {
+      Grow();
+    }
+    Index index = freeHead_;
+    Slab &slab = SlabOf(index);
+    std::size_t at = Offset(index);
+    freeHead_ = slab.nextFree[at];
+    slab.live[at] = 1;
+    slab.records[at] = T{};
+    ++live_;
+    return index;
+  }
+
+  void Recycle(Index index) {
+    Slab &slab = SlabOf(index);
+    std::size_t at = Offset(index);
+    if (!slab.live[at]) {
+      return;
+    }
+    slab.live[at] = 0;
+    slab.nextFree[at] = freeHead_;
+    freeHead_ = index;
+    --live_;
+  }
+
+  bool IsLive(Index index) const {
+    return index >= 0 && static_cast<std::size_t>(index) < Capacity() &&
+           SlabOf(index).live[Offset(index)] != 0;
+  }
+
+  T &operator[](Index index) { return SlabOf(index).records[Offset(index)]; }
+  const T &operator[](Index index) const {
+    return SlabOf(index).records[Offset(index)];
+  }
+
+  std::size_t Live() const { return live_; }
+  std::size_t Capacity() const { return slabs_.size() * kSlabRecords; }
+
+  // fn(Index, T &) for every live record, lowest index first. fn may
+  // recycle the record it is given but must not create any.
+  template <typename Fn> void ForEach(Fn &&fn) {
+    for (std::size_t s = 0; s < slabs_.size(); ++s) {
+      Slab &slab = *slabs_[s];
+      for (std::size_t at = 0; at < kSlabRecords; ++at) {
+        if (slab.live[at]) {
+          fn(static_cast<Index>(s * kSlabRecords + at), slab.records[at]);
+        }
+      }
+    }
+  }
+
+private:
+  struct Slab {
+    std::uint8_t live[kSlabRecords] = {};
+    Index nextFree[kSlabRecords];
+    T records[kSlabRecords];
+  };
+
+  Slab &SlabOf(Index index) { return *slabs_[index / kSlabRecords]; }
+  const Slab &SlabOf(Index index) const {
+    return *slabs_[index / kSlabRecords];
+  }
+  static std::size_t Offset(Index index) {
+    return static_cast<std::size_t>(index) % kSlabRecords;
+  }
+
+  // Links a new slab's records into the free list, lowest index first out.
+  void Grow() {
+    auto base = static_cast<Index>(Capacity());
+    slabs_.push_back(std::make_unique<Slab>());
+    Slab &slab = *slabs_.back();
+    for (std::size_t at = 0; at < kSlabRecords; ++at) {
+      slab.nextFree[at] = at + 1 < kSlabRecords
+                              ? base + static_cast<Index>(at + 1)
+                              : freeHead_;
+    }
+    freeHead_ = base;
+  }
+
+  std::vector<std::unique_ptr<Slab>> slabs_;
+  Index freeHead_ = kNone;
+  std::size_t live_ = 0;
+};
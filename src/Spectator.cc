@@ -0,0 +1,141 @@
+#include "Spectator.h"
+
+#include "Board.h"
+#include "BoardView.h"
+#include "ResultStore.h"
+#include "raylib.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kWallWidth = 1280;
+constexpr int kWallHeight = 800;
+constexpr float kTilePadding = 12.0f;
+constexpr float kLabelHeight = 18.0f;
+constexpr std::uint32_t kShotIntervalMs = 150;
+// the final position stays up this long before the match starts over
+constexpr std::uint32_t kEndPauseMs = 2000;
+
+struct ReplayTile {
+  MatchRecord record;
+  std::vector<std::uint16_t> shots;
+  std::size_t shown = 0;
+  Grid boards[2]{}; // boards[seat] holds the shots fired by that seat
+  std::uint32_t nextShotMs = 0;
+  BoardView views[2];
+  std::string label;
+};
+
+void Advance(ReplayTile &tile, std::uint32_t nowMs) {
+  if (static_cast<std::int32_t>(nowMs - tile.nextShotMs) < 0) {
+    return;
+  }
+  if (tile.shown == tile.shots.size()) {
+    ResetGrid(tile.boards[0]);
+    ResetGrid(tile.boards[1]);
+    tile.shown = 0;
+    tile.nextShotMs = nowMs + kShotIntervalMs;
+    return;
+  }
+
+  std::uint16_t shot = tile.shots[tile.shown++];
+  tile.boards[ReplayShotSeat(shot)][ReplayShotCell(shot)] =
+      ReplayShotHit(shot) ? CellState::Hit : CellState::Miss;
+  tile.nextShotMs =
+      nowMs + (tile.shown == tile.shots.size() ? kEndPauseMs : kShotIntervalMs);
+}
+
+// Splits the window into near-square tiles with the two boards of a match
+// side by side in each. Runs again whenever the window is resized.
+void LayOut(std::vector<ReplayTile> &tiles, int width, int height) {
+  int columns = static_cast<int>(
+      std::ceil(std::sqrt(static_cast<double>(tiles.size()))));
+  int rows = (static_cast<int>(tiles.size()) + columns - 1) / columns;
+  float tileWidth = static_cast<float>(width) / columns;
+  float tileHeight = static_cast<float>(height) / rows;
+  float cellSize = std::fmin(
+      (tileWidth - 3 * kTilePadding) / (2 * kGridCols),
+      (tileHeight - 2 * kTilePadding - kLabelHeight) / kGridRows);
+
+  for (std::size_t i = 0; i < tiles.size(); ++i) {
+    float x = (static_cast<int>(i) % columns) * tileWidth + kTilePadding;
+    float y = (static_cast<int>(i) / columns) * tileHeight + kTilePadding +
+              kLabelHeight;
+    tiles[i].views[0] = BoardView{x, y, cellSize};
+    tiles[i].views[1] =
+        BoardView{x + cellSize * kGridCols + kTilePadding, y, cellSize};
+  }
+}
+
+} // namespace
+
+int RunSpectator(const std::string &resultsPath, std::size_t matches) {
+  ResultIndex index(resultsPath);
+  if (!index.IsOpen()) {
+    std::fprintf(stderr, "No match results at %s\n", resultsPath.c_str());
+    return 1;
+  }
+
+  std::vector<ReplayTile> tiles;
+  for (const MatchRecord &record : index.Recent(matches * 4)) {
+    if (tiles.size() == matches) {
+      break;
+    }
+    ReplayTile tile;
+    tile.record = record;
+    tile.shots = index.Replay(record);
+    if (tile.shots.empty()) {
+      continue; // forfeits before the first shot have nothing to show
+    }
+    tile.label = "match " + std::to_string(record.matchId);
+    tiles.push_back(std::move(tile));
+  }
+  if (tiles.empty()) {
+    std::fprintf(stderr, "No replays stored in %s\n", resultsPath.c_str());
+    return 1;
+  }
+  SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_WINDOW_HIGHDPI);
+  InitWindow(kWallWidth, kWallHeight, "Amiral Batti - Spectator");
+  LayOut(tiles, GetScreenWidth(), GetScreenHeight());
+  // uncapped, so the FPS counter shows the real headroom of the wall
+  SetTargetFPS(0);
+
+  auto nowMs = [] { return static_cast<std::uint32_t>(GetTime() * 1000.0); };
+  // staggered so the wall does not move in lockstep
+  for (std::size_t i = 0; i < tiles.size(); ++i) {
+    tiles[i].nextShotMs = nowMs() + static_cast<std::uint32_t>(i * 37) %
+                                        kShotIntervalMs;
+  }
+
+  while (!WindowShouldClose()) {
+    if (IsWindowResized()) {
+      LayOut(tiles, GetScreenWidth(), GetScreenHeight());
+    }
+    std::uint32_t now = nowMs();
+    for (ReplayTile &tile : tiles) {
+      Advance(tile, now);
+    }
+
+    BeginDrawing();
+    ClearBackground(RAYWHITE);
+    // every board first, so they share one batch; text last
+    for (const ReplayTile &tile : tiles) {
+      DrawBoard(tile.views[0], tile.boards[0]);
+      DrawBoard(tile.views[1], tile.boards[1]);
+    }
+    for (const ReplayTile &tile : tiles) {
+      DrawText(tile.label.c_str(), static_cast<int>(tile.views[0].x),
+               static_cast<int>(tile.views[0].y - kLabelHeight), 14, GRAY);
+    }
+    DrawFPS(GetScreenWidth() - 100, 8);
+    EndDrawing();
+  }
+
+  CloseWindow();
+  return 0;
+}
@@ -0,0 +1,9 @@
+// Spectator.h
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Replays the latest matches of a results store on a wall of boards, both
+// sides of every match at once, looping each one when it ends.
+int RunSpectator(const std::string &resultsPath, std::size_t matches);
@@ -0,0 +1,174 @@
+// TimerWheel.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hashed timer wheel used for match deadlines. Scheduling and cancelling are
+// O(1), and a tick only walks the slot it lands on, so idle sessions cost
+// nothing until their slot comes around.
+class TimerWheel {
+public:
+  using Handle = std::uint64_t;
+  static constexpr Handle kInvalidHandle = 0;
+
+  explicit TimerWheel(std::uint32_t tickMs = 10, std::uint32_t slotCount = 512)
+      : tickMs_(tickMs == 0 ? 1 : tickMs),
+        slots_(slotCount == 0 ? 1 : slotCount, kNil) {}
+
+  // Aligns the wheel with the caller's clock; call once before scheduling.
+  void Start(std::uint32_t nowMs) {
+    lastMs_ = nowMs;
+    currentTick_ = 0;
+  }
+
+  Handle Schedule(std::uint32_t delayMs, std::uint32_t token) {
+    std::uint64_t ticks = (delayMs + tickMs_ - 1) / tickMs_;
+    if (ticks == 0) {
+      ticks = 1;
+    }
+
+    std::int32_t index = Allocate();
+    Node &node = nodes_[index];
+    node.token = token;
+    node.rounds = static_cast<std::uint32_t>((ticks - 1) / slots_.size());
+    node.slot = static_cast<std::uint32_t>((currentTick_ + ticks) %
+                                           slots_.size());
+    Link(index);
+    ++size_;
+
+    return (static_cast<Handle>(node.generation) << 32) |
+           static_cast<Handle>(index + 1);
+  }
+
+  // Returns false when the timer already fired or was cancelled.
+  bool Cancel(Handle handle) {
+    if (handle == kInvalidHandle) {
+      return false;
+    }
+    std::int32_t index = static_cast<std::int32_t>(handle & 0xFFFFFFFFu) - 1;
+    std::uint32_t generation = static_cast<std::uint32_t>(handle >> 32);
+    if (index < 0 || static_cast<std::size_t>(index) >= nodes_.size()) {
+      return false;
+    }
+    Node &node = nodes_[index];
+    if (!node.active || node.generation != generation) {
+      return false;
+    }
+    Unlink(index);
+    Release(index);
+    --size_;
+    return true;
+  }
+
+  // Fires every timer that is due at nowMs. Expired tokens are collected
+  // before onExpire runs, so the callback may freely schedule or cancel.
+  template <typename Fn> void Advance(std::uint32_t nowMs, Fn &&onExpire) {
+    std::uint32_t elapsed = nowMs - lastMs_;
+    while (elapsed >= tickMs_) {
+      elapsed -= tickMs_;
+      lastMs_ += tickMs_;
+      ++currentTick_;
+      CollectSlot(static_cast<std::uint32_t>(currentTick_ % slots_.size()));
+    }
+
+    if (expired_.empty()) {
+      return;
+    }
+    fired_.swap(expired_);
+    for (std::uint32_t token : fired_) {
+      onExpire(token);
+    }
+    fired_.clear();
+  }
+
+  std::size_t Size() const { return size_; }
+
+private:
+  static constexpr std::int32_t kNil = -1;
+
+  struct Node {
+    std::uint32_t token = 0;
+    std::uint32_t rounds = 0;
+    std::uint32_t slot = 0;
+    std::uint32_t generation = 1;
+    std::int32_t prev = kNil;
+    std::int32_t next = kNil;
+    bool active = false;
+  };
+
+  std::int32_t Allocate() {
+    std::int32_t index = freeHead_;
+    if (index != kNil) {
+      freeHead_ = nodes_[index].next;
+    } else {
+      index = static_cast<std::int32_t>(nodes_.size());
+      nodes_.emplace_back();
+    }
+    nodes_[index].active = true;
+    return index;
+  }
+
+  void Release(std::int32_t index) {
+    Node &node = nodes_[index];
+    node.active = false;
+    ++node.generation;
+    if (node.generation == 0) {
+      node.generation = 1;
+    }
+    node.prev = kNil;
+    node.next = freeHead_;
+    freeHead_ = index;
+  }
+
+  void Link(std::int32_t index) {
+    Node &node = nodes_[index];
+    std::int32_t &head = slots_[node.slot];
+    node.prev = kNil;
+    node.next = head;
+    if (head != kNil) {
+      nodes_[head].prev = index;
+    }
+    head = index;
+  }
+
+  void Unlink(std::int32_t index) {
+    Node &node = nodes_[index];
+    if (node.prev != kNil) {
+      nodes_[node.prev].next = node.next;
+    } else {
+      slots_[node.slot] = node.next;
+    }
+    if (node.next != kNil) {
+      nodes_[node.next].prev = node.prev;
+    }
+  }
+
+  void CollectSlot(std::uint32_t slot) {
+    std::int32_t index = slots_[slot];
+    while (index != kNil) {
+      std::int32_t next = nodes_[index].next;
+      Node &node = nodes_[index];
+      if (node.rounds > 0) {
+        --node.rounds;
+      } else {
+        expired_.push_back(node.token);
+        Unlink(index);
+        Release(index);
+        --size_;
+      }
+      index = next;
+    }
+  }
+
+  std::uint32_t tickMs_;
+  std::uint32_t lastMs_ = 0;
+  std::uint64_t currentTick_ = 0;
+  std::vector<std::int32_t> slots_;
+  std::vector<Node> nodes_;
+  std::int32_t freeHead_ = kNil;
+  std::size_t size_ = 0;
+  std::vector<std::uint32_t> expired_;
+  std::vector<std::uint32_t> fired_;
+};
@@ -0,0 +1,157 @@
+#include "Trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+
+#include <unistd.h>
+
+namespace tracedetail {
+
+std::atomic<bool> enabled{false};
+
+std::int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace tracedetail
+
+namespace {
+
+using tracedetail::Phase;
+
+// a long match records a few thousand
+constexpr std::size_t kMaxEvents = 1 << 16;
+
+struct Event {
+  const char *name;
+  std::int64_t startUs;
+  std::int64_t endUs;
+  std::uint64_t id;
+  Phase phase;
+};
+
+// Written by the game thread while tracing runs, read once it stops.
+struct Collector {
+  std::FILE *file = nullptr;
+  std::string process = "amiral";
+  std::unique_ptr<Event[]> events;
+  std::atomic<std::size_t> used{0};
+  std::uint32_t idBase = 0;
+  std::uint32_t nextId = 0;
+  // host clock minus ours, from the best sample so far
+  std::int64_t offsetUs = 0;
+  std::uint32_t bestRoundTripMs = ~std::uint32_t{0};
+};
+
+Collector collector;
+
+void WriteEvent(std::FILE *file, const Event &event, int pid,
+                std::int64_t offsetUs) {
+  long long ts = static_cast<long long>(event.startUs + offsetUs);
+  auto id = static_cast<unsigned long long>(event.id);
+  switch (event.phase) {
+  case Phase::Complete:
+    std::fprintf(file,
+                 "{\"name\":\"%s\",\"cat\":\"turn\",\"ph\":\"X\",\"ts\":%lld,"
+                 "\"dur\":%lld,\"pid\":%d,\"tid\":1,"
+                 "\"args\":{\"trace\":\"%08llx\"}}",
+                 event.name, ts,
+                 static_cast<long long>(event.endUs - event.startUs), pid, id);
+    break;
+  case Phase::AsyncBegin:
+  case Phase::AsyncEnd:
+    std::fprintf(file,
+                 "{\"name\":\"%s\",\"cat\":\"turn\",\"ph\":\"%c\",\"ts\":%lld,"
+                 "\"id\":\"0x%08llx\",\"pid\":%d,\"tid\":1}",
+                 event.name, static_cast<char>(event.phase), ts, id, pid);
+    break;
+  case Phase::FlowStart:
+  case Phase::FlowEnd:
+    // an arrival binds to the span it happens in
+    std::fprintf(file,
+                 "{\"name\":\"%s\",\"cat\":\"turn\",\"ph\":\"%c\",%s"
+                 "\"ts\":%lld,\"id\":%llu,\"pid\":%d,\"tid\":1}",
+                 event.name, static_cast<char>(event.phase),
+                 event.phase == Phase::FlowEnd ? "\"bp\":\"e\"," : "", ts, id,
+                 pid);
+    break;
+  }
+}
+
+} // namespace
+
+void tracedetail::Record(const char *name, Phase phase, std::uint64_t id,
+                         std::int64_t startUs, std::int64_t endUs) {
+  std::size_t index = collector.used.fetch_add(1, std::memory_order_relaxed);
+  if (index < kMaxEvents) {
+    collector.events[index] = Event{name, startUs, endUs, id, phase};
+  }
+}
+
+bool StartTracing(const std::string &path) {
+  collector.file = std::fopen(path.c_str(), "w");
+  if (!collector.file) {
+    return false;
+  }
+  collector.events = std::make_unique<Event[]>(kMaxEvents);
+  // ids from the two peers stay apart by their random upper half
+  collector.idBase = ((std::random_device{}() & 0xFFFF) | 1) << 16;
+  tracedetail::enabled.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+void SetTraceProcess(const char *name) { collector.process = name; }
+
+bool StopTracing() {
+  if (!collector.file) {
+    return true;
+  }
+  tracedetail::enabled.store(false, std::memory_order_relaxed);
+  std::size_t used = collector.used.load(std::memory_order_relaxed);
+  std::size_t count = used < kMaxEvents ? used : kMaxEvents;
+  int pid = static_cast<int>(::getpid());
+
+  std::FILE *file = collector.file;
+  std::fprintf(file,
+               "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"process\":\"%s\","
+               "\"clockOffsetUs\":%lld,\"droppedEvents\":%zu},\n"
+               "\"traceEvents\":[\n"
+               "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+               "\"tid\":1,\"args\":{\"name\":\"%s\"}}",
+               collector.process.c_str(),
+               static_cast<long long>(collector.offsetUs), used - count, pid,
+               collector.process.c_str());
+  for (std::size_t i = 0; i < count; ++i) {
+    std::fputs(",\n", file);
+    WriteEvent(file, collector.events[i], pid, collector.offsetUs);
+  }
+  std::fputs("\n]}\n", file);
+  collector.file = nullptr;
+  return std::fclose(file) == 0;
+}
+
+std::uint32_t NewTraceId() {
+  if (!Tracing()) {
+    return 0;
+  }
+  collector.nextId = (collector.nextId + 1) & 0xFFFF;
+  return collector.idBase | collector.nextId;
+}
+
+std::uint64_t TraceClockUs() {
+  return static_cast<std::uint64_t>(tracedetail::NowUs());
+}
+
+void TraceClockSample(std::uint64_t hostUs, std::uint32_t roundTripMs) {
+  if (!Tracing() || roundTripMs > collector.bestRoundTripMs) {
+    return;
+  }
+  collector.bestRoundTripMs = roundTripMs;
+  collector.offsetUs = static_cast<std::int64_t>(hostUs) +
+                       static_cast<std::int64_t>(roundTripMs) * 500 -
+                       tracedetail::NowUs();
+}
@@ -0,0 +1,126 @@
+// Trace.h
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Turn tracing across both peers of a match. Each traced shot carries a
+// trace id in its CellRequest and the CellUpdate answering it; both peers
+// record timestamped spans under that id, and flow arrows join the sender's
+// span to the receiver's. StopTracing() writes them as Chrome trace-event
+// JSON for chrome://tracing or ui.perfetto.dev.
+//
+// The guest moves its timestamps onto the host's clock. The host sends its
+// clock in TraceClock messages; the guest keeps the sample taken with the
+// shortest ENet round trip and adds half that trip. Both files then share one
+// timeline and can simply be merged.
+//
+// Until StartTracing() every hook costs one relaxed load.
+
+namespace tracedetail {
+
+extern std::atomic<bool> enabled;
+
+enum class Phase : char {
+  Complete = 'X',
+  AsyncBegin = 'b',
+  AsyncEnd = 'e',
+  FlowStart = 's',
+  FlowEnd = 'f'
+};
+
+std::int64_t NowUs();
+// id is the trace id, or for flows the leg's own id derived from it
+void Record(const char *name, Phase phase, std::uint64_t id,
+            std::int64_t startUs, std::int64_t endUs);
+
+inline std::uint64_t FlowId(std::uint32_t trace, bool answer) {
+  return static_cast<std::uint64_t>(trace) << 1 | (answer ? 1 : 0);
+}
+
+} // namespace tracedetail
+
+inline bool Tracing() {
+  return tracedetail::enabled.load(std::memory_order_relaxed);
+}
+
+// Starts collecting for this process; false when path cannot be written.
+bool StartTracing(const std::string &path);
+// How this process is labelled in the viewer, e.g. "host".
+void SetTraceProcess(const char *name);
+// Writes the JSON file; false when that failed. Later spans are dropped.
+bool StopTracing();
+
+// A fresh id for a shot this peer fires; 0 while tracing is off.
+std::uint32_t NewTraceId();
+
+// This process's trace clock, for a TraceClock message.
+std::uint64_t TraceClockUs();
+// The host's clock as sent, received now over a link with this round trip.
+void TraceClockSample(std::uint64_t hostUs, std::uint32_t roundTripMs);
+
+// The two messages a traced shot travels in.
+enum class TraceLeg : std::uint8_t { Request, Answer };
+
+// The leg leaves this peer, or arrives; call inside a TraceScope so the
+// viewer draws the arrow between the two peers' spans.
+inline void TraceDepart(std::uint32_t trace, TraceLeg leg) {
+  if (Tracing() && trace != 0) {
+    bool answer = leg == TraceLeg::Answer;
+    std::int64_t now = tracedetail::NowUs();
+    tracedetail::Record(answer ? "answer" : "request",
+                        tracedetail::Phase::FlowStart,
+                        tracedetail::FlowId(trace, answer), now, now);
+  }
+}
+inline void TraceArrive(std::uint32_t trace, TraceLeg leg) {
+  if (Tracing() && trace != 0) {
+    bool answer = leg == TraceLeg::Answer;
+    std::int64_t now = tracedetail::NowUs();
+    tracedetail::Record(answer ? "answer" : "request",
+                        tracedetail::Phase::FlowEnd,
+                        tracedetail::FlowId(trace, answer), now, now);
+  }
+}
+
+// A shot's whole round trip on the shooter's side, as one async span.
+inline void TraceShotBegin(std::uint32_t trace) {
+  if (Tracing() && trace != 0) {
+    std::int64_t now = tracedetail::NowUs();
+    tracedetail::Record("shot", tracedetail::Phase::AsyncBegin, trace, now,
+                        now);
+  }
+}
+inline void TraceShotEnd(std::uint32_t trace) {
+  if (Tracing() && trace != 0) {
+    std::int64_t now = tracedetail::NowUs();
+    tracedetail::Record("shot", tracedetail::Phase::AsyncEnd, trace, now,
+                        now);
+  }
+}
+
+// A span from construction to destruction. Nothing is recorded for trace 0,
+// so a scope whose id is only known later can be given it through Bind().
+class TraceScope {
+public:
+  TraceScope(const char *name, std::uint32_t trace = 0)
+      : name_(name), trace_(trace),
+        startUs_(Tracing() ? tracedetail::NowUs() : 0) {}
+  ~TraceScope() {
+    if (Tracing() && trace_ != 0 && startUs_ != 0) {
+      tracedetail::Record(name_, tracedetail::Phase::Complete, trace_,
+                          startUs_, tracedetail::NowUs());
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+  void Bind(std::uint32_t trace) { trace_ = trace; }
+
+private:
+  const char *name_;
+  std::uint32_t trace_;
+  std::int64_t startUs_;
+};
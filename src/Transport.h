@@ -0,0 +1,46 @@
+// Transport.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// What the other end did, as reported by Transport::Poll().
+struct TransportEvent {
+  enum class Type { Connected, Message, Disconnected };
+
+  Type type = Type::Message;
+  // Message: valid until the next Poll()
+  const std::uint8_t *data = nullptr;
+  std::size_t size = 0;
+  // Disconnected: the DisconnectReason the other end gave, if it could
+  std::uint32_t reason = 0;
+};
+
+// The reliable, ordered channel to the other peer of a match. The game
+// backs it with ENet, or with shared memory when both peers run on this
+// machine; the lockstep harness with a simulated link.
+class Transport {
+public:
+  virtual ~Transport() = default;
+
+  virtual void Send(const void *data, std::size_t size) = 0;
+  virtual void Disconnect() = 0;
+
+  // Hands over the next inbound event, false once none is waiting. Frame
+  // loops drain it every frame. The harness delivers on its own clock and
+  // never polls.
+  virtual bool Poll(TransportEvent &event) {
+    (void)event;
+    return false;
+  }
+  // Sends may be held back until this is called, once per batch of them.
+  virtual void Flush() {}
+  // Turns away a peer that has just connected because the seat is taken.
+  virtual void Refuse() { Disconnect(); }
+  // Smoothed round trip to the other end; 0 when unknown or negligible.
+  virtual std::uint32_t RoundTripMs() const { return 0; }
+
+  template <typename Message> void Send(const Message &msg) {
+    Send(&msg, sizeof(msg));
+  }
+};
@@ -0,0 +1,72 @@
+#include "Viewport.h"
+
+#include <algorithm>
+
+namespace {
+
+// raylib's default font is 10px and DrawText() spaces glyphs by size / 10
+constexpr float kDefaultFontSize = 10.0f;
+
+} // namespace
+
+bool Viewport::Refresh() {
+  int width = GetScreenWidth();
+  int height = GetScreenHeight();
+  Vector2 dpi = GetWindowScaleDPI();
+  if (width == width_ && height == height_ && dpi.x == dpi_.x &&
+      dpi.y == dpi_.y && generation_ != 0) {
+    return false;
+  }
+  width_ = width;
+  height_ = height;
+  dpi_ = dpi;
+
+  float zoom = std::max(std::min(width, height) / kDesignSize, 0.01f);
+  camera_.zoom = zoom;
+  camera_.offset = Vector2{(width - kDesignSize * zoom) / 2.0f,
+                           (height - kDesignSize * zoom) / 2.0f};
+  ++generation_;
+  return true;
+}
+
+void OpenWindow(const char *title) {
+  if (IsWindowReady()) {
+    SetWindowTitle(title);
+    return;
+  }
+  SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_WINDOW_HIGHDPI |
+                 FLAG_MSAA_4X_HINT);
+  const int designSize = static_cast<int>(kDesignSize);
+  InitWindow(designSize, designSize, title);
+  SetWindowMinSize(designSize / 2, designSize / 2);
+
+  // start at two thirds of the display height, so 4K screens get a board
+  // that is not a postage stamp
+  int fit = GetMonitorHeight(GetCurrentMonitor()) * 2 / 3;
+  if (fit > designSize) {
+    SetWindowSize(fit, fit);
+  }
+}
+
+void CachedText::Draw(const Viewport &viewport, const char *text,
+                      Vector2 anchor, Color color) {
+  if (generation_ != viewport.Generation() || anchor.x != anchor_.x ||
+      anchor.y != anchor_.y || text_ != text) {
+    text_ = text;
+    anchor_ = anchor;
+    generation_ = viewport.Generation();
+
+    pixelSize_ = fontSize_ * viewport.Scale();
+    float width = MeasureTextEx(GetFontDefault(), text, pixelSize_,
+                                pixelSize_ / kDefaultFontSize)
+                      .x;
+    designWidth_ = width / viewport.Scale();
+    position_ = viewport.ToScreen(anchor);
+    if (align_ == TextAlign::Center) {
+      position_.x -= width / 2.0f;
+    }
+  }
+
+  DrawTextEx(GetFontDefault(), text_.c_str(), position_, pixelSize_,
+             pixelSize_ / kDefaultFontSize, color);
+}
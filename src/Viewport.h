@@ -0,0 +1,74 @@
+// Viewport.h
+#pragma once
+
+#include "raylib.h"
+
+#include <string>
+
+// Every screen is laid out on a fixed square canvas of kDesignSize units.
+constexpr float kDesignSize = 600.0f;
+
+// Scales the design canvas to the window: centred, letterboxed, cells kept
+// square. Worked out again only when the window is resized or moves to a
+// display with another DPI, not every frame.
+class Viewport {
+public:
+  // Call at the start of every frame; true when the layout changed.
+  bool Refresh();
+
+  // For BeginMode2D(): shapes drawn inside use design units.
+  const Camera2D &Camera() const { return camera_; }
+  float Scale() const { return camera_.zoom; }
+  // Bumped on every change so cached layouts know to redo themselves.
+  unsigned Generation() const { return generation_; }
+
+  Vector2 ToDesign(Vector2 screen) const {
+    return Vector2{(screen.x - camera_.offset.x) / camera_.zoom,
+                   (screen.y - camera_.offset.y) / camera_.zoom};
+  }
+  Vector2 ToScreen(Vector2 design) const {
+    return Vector2{camera_.offset.x + design.x * camera_.zoom,
+                   camera_.offset.y + design.y * camera_.zoom};
+  }
+  Vector2 Mouse() const { return ToDesign(GetMousePosition()); }
+
+private:
+  Camera2D camera_{Vector2{0.0f, 0.0f}, Vector2{0.0f, 0.0f}, 0.0f, 1.0f};
+  int width_ = 0;
+  int height_ = 0;
+  Vector2 dpi_{0.0f, 0.0f};
+  unsigned generation_ = 0;
+};
+
+// A resizable, high-DPI window sized to the current display. One window
+// serves the whole process: once it is open this only retitles it, and
+// main() closes it on the way out.
+void OpenWindow(const char *title);
+
+enum class TextAlign { Left, Center };
+
+// A line of text placed in design units but drawn at screen resolution, so
+// it stays sharp at any scale. It is measured and placed again only when
+// the text or the viewport changes; steady frames only draw. Draw it
+// outside BeginMode2D().
+class CachedText {
+public:
+  explicit CachedText(float fontSize, TextAlign align = TextAlign::Left)
+      : fontSize_(fontSize), align_(align) {}
+
+  // anchor is the top-left corner, or the top centre for TextAlign::Center.
+  void Draw(const Viewport &viewport, const char *text, Vector2 anchor,
+            Color color);
+  // Width of the text last drawn, in design units.
+  float Width() const { return designWidth_; }
+
+private:
+  float fontSize_;
+  TextAlign align_;
+  std::string text_;
+  Vector2 anchor_{0.0f, 0.0f};
+  unsigned generation_ = 0;
+  Vector2 position_{0.0f, 0.0f};
+  float pixelSize_ = 0.0f;
+  float designWidth_ = 0.0f;
+};
@@ -1,29 +1,265 @@
 #include "GameLogic.h"
 #include "GameState.h"
+#include "LoadGenerator.h"
+#include "Log.h"
+#include "MatchServer.h"
+#include "ReplayBook.h"
+#include "ResultStore.h"
+#include "Spectator.h"
+#include "Trace.h"
 
 #include <enet/enet.h>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool ParseSeconds(const char *text, std::uint32_t &outMs) {
+  char *end = nullptr;
+  unsigned long seconds = std::strtoul(text, &end, 10);
+  if (end == text || *end != '\0' || seconds > 86400) {
+    return false;
+  }
+  outMs = static_cast<std::uint32_t>(seconds * 1000);
+  return true;
+}
+
+int PrintHistory(const std::string &resultsPath, std::uint64_t playerId) {
+  ResultIndex index(resultsPath);
+  const PlayerTotals *totals = index.Find(playerId);
+  if (!totals) {
+    std::fprintf(stderr, "No recorded matches for %016llx\n",
+                 static_cast<unsigned long long>(playerId));
+    return 1;
+  }
+
+  std::printf("%016llx: %u wins, %u losses, %u unfinished\n",
+              static_cast<unsigned long long>(playerId), totals->wins,
+              totals->losses, totals->unfinished);
+  for (const MatchRecord &record : index.History(playerId, 20)) {
+    int seat = record.players[0] == playerId ? 0 : 1;
+    const char *result = record.outcome == MatchOutcome::NoResult ? "none"
+                         : (record.outcome == MatchOutcome::FirstWon) ==
+                                 (seat == 0)
+                             ? "won"
+                             : "lost";
+    std::printf("  match %-8u %-4s vs %016llx  %3u shots  %5.1fs\n",
+                record.matchId, result,
+                static_cast<unsigned long long>(record.players[1 - seat]),
+                record.shots[seat], record.durationMs / 1000.0);
+  }
+  return 0;
+}
+
+int PrintLeaderboard(const std::string &resultsPath, std::size_t count) {
+  ResultIndex index(resultsPath);
+  if (!index.IsOpen()) {
+    std::fprintf(stderr, "No match results at %s\n", resultsPath.c_str());
+    return 1;
+  }
+  int rank = 1;
+  for (const PlayerTotals &totals : index.Leaderboard(count)) {
+    std::printf("%3d. %016llx  %u-%u\n", rank++,
+                static_cast<unsigned long long>(totals.playerId), totals.wins,
+                totals.losses);
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  DeadlineConfig deadlines;
+  MatchServerConfig serverConfig;
+  LoadGeneratorConfig loadConfig;
+  bool dedicated = false;
+  bool loadgen = false;
+  bool training = false;
+  GameMode mode = GameMode::Classic;
+  const char *historyPlayer = nullptr;
+  unsigned long leaderboardSize = 0;
+  unsigned long spectateMatches = 0;
+  std::vector<std::string> analyzeBases;
+  unsigned threads = 0;
+  LogLevel logLevel = LogLevel::Info;
+  const char *logPath = nullptr;
+  const char *tracePath = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--turn-time") == 0 && hasValue &&
+        ParseSeconds(argv[i + 1], deadlines.turnMs)) {
+      ++i;
+    } else if (std::strcmp(argv[i], "--prepare-time") == 0 && hasValue &&
+               ParseSeconds(argv[i + 1], deadlines.prepareMs)) {
+      ++i;
+    } else if (std::strcmp(argv[i], "--salvo") == 0) {
+      mode = GameMode::Salvo;
+    } else if (std::strcmp(argv[i], "--dedicated") == 0) {
+      dedicated = true;
+    } else if (std::strcmp(argv[i], "--bot-wait") == 0 && hasValue &&
+               ParseSeconds(argv[i + 1], serverConfig.botAfterMs)) {
+      ++i;
+    } else if (std::strcmp(argv[i], "--rate-limit") == 0 && hasValue) {
+      serverConfig.limits.perSecond =
+          static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--shards") == 0 && hasValue) {
+      serverConfig.shards =
+          static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--loadgen") == 0 && hasValue) {
+      loadgen = true;
+      loadConfig.host = argv[++i];
+    } else if (std::strcmp(argv[i], "--sweep") == 0 && hasValue) {
+      loadgen = true;
+      loadConfig.sweepShards =
+          static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--training") == 0) {
+      training = true;
+    } else if (std::strcmp(argv[i], "--startup-bench") == 0) {
+      gameState.startup.benchmark = true;
+    } else if (std::strcmp(argv[i], "--players") == 0 && hasValue) {
+      loadConfig.players =
+          static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) {
+      threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+      loadConfig.threads = threads;
+    } else if (std::strcmp(argv[i], "--duration") == 0 && hasValue &&
+               ParseSeconds(argv[i + 1], loadConfig.durationMs)) {
+      ++i;
+    } else if (std::strcmp(argv[i], "--ratings") == 0 && hasValue) {
+      serverConfig.ratingsPath = argv[++i];
+    } else if (std::strcmp(argv[i], "--results") == 0 && hasValue) {
+      serverConfig.resultsPath = argv[++i];
+    } else if (std::strcmp(argv[i], "--checkpoint") == 0 && hasValue) {
+      serverConfig.checkpointPath = argv[++i];
+    } else if (std::strcmp(argv[i], "--history") == 0 && hasValue) {
+      historyPlayer = argv[++i];
+    } else if (std::strcmp(argv[i], "--leaderboard") == 0 && hasValue) {
+      leaderboardSize = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--analyze") == 0 && hasValue) {
+      analyzeBases.push_back(argv[++i]);
+    } else if (std::strcmp(argv[i], "--book") == 0 && hasValue) {
+      serverConfig.bookPath = argv[++i];
+    } else if (std::strcmp(argv[i], "--log-level") == 0 && hasValue &&
+               ParseLogLevel(argv[i + 1], logLevel)) {
+      ++i;
+    } else if (std::strcmp(argv[i], "--log") == 0 && hasValue) {
+      logPath = argv[++i];
+    } else if (std::strcmp(argv[i], "--trace") == 0 && hasValue) {
+      tracePath = argv[++i];
+    } else if (std::strcmp(argv[i], "--spectate") == 0 && hasValue) {
+      spectateMatches = std::strtoul(argv[++i], nullptr, 10);
+    } else {
+      std::fprintf(stderr,
+                   "Usage: %s [--turn-time SEC] [--prepare-time SEC]\n"
+                   "          [--salvo]\n"
+                   "          [--dedicated [--shards N] [--ratings FILE]]\n"
+                   "          [--bot-wait SEC] [--rate-limit MSG_PER_SEC]\n"
+                   "          [--results BASE] [--checkpoint FILE]\n"
+                   "          [--history PLAYER_ID | --leaderboard N]\n"
+                   "          [--spectate N]\n"
+                   "          [--analyze BASE ... [--book FILE]]\n"
+                   "          [--loadgen HOST | --sweep MAX_SHARDS]\n"
+                   "          [--players N] [--threads N] [--duration SEC]\n"
+                   "          [--training | --startup-bench]\n"
+                   "          [--log-level debug|info|warn|error|off]\n"
+                   "          [--log FILE] [--trace FILE]\n"
+                   "  0 disables the corresponding deadline, bots or limit\n"
+                   "  --salvo hosts a match where each ship fires every turn\n"
+                   "  --dedicated runs the headless matchmaking host\n"
+                   "  --checkpoint keeps its live matches across restarts;\n"
+                   "    an empty FILE turns that off\n"
+                   "  --loadgen/--sweep drive a host with bot players\n"
+                   "  --training runs the PGO workload\n"
+                   "  --startup-bench times launch and Host Game\n"
+                   "  --history/--leaderboard query stored match results\n"
+                   "  --spectate replays the last N stored matches\n"
+                   "  --analyze writes the bots' opening book from results\n"
+                   "  --log sends diagnostics to FILE instead of stderr\n"
+                   "  --trace writes this seat's shots as Chrome trace JSON\n",
+                   argv[0]);
+      return 1;
+    }
+  }
+
+  SetLogLevel(logLevel);
+  if (logPath && !SetLogFile(logPath)) {
+    std::fprintf(stderr, "Failed to open log file %s\n", logPath);
+    return 1;
+  }
+
+  if (historyPlayer) {
+    return PrintHistory(serverConfig.resultsPath,
+                        std::strtoull(historyPlayer, nullptr, 16));
+  }
+  if (leaderboardSize > 0) {
+    return PrintLeaderboard(serverConfig.resultsPath, leaderboardSize);
+  }
+  if (spectateMatches > 0) {
+    return RunSpectator(serverConfig.resultsPath, spectateMatches);
+  }
+  if (!analyzeBases.empty()) {
+    return RunReplayAnalytics(analyzeBases, serverConfig.bookPath, threads);
+  }
 
-int main() {
   if (enet_initialize() != 0) {
     std::fprintf(stderr, "Failed to initialise ENet\n");
     return 1;
   }
 
+  if (training || loadgen) {
+    int result =
+        training ? RunTrainingWorkload() : RunLoadGenerator(loadConfig);
+    enet_deinitialize();
+    return result;
+  }
+
+  if (dedicated) {
+    serverConfig.deadlines = deadlines;
+    int result = RunMatchServer(serverConfig);
+    enet_deinitialize();
+    return result;
+  }
+
+  if (tracePath && !StartTracing(tracePath)) {
+    std::fprintf(stderr, "Failed to open trace file %s\n", tracePath);
+    enet_deinitialize();
+    return 1;
+  }
+
+  WarmStart();
   MenuResult menu = ShowMainMenu();
   int result = 0;
 
   if (!menu.quit) {
     if (menu.isHost) {
-      result = RunServer();
+      result = RunServer(deadlines, mode);
     } else {
       const char *address =
           menu.address.empty() ? "127.0.0.1" : menu.address.c_str();
-      result = RunClient(address);
+      result = RunClient(address, menu.matchmaking);
     }
   }
+  if (IsWindowReady()) {
+    CloseWindow();
+  }
+  if (!StopTracing()) {
+    std::fprintf(stderr, "Failed to write trace file %s\n", tracePath);
+  }
+
+  const StartupTimes &startup = gameState.startup;
+  if (startup.benchmark) {
+    std::printf("Launch to interactive menu: %8.1f ms\n"
+                "Host Game to first frame:   %8.1f ms\n",
+                startup.interactiveMs, startup.firstFrameMs);
+  } else if (startup.firstFrameMs >= 0.0) {
+    Log(LogLevel::Debug, "Menu after %.1f ms, first game frame %.1f ms later",
+        startup.interactiveMs, startup.firstFrameMs);
+  }
 
   enet_deinitialize();
   return result;
 }
-
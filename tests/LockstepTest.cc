@@ -0,0 +1,417 @@
+// Runs full host/guest matches in one process over simulated links on a
+// virtual clock and checks that both seats end up agreeing on the game.
+//
+//   lockstep_test [matches per scenario] [base seed]
+
+#include "SimTransport.h"
+
+#include "Board.h"
+#include "Protocol.h"
+#include "Session.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr std::uint32_t kTickMs = 5;
+constexpr std::uint32_t kMaxMatchMs = 30 * 60 * 1000;
+
+struct Scenario {
+  const char *name;
+  LinkConfig link;
+  double doubleClickRate; // a shot clicked twice before the reply arrives
+  double idleRate;        // a turn left to the host's auto-fire
+  // failures are reported but do not fail the run
+  bool knownIssue;
+  GameMode mode = GameMode::Classic;
+};
+
+// Clicks like a player would: waits a moment, places a random fleet, fires
+// at random untried cells when it is its turn.
+class ScriptedPlayer {
+public:
+  ScriptedPlayer(const Scenario &scenario, std::uint32_t seed)
+      : scenario_(scenario), rng_(seed) {}
+
+  void Act(PeerSession &session, std::uint32_t nowMs,
+           const DeadlineConfig &deadlines) {
+    const SeatState &state = session.State();
+    if (nowMs < nextActionMs_) {
+      return;
+    }
+
+    if (state.phase == Phase::Preparing && !state.selfReady) {
+      if (Chance(scenario_.idleRate)) {
+        nextActionMs_ = nowMs + deadlines.prepareMs + kDeadlineGraceMs / 2;
+        return;
+      }
+      session.AutoPlace();
+      return;
+    }
+
+    // the previous shot is still shown as pending
+    if (!session.IsMyTurn() || state.pendingShot >= 0 ||
+        !state.pendingSalvo.Empty()) {
+      return;
+    }
+
+    if (Chance(scenario_.idleRate)) {
+      nextActionMs_ = nowMs + deadlines.turnMs + 250;
+      return;
+    }
+
+    Grid untried = state.enemyGrid;
+    state.aimed.ForEach(
+        [&untried](int aimed) { untried[aimed] = CellState::Miss; });
+    int index = PickAutoShot(untried, rng_);
+    if (index < 0) {
+      return;
+    }
+    session.Fire(index % kGridCols, index / kGridCols, nowMs);
+    if (Chance(scenario_.doubleClickRate)) {
+      session.Fire(index % kGridCols, index / kGridCols, nowMs);
+    }
+    nextActionMs_ = nowMs + Think();
+  }
+
+  void Start(std::uint32_t nowMs) { nextActionMs_ = nowMs + 500 + Think(); }
+
+private:
+  bool Chance(double rate) {
+    return rate > 0.0 &&
+           std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < rate;
+  }
+
+  std::uint32_t Think() {
+    return std::uniform_int_distribution<std::uint32_t>(0, 60)(rng_);
+  }
+
+  const Scenario &scenario_;
+  std::mt19937 rng_;
+  std::uint32_t nextActionMs_ = 0;
+};
+
+bool IsShipCell(const SeatState &state, int index) {
+  return std::find(state.shipLocations.begin(), state.shipLocations.end(),
+                   index) != state.shipLocations.end();
+}
+
+// Ships with a cell not yet marked Hit on grid, counted one ship at a time.
+int CountAfloat(const std::vector<Ship> &ships,
+                const std::vector<std::uint8_t> &locations, const Grid &grid) {
+  int afloat = 0;
+  std::size_t first = 0;
+  for (const Ship &ship : ships) {
+    for (int i = 0; i < ship.length; ++i) {
+      if (grid[locations[first + i]] != CellState::Hit) {
+        ++afloat;
+        break;
+      }
+    }
+    first += static_cast<std::size_t>(ship.length);
+  }
+  return afloat;
+}
+
+// Sinks random fleets ship by ship in shuffled orders, with stray hits on
+// the ships left, and compares ShipsAfloat() with CountAfloat().
+bool CheckShipsAfloat(std::uint32_t seed) {
+  std::mt19937 rng(seed);
+  for (int fleet = 0; fleet < 200; ++fleet) {
+    Grid grid{};
+    std::vector<Ship> ships = CreateFleet();
+    std::vector<std::uint8_t> locations;
+    int shipIndex = 0;
+    if (!AutoPlaceFleet(grid, ships, shipIndex, locations, rng)) {
+      continue;
+    }
+    std::vector<std::size_t> firsts;
+    std::size_t first = 0;
+    for (const Ship &ship : ships) {
+      firsts.push_back(first);
+      first += static_cast<std::size_t>(ship.length);
+    }
+    std::vector<std::size_t> order(ships.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), rng);
+
+    CellMask struck;
+    for (std::size_t ship : order) {
+      for (int i = 0; i < ships[ship].length; ++i) {
+        std::uint8_t cell = locations[firsts[ship] + i];
+        struck.Set(cell);
+        grid[cell] = CellState::Hit;
+      }
+      std::uint8_t stray = locations[rng() % locations.size()];
+      struck.Set(stray);
+      grid[stray] = CellState::Hit;
+      if (ShipsAfloat(ships, locations, struck) !=
+          CountAfloat(ships, locations, grid)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Empty string when the two seats' views are consistent.
+std::string CheckSeat(const char *seat, const SeatState &self,
+                      const SeatState &opponent) {
+  int hits = 0;
+  for (int i = 0; i < kCellCount; ++i) {
+    CellState aimed = self.enemyGrid[i];
+    if (aimed == CellState::Hit) {
+      ++hits;
+      if (!IsShipCell(opponent, i)) {
+        return std::string(seat) + " marked a hit on open water";
+      }
+    } else if (aimed == CellState::Miss && IsShipCell(opponent, i)) {
+      return std::string(seat) + " marked a miss on a ship";
+    }
+    if (aimed != CellState::Empty &&
+        (opponent.playerGrid[i] != CellState::Hit &&
+         opponent.playerGrid[i] != CellState::Miss)) {
+      return std::string(seat) + " saw a result the opponent never sent";
+    }
+
+    CellState own = self.playerGrid[i];
+    if ((own == CellState::Hit && !IsShipCell(self, i)) ||
+        (own == CellState::Miss && IsShipCell(self, i))) {
+      return std::string(seat) + " applied a shot result to its own grid";
+    }
+  }
+  if (hits != self.hitsScored) {
+    return std::string(seat) + " hit count disagrees with its grid";
+  }
+  return std::string();
+}
+
+struct MatchResult {
+  std::string failure; // empty when the match checked out
+  std::uint32_t durationMs = 0;
+  int shots = 0;
+};
+
+// Feeds the seat a result for its salvo in flight that it must reject.
+bool AcceptsForgedResult(PeerSession &session, std::uint8_t board,
+                         const CellMask &cells, const CellMask &hits,
+                         std::uint32_t nowMs) {
+  SeatState before = session.State();
+  SalvoResultMessage msg{static_cast<std::uint8_t>(MessageType::SalvoResult),
+                         before.shotSeq,
+                         {cells.bits[0], cells.bits[1]},
+                         {hits.bits[0], hits.bits[1]},
+                         board,
+                         static_cast<std::uint8_t>(kFleetShipCount)};
+  session.OnMessage(reinterpret_cast<const std::uint8_t *>(&msg), sizeof(msg),
+                    nowMs);
+  const SeatState &after = session.State();
+  return !(after.pendingSalvo == before.pendingSalvo) ||
+         after.enemyGrid != before.enemyGrid ||
+         after.hitsScored != before.hitsScored;
+}
+
+// A salvo just sent must hold a shot per ship the sender has afloat, or
+// every untried cell when fewer are left, and the sender must turn away
+// results for cells off the board or never fired at. Empty string when
+// all of that holds.
+std::string CheckSalvo(const char *seat, PeerSession &session,
+                       std::uint8_t resultBoard, CellMask &lastSalvo,
+                       std::uint32_t nowMs) {
+  const SeatState &state = session.State();
+  const CellMask salvo = state.pendingSalvo;
+  if (salvo.Empty() || salvo == lastSalvo) {
+    return std::string();
+  }
+  lastSalvo = salvo;
+  auto untried = static_cast<int>(std::count(
+      state.enemyGrid.begin(), state.enemyGrid.end(), CellState::Empty));
+  int expected = std::min(
+      CountAfloat(state.ships, state.shipLocations, state.playerGrid),
+      untried);
+  if (salvo.Count() != expected) {
+    return std::string(seat) + " fired a salvo of the wrong size";
+  }
+
+  CellMask offBoard = salvo;
+  offBoard.Set(kCellCount);
+  CellMask unfired;
+  for (int i = 0; i < kCellCount && unfired.Empty(); ++i) {
+    if (!salvo.Test(i)) {
+      unfired.Set(i);
+    }
+  }
+  if (AcceptsForgedResult(session, resultBoard, offBoard, offBoard, nowMs) ||
+      AcceptsForgedResult(session, resultBoard, salvo | unfired,
+                          salvo | unfired, nowMs) ||
+      AcceptsForgedResult(session, resultBoard, salvo, salvo | unfired,
+                          nowMs)) {
+    return std::string(seat) + " accepted a forged salvo result";
+  }
+  return std::string();
+}
+
+MatchResult RunMatch(const Scenario &scenario, std::uint32_t seed) {
+  const DeadlineConfig deadlines{2000, 5000};
+  std::mt19937 seeds(seed);
+
+  std::uint32_t clock = 0;
+  SimLink toGuest;
+  SimLink toHost;
+  toGuest.Reset(scenario.link, seeds());
+  toHost.Reset(scenario.link, seeds());
+  SimTransport hostTransport(toGuest, toHost, clock);
+  SimTransport guestTransport(toHost, toGuest, clock);
+
+  HostSession host(hostTransport, deadlines, seeds(), clock, scenario.mode);
+  GuestSession guest(guestTransport, seeds());
+  ScriptedPlayer hostPlayer(scenario, seeds());
+  ScriptedPlayer guestPlayer(scenario, seeds());
+
+  host.OnPeerConnected(clock);
+  hostPlayer.Start(clock);
+  guestPlayer.Start(clock);
+
+  MatchResult result;
+  CellMask hostSalvo;
+  CellMask guestSalvo;
+  for (; clock < kMaxMatchMs; clock += kTickMs) {
+    toGuest.Deliver(clock, [&](const std::uint8_t *data, std::size_t size) {
+      guest.OnMessage(data, size, clock);
+    });
+    toHost.Deliver(clock, [&](const std::uint8_t *data, std::size_t size) {
+      host.OnMessage(data, size, clock);
+    });
+
+    hostPlayer.Act(host, clock, deadlines);
+    guestPlayer.Act(guest, clock, deadlines);
+    host.Update(clock);
+    guest.Update(clock);
+    if (result.failure.empty()) {
+      result.failure =
+          CheckSalvo("host", host, kBoardClient, hostSalvo, clock);
+    }
+    if (result.failure.empty()) {
+      result.failure =
+          CheckSalvo("guest", guest, kBoardServer, guestSalvo, clock);
+    }
+    if (!result.failure.empty()) {
+      break;
+    }
+
+    bool dropped = toGuest.IsClosed();
+    bool hostDone = host.State().phase == Phase::Finished;
+    bool guestDone = guest.State().phase == Phase::Finished || dropped;
+    if (hostDone && guestDone && toGuest.IsIdle() && toHost.IsIdle()) {
+      break;
+    }
+    if (hostDone && guestDone && dropped) {
+      break;
+    }
+  }
+
+  result.durationMs = clock;
+  result.shots = host.ShotsFired()[0] + host.ShotsFired()[1];
+  const SeatState &hostState = host.State();
+  const SeatState &guestState = guest.State();
+
+  if (clock >= kMaxMatchMs) {
+    result.failure = "match stalled";
+    return result;
+  }
+  if (result.failure.empty()) {
+    result.failure = CheckSeat("host", hostState, guestState);
+  }
+  if (result.failure.empty()) {
+    result.failure = CheckSeat("guest", guestState, hostState);
+  }
+  if (result.failure.empty() && !toGuest.IsClosed() &&
+      (hostState.outcome == GameResult::Victory) !=
+          (guestState.outcome == GameResult::Defeat)) {
+    result.failure = "seats disagree on the winner";
+  }
+  return result;
+}
+
+LinkConfig Link(std::uint32_t latencyMs, std::uint32_t jitterMs,
+                double lossRate, double duplicateRate, bool reliable) {
+  LinkConfig link;
+  link.latencyMs = latencyMs;
+  link.jitterMs = jitterMs;
+  link.lossRate = lossRate;
+  link.duplicateRate = duplicateRate;
+  link.reliable = reliable;
+  return link;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned long matches = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+  std::uint32_t baseSeed =
+      argc > 2 ? static_cast<std::uint32_t>(std::strtoul(argv[2], nullptr, 10))
+               : 1;
+
+  const Scenario scenarios[] = {
+      {"lan", Link(1, 0, 0.0, 0.0, true), 0.0, 0.0, false},
+      {"wan", Link(60, 40, 0.05, 0.0, true), 0.0, 0.0, false},
+      {"idle", Link(30, 20, 0.0, 0.0, true), 0.0, 0.15, false},
+      {"impatient", Link(60, 40, 0.0, 0.0, true), 0.2, 0.0, false},
+      {"salvo", Link(60, 40, 0.05, 0.0, true), 0.2, 0.1, false,
+       GameMode::Salvo},
+      // the protocol assumes ENet's reliable channel: duplicates and
+      // reordering are harmless, but a lost final result is never resent
+      {"datagram", Link(40, 60, 0.02, 0.02, false), 0.0, 0.0, true},
+  };
+
+  bool failed = false;
+  if (!CheckShipsAfloat(baseSeed)) {
+    std::printf("ShipsAfloat disagrees with a per-ship count\n");
+    failed = true;
+  }
+  for (const Scenario &scenario : scenarios) {
+    unsigned long failures = 0;
+    std::uint32_t firstFailingSeed = 0;
+    std::string firstFailure;
+    double virtualSeconds = 0.0;
+    unsigned long shots = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < matches; ++i) {
+      std::uint32_t seed = baseSeed + static_cast<std::uint32_t>(i);
+      MatchResult result = RunMatch(scenario, seed);
+      virtualSeconds += result.durationMs / 1000.0;
+      shots += static_cast<unsigned long>(result.shots);
+      if (!result.failure.empty() && failures++ == 0) {
+        firstFailingSeed = seed;
+        firstFailure = result.failure;
+      }
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    std::printf("%-10s %6lu matches %8.0f matches/s %6.1f shots/match "
+                "%6.1fs/match  %lu failed",
+                scenario.name, matches, matches / seconds,
+                matches ? static_cast<double>(shots) / matches : 0.0,
+                matches ? virtualSeconds / matches : 0.0, failures);
+    if (failures > 0) {
+      std::printf(" (first: seed %u, %s)%s", firstFailingSeed,
+                  firstFailure.c_str(),
+                  scenario.knownIssue ? " [known issue]" : "");
+      failed = failed || !scenario.knownIssue;
+    }
+    std::printf("\n");
+  }
+  return failed ? 1 : 0;
+}
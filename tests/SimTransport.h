@@ -0,0 +1,149 @@
+// SimTransport.h
+#pragma once
+
+#include "Transport.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Network conditions for one direction of a simulated link.
+struct LinkConfig {
+  std::uint32_t latencyMs = 20;
+  std::uint32_t jitterMs = 0;
+  double lossRate = 0.0;
+  double duplicateRate = 0.0;
+  // ENet reliable channel semantics: every message arrives once and in
+  // order, a lost one just pays retransmitMs per loss and holds back the
+  // ones behind it. Otherwise messages are raw datagrams that can be lost,
+  // duplicated and reordered by jitter.
+  bool reliable = true;
+  std::uint32_t retransmitMs = 150;
+};
+
+// One direction of a link, delivering on a virtual millisecond clock.
+class SimLink {
+public:
+  static constexpr std::size_t kMaxMessageSize = 128;
+
+  void Reset(const LinkConfig &config, std::uint32_t seed) {
+    config_ = config;
+    rng_.seed(seed);
+    queue_.clear();
+    nextSequence_ = 0;
+    lastDeliveryMs_ = 0;
+    closed_ = false;
+  }
+
+  void Push(std::uint32_t nowMs, const void *data, std::size_t size) {
+    if (closed_ || size > kMaxMessageSize) {
+      return;
+    }
+    if (config_.reliable) {
+      std::uint32_t delay = Delay();
+      while (Chance(config_.lossRate)) {
+        delay += config_.retransmitMs;
+      }
+      lastDeliveryMs_ = std::max(lastDeliveryMs_, nowMs + delay);
+      Enqueue(lastDeliveryMs_, data, size);
+      return;
+    }
+
+    if (Chance(config_.lossRate)) {
+      return;
+    }
+    Enqueue(nowMs + Delay(), data, size);
+    if (Chance(config_.duplicateRate)) {
+      Enqueue(nowMs + Delay(), data, size);
+    }
+  }
+
+  // Calls fn(data, size) for every message due by nowMs, in arrival order.
+  template <typename Fn> void Deliver(std::uint32_t nowMs, Fn &&fn) {
+    while (!queue_.empty() && !closed_) {
+      auto first = std::min_element(queue_.begin(), queue_.end(), Earlier);
+      if (first->deliverMs > nowMs) {
+        return;
+      }
+      Packet packet = *first;
+      *first = queue_.back();
+      queue_.pop_back();
+      fn(packet.data.data(), packet.size);
+    }
+  }
+
+  void Close() { closed_ = true; }
+  bool IsClosed() const { return closed_; }
+  bool IsIdle() const { return queue_.empty(); }
+
+private:
+  struct Packet {
+    std::uint32_t deliverMs;
+    std::uint32_t sequence;
+    std::size_t size;
+    std::array<std::uint8_t, kMaxMessageSize> data;
+  };
+
+  static bool Earlier(const Packet &a, const Packet &b) {
+    return a.deliverMs != b.deliverMs ? a.deliverMs < b.deliverMs
+                                      : a.sequence < b.sequence;
+  }
+
+  bool Chance(double rate) {
+    return rate > 0.0 &&
+           std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < rate;
+  }
+
+  std::uint32_t Delay() {
+    if (config_.jitterMs == 0) {
+      return config_.latencyMs;
+    }
+    return config_.latencyMs +
+           std::uniform_int_distribution<std::uint32_t>(0, config_.jitterMs)(
+               rng_);
+  }
+
+  void Enqueue(std::uint32_t deliverMs, const void *data, std::size_t size) {
+    Packet packet;
+    packet.deliverMs = deliverMs;
+    packet.sequence = nextSequence_++;
+    packet.size = size;
+    std::memcpy(packet.data.data(), data, size);
+    queue_.push_back(packet);
+  }
+
+  LinkConfig config_;
+  std::mt19937 rng_;
+  std::vector<Packet> queue_;
+  std::uint32_t nextSequence_ = 0;
+  std::uint32_t lastDeliveryMs_ = 0;
+  bool closed_ = false;
+};
+
+// Stands in for the ENet peer: sends go into the outbound link, a
+// disconnect closes both directions.
+class SimTransport : public Transport {
+public:
+  SimTransport(SimLink &outbound, SimLink &inbound, const std::uint32_t &clock)
+      : outbound_(outbound), inbound_(inbound), clock_(clock) {}
+
+  void Send(const void *data, std::size_t size) override {
+    outbound_.Push(clock_, data, size);
+  }
+
+  void Disconnect() override {
+    outbound_.Close();
+    inbound_.Close();
+  }
+
+  using Transport::Send;
+
+private:
+  SimLink &outbound_;
+  SimLink &inbound_;
+  const std::uint32_t &clock_;
+};
@@ -0,0 +1,418 @@
+// Plays every registered strategy against every other on all cores, headless,
+// and reports how often each wins and how many shots a win takes.
+//
+//   tournament [max games per pairing] [base seed] [threads]
+//
+// Games are dealt out in fixed blocks seeded from the base seed, the pairing
+// and the block number, and a pairing's tally only ever takes its blocks in
+// order, so the report does not depend on the thread count. A pairing stops
+// early once its win rate is clearly away from even.
+
+#include "Board.h"
+#include "BotBrain.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr std::uint32_t kBlockGames = 256;
+// no pairing is called on fewer games than this
+constexpr std::uint64_t kMinGames = 2048;
+// Reported intervals are 95%. Stopping asks for 99.9% because the tally is
+// looked at again after every block.
+constexpr double kReportZ = 1.96;
+constexpr double kStopZ = 3.29;
+
+enum class Layout { Random, Edges };
+enum class Aim { Random, Hunt, Density };
+
+struct Strategy {
+  const char *name;
+  Layout layout;
+  Aim aim;
+};
+
+const Strategy kStrategies[] = {
+    {"random", Layout::Random, Aim::Random},
+    {"hunt", Layout::Random, Aim::Hunt},
+    {"density", Layout::Random, Aim::Density},
+    {"density-edge", Layout::Edges, Aim::Density},
+};
+constexpr int kStrategyCount = static_cast<int>(std::size(kStrategies));
+
+// Puts each ship on a random free spot touching the border while there is
+// one, a common habit of human players.
+void PlaceAlongEdges(Grid &grid, std::vector<Ship> &ships, int &shipIndex,
+                     std::vector<std::uint8_t> &locations, std::mt19937 &rng) {
+  struct Spot {
+    int x;
+    int y;
+    bool horizontal;
+  };
+  std::vector<Spot> spots;
+  for (; static_cast<std::size_t>(shipIndex) < ships.size(); ++shipIndex) {
+    Ship &ship = ships[shipIndex];
+    spots.clear();
+    for (int y = 0; y < kGridRows; ++y) {
+      for (int x = 0; x < kGridCols; ++x) {
+        for (bool horizontal : {true, false}) {
+          int endX = x + (horizontal ? ship.length - 1 : 0);
+          int endY = y + (horizontal ? 0 : ship.length - 1);
+          bool edge = x == 0 || y == 0 || endX == kGridCols - 1 ||
+                      endY == kGridRows - 1;
+          if (edge && CanPlaceShip(grid, x, y, ship.length, horizontal)) {
+            spots.push_back(Spot{x, y, horizontal});
+          }
+        }
+      }
+    }
+    if (spots.empty()) {
+      return;
+    }
+    const Spot &spot = spots[std::uniform_int_distribution<std::size_t>(
+        0, spots.size() - 1)(rng)];
+    ship.isHorizontal = spot.horizontal;
+    ApplyFill(grid, spot.x, spot.y, ship.length, ship.isHorizontal);
+    RecordShipCells(locations, spot.x, spot.y, ship);
+  }
+}
+
+CellMask PlaceFleet(Layout layout, std::mt19937 &rng) {
+  Grid grid{};
+  std::vector<Ship> ships = CreateFleet();
+  std::vector<std::uint8_t> locations;
+  int shipIndex = 0;
+  if (layout == Layout::Edges) {
+    PlaceAlongEdges(grid, ships, shipIndex, locations, rng);
+  }
+  // whatever is left, the way the game auto-places
+  AutoPlaceFleet(grid, ships, shipIndex, locations, rng);
+  return FleetMask(locations);
+}
+
+// Next to a hit while one has an untried neighbour, otherwise a random
+// untried cell of one checkerboard colour, which every ship longer than one
+// cell crosses.
+int PickHuntShot(const Grid &shots, std::mt19937 &rng) {
+  int chosen = -1;
+  int candidates = 0;
+  bool targeting = false;
+  for (int cell = 0; cell < kCellCount; ++cell) {
+    if (shots[cell] != CellState::Empty) {
+      continue;
+    }
+    int x = cell % kGridCols;
+    int y = cell / kGridCols;
+    bool nextToHit =
+        (x > 0 && shots[cell - 1] == CellState::Hit) ||
+        (x < kGridCols - 1 && shots[cell + 1] == CellState::Hit) ||
+        (y > 0 && shots[cell - kGridCols] == CellState::Hit) ||
+        (y < kGridRows - 1 && shots[cell + kGridCols] == CellState::Hit);
+    if (nextToHit && !targeting) {
+      targeting = true;
+      candidates = 0;
+    }
+    if ((targeting && !nextToHit) || (!targeting && (x + y) % 2 != 0)) {
+      continue;
+    }
+    ++candidates;
+    if (std::uniform_int_distribution<int>(1, candidates)(rng) == 1) {
+      chosen = cell;
+    }
+  }
+  return chosen >= 0 ? chosen : PickAutoShot(shots, rng);
+}
+
+// One classic game: a hit keeps the turn. Seat 0 plays the pairing's first
+// strategy.
+struct Game {
+  CellMask fleets[2];
+  Grid shots[2]; // each seat's targeting board
+  int hits[2] = {0, 0};
+  int fired[2] = {0, 0};
+  int turn = 0;
+  int winner = -1;
+};
+
+void Fire(Game &game, int cell) {
+  int seat = game.turn;
+  // a whole fleet always leaves something to fire at; never loop on it
+  if (cell < 0) {
+    game.winner = 1 - seat;
+    return;
+  }
+  ++game.fired[seat];
+  bool hit = game.fleets[1 - seat].Test(cell);
+  game.shots[seat][cell] = hit ? CellState::Hit : CellState::Miss;
+  if (hit && ++game.hits[seat] >= kFleetCellCount) {
+    game.winner = seat;
+  } else if (!hit) {
+    game.turn = 1 - seat;
+  }
+}
+
+struct Tally {
+  std::uint64_t games = 0;
+  std::uint64_t wins[2] = {0, 0};
+  std::uint64_t shotsToWin[2] = {0, 0};
+
+  void Add(const Tally &other) {
+    games += other.games;
+    for (int seat = 0; seat < 2; ++seat) {
+      wins[seat] += other.wins[seat];
+      shotsToWin[seat] += other.shotsToWin[seat];
+    }
+  }
+};
+
+// Plays one block of a pairing in lockstep, so every density shot of a step
+// is scored in one BotBrain batch. Even games open with seat 0.
+Tally PlayBlock(const Strategy &first, const Strategy &second,
+                std::uint32_t seed) {
+  std::mt19937 rng(seed);
+  BotBrain brain(static_cast<std::uint32_t>(rng()));
+  const Strategy *seats[2] = {&first, &second};
+
+  std::vector<Game> games(kBlockGames);
+  std::vector<std::uint32_t> live;
+  for (std::uint32_t g = 0; g < kBlockGames; ++g) {
+    Game &game = games[g];
+    for (int seat = 0; seat < 2; ++seat) {
+      game.fleets[seat] = PlaceFleet(seats[seat]->layout, rng);
+      ResetGrid(game.shots[seat]);
+    }
+    game.turn = static_cast<int>(g % 2);
+    live.push_back(g);
+  }
+
+  std::vector<BotBrain::Move> moves;
+  while (!live.empty()) {
+    for (std::uint32_t g : live) {
+      Game &game = games[g];
+      const Grid &board = game.shots[game.turn];
+      switch (seats[game.turn]->aim) {
+      case Aim::Random:
+        Fire(game, PickAutoShot(board, rng));
+        break;
+      case Aim::Hunt:
+        Fire(game, PickHuntShot(board, rng));
+        break;
+      case Aim::Density:
+        brain.Queue(g, board);
+        break;
+      }
+    }
+    brain.Evaluate(moves);
+    for (const BotBrain::Move &move : moves) {
+      Fire(games[move.token], move.cell);
+    }
+    live.erase(std::remove_if(live.begin(), live.end(),
+                              [&games](std::uint32_t g) {
+                                return games[g].winner >= 0;
+                              }),
+               live.end());
+  }
+
+  Tally tally;
+  tally.games = kBlockGames;
+  for (const Game &game : games) {
+    ++tally.wins[game.winner];
+    tally.shotsToWin[game.winner] +=
+        static_cast<std::uint64_t>(game.fired[game.winner]);
+  }
+  return tally;
+}
+
+// Wilson score interval for a win rate, sound near 0% and 100% too.
+void WinInterval(std::uint64_t wins, std::uint64_t games, double z,
+                 double &low, double &high) {
+  if (games == 0) {
+    low = 0.0;
+    high = 1.0;
+    return;
+  }
+  double n = static_cast<double>(games);
+  double p = wins / n;
+  double z2 = z * z;
+  double centre = (p + z2 / (2 * n)) / (1 + z2 / n);
+  double half =
+      z * std::sqrt(p * (1 - p) / n + z2 / (4 * n * n)) / (1 + z2 / n);
+  low = centre - half;
+  high = centre + half;
+}
+
+bool Significant(const Tally &tally) {
+  if (tally.games < kMinGames) {
+    return false;
+  }
+  double low = 0.0;
+  double high = 1.0;
+  WinInterval(tally.wins[0], tally.games, kStopZ, low, high);
+  return low > 0.5 || high < 0.5;
+}
+
+struct Pairing {
+  int first = 0;
+  int second = 0;
+  std::atomic<std::uint32_t> nextBlock{0};
+  std::atomic<bool> settled{false};
+
+  std::mutex lock;
+  std::vector<Tally> blocks; // by block number, games == 0 until played
+  std::uint32_t counted = 0; // blocks folded into tally, in order
+  Tally tally;
+};
+
+void Record(Pairing &pairing, std::uint32_t block, const Tally &result) {
+  std::lock_guard<std::mutex> hold(pairing.lock);
+  pairing.blocks[block] = result;
+  while (!pairing.settled.load(std::memory_order_relaxed) &&
+         pairing.counted < pairing.blocks.size() &&
+         pairing.blocks[pairing.counted].games > 0) {
+    pairing.tally.Add(pairing.blocks[pairing.counted++]);
+    if (Significant(pairing.tally)) {
+      pairing.settled.store(true, std::memory_order_release);
+    }
+  }
+}
+
+// Takes blocks round robin across the pairings still running; blocks
+// played past the one that settled a pairing are thrown away.
+void Work(std::vector<std::unique_ptr<Pairing>> &pairings,
+          std::uint32_t maxBlocks, std::uint32_t baseSeed,
+          std::atomic<std::size_t> &cursor) {
+  for (;;) {
+    Pairing *pairing = nullptr;
+    std::uint32_t block = 0;
+    for (std::size_t tries = 0; tries < pairings.size() && !pairing;
+         ++tries) {
+      Pairing &candidate = *pairings[cursor++ % pairings.size()];
+      if (candidate.settled.load(std::memory_order_acquire)) {
+        continue;
+      }
+      block = candidate.nextBlock++;
+      if (block < maxBlocks) {
+        pairing = &candidate;
+      }
+    }
+    if (!pairing) {
+      return;
+    }
+
+    std::seed_seq seeds{baseSeed,
+                        static_cast<std::uint32_t>(pairing->first),
+                        static_cast<std::uint32_t>(pairing->second), block};
+    std::uint32_t seed = 0;
+    seeds.generate(&seed, &seed + 1);
+    Record(*pairing, block,
+           PlayBlock(kStrategies[pairing->first],
+                     kStrategies[pairing->second], seed));
+  }
+}
+
+double MeanShots(const Tally &tally, int seat) {
+  return tally.wins[seat] ? static_cast<double>(tally.shotsToWin[seat]) /
+                                tally.wins[seat]
+                          : 0.0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned long maxGames =
+      argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  std::uint32_t baseSeed =
+      argc > 2 ? static_cast<std::uint32_t>(std::strtoul(argv[2], nullptr, 10))
+               : 1;
+  unsigned threads = argc > 3 ? static_cast<unsigned>(
+                                    std::strtoul(argv[3], nullptr, 10))
+                              : std::thread::hardware_concurrency();
+  threads = std::max(threads, 1u);
+  auto maxBlocks = static_cast<std::uint32_t>(
+      std::max<unsigned long>((maxGames + kBlockGames - 1) / kBlockGames, 1));
+
+  std::vector<std::unique_ptr<Pairing>> pairings;
+  for (int first = 0; first < kStrategyCount; ++first) {
+    for (int second = first + 1; second < kStrategyCount; ++second) {
+      auto pairing = std::make_unique<Pairing>();
+      pairing->first = first;
+      pairing->second = second;
+      pairing->blocks.resize(maxBlocks);
+      pairings.push_back(std::move(pairing));
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::atomic<std::size_t> cursor{0};
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.emplace_back(Work, std::ref(pairings), maxBlocks, baseSeed,
+                         std::ref(cursor));
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  std::printf("%-27s %9s %8s %17s %15s\n", "pairing", "games", "wins",
+              "95% interval", "shots to win");
+  Tally totals[kStrategyCount];
+  std::uint64_t played = 0;
+  for (const auto &pairing : pairings) {
+    const Tally &tally = pairing->tally;
+    double low = 0.0;
+    double high = 1.0;
+    WinInterval(tally.wins[0], tally.games, kReportZ, low, high);
+    std::printf("%-12s vs %-12s %9llu %7.2f%% [%6.2f, %6.2f] %6.1f / %6.1f"
+                "%s\n",
+                kStrategies[pairing->first].name,
+                kStrategies[pairing->second].name,
+                static_cast<unsigned long long>(tally.games),
+                tally.games ? 100.0 * tally.wins[0] / tally.games : 0.0,
+                100.0 * low, 100.0 * high, MeanShots(tally, 0),
+                MeanShots(tally, 1),
+                pairing->settled ? "" : "  (not significant)");
+    played += tally.games;
+
+    // the same games from each side's point of view
+    Tally mirrored;
+    mirrored.games = tally.games;
+    mirrored.wins[0] = tally.wins[1];
+    mirrored.shotsToWin[0] = tally.shotsToWin[1];
+    totals[pairing->first].Add(tally);
+    totals[pairing->second].Add(mirrored);
+  }
+
+  std::printf("\n%-12s %9s %8s %17s %15s\n", "strategy", "games", "wins",
+              "95% interval", "shots to win");
+  for (int i = 0; i < kStrategyCount; ++i) {
+    const Tally &tally = totals[i];
+    double low = 0.0;
+    double high = 1.0;
+    WinInterval(tally.wins[0], tally.games, kReportZ, low, high);
+    std::printf("%-12s %9llu %7.2f%% [%6.2f, %6.2f] %15.1f\n",
+                kStrategies[i].name,
+                static_cast<unsigned long long>(tally.games),
+                tally.games ? 100.0 * tally.wins[0] / tally.games : 0.0,
+                100.0 * low, 100.0 * high, MeanShots(tally, 0));
+  }
+
+  std::printf("\n%llu games in %.1fs on %u threads, %.0f games/s\n",
+              static_cast<unsigned long long>(played), seconds, threads,
+              played / seconds);
+  return 0;
+}